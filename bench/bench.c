@@ -0,0 +1,358 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+
+#include "pdp11.h"
+
+//pdp11bench: runs each workload repeatedly through the library on
+//one pinned CPU and prints median MIPS, ns/instruction and the run
+//to run variation as JSON. With -b it compares against a stored
+//baseline and exits 1 if a workload got slower than the threshold
+//allows. Decimal constants in the listings end in a dot, the rest
+//are octal
+
+//Nested countdowns: sub/bne and a one-instruction sob loop
+static const char countdown[] =
+    "012705 000310 " /*         mov #200., r5 */
+    "012700 116100 " /* outer:  mov #40000., r0 */
+    "162700 000001 " /* down:   sub #1, r0 */
+    "001375 "        /*         bne down */
+    "012701 116100 " /*         mov #40000., r1 */
+    "077101 "        /* loop:   sob r1, loop */
+    "077511 "        /*         sob r5, outer */
+    "000000 ";       /*         halt */
+
+//N = 1024 words copied with every addressing mode; SRC = 010000,
+//DST = 020000 and PTR = 030000 holds a pointer to each SRC word
+static const char copy[] =
+    "012700 010000 " /*         mov #SRC, r0 */
+    "012702 002000 " /*         mov #N, r2 */
+    "010220 "        /* fill:   mov r2, (r0)+ */
+    "077202 "        /*         sob r2, fill */
+    "012703 030000 " /*         mov #PTR, r3 */
+    "012700 010000 " /*         mov #SRC, r0 */
+    "012702 002000 " /*         mov #N, r2 */
+    "010023 "        /* table:  mov r0, (r3)+ */
+    "062700 000002 " /*         add #2, r0 */
+    "077204 "        /*         sob r2, table */
+    "012705 000764 " /*         mov #500., r5 */
+    "012700 010000 " /* pass:   mov #SRC, r0 */
+    "012701 020000 " /*         mov #DST, r1 */
+    "012702 002000 " /*         mov #N, r2 */
+    "012021 "        /* inc:    mov (r0)+, (r1)+ */
+    "077202 "        /*         sob r2, inc */
+    "012702 002000 " /*         mov #N, r2 */
+    "014041 "        /* dec:    mov -(r0), -(r1) */
+    "077202 "        /*         sob r2, dec */
+    "012702 002000 " /*         mov #N, r2 */
+    "011011 "        /* defer:  mov (r0), (r1) */
+    "062700 000002 " /*         add #2, r0 */
+    "062701 000002 " /*         add #2, r1 */
+    "077206 "        /*         sob r2, defer */
+    "012703 030000 " /*         mov #PTR, r3 */
+    "012701 020000 " /*         mov #DST, r1 */
+    "012702 002000 " /*         mov #N, r2 */
+    "013321 "        /* incdef: mov @(r3)+, (r1)+ */
+    "077202 "        /*         sob r2, incdef */
+    "012702 002000 " /*         mov #N, r2 */
+    "015341 "        /* decdef: mov @-(r3), -(r1) */
+    "077202 "        /*         sob r2, decdef */
+    "012702 002000 " /*         mov #N, r2 */
+    "013704 010000 " /* abs:    mov @#SRC, r4 */
+    "010437 020000 " /*         mov r4, @#DST */
+    "077205 "        /*         sob r2, abs */
+    "012702 002000 " /*         mov #N, r2 */
+    "016004 000002 " /* index:  mov 2(r0), r4 */
+    "017004 000002 " /*         mov @2(r0), r4 */
+    "077205 "        /*         sob r2, index */
+    "162705 000001 " /*         sub #1, r5 */
+    "001317 "        /*         bne pass */
+    "000000 ";       /*         halt */
+
+//Short blocks ending in branches taken with periods of 3, 5 and 15
+static const char branches[] =
+    "012705 000024 " /*         mov #20., r5 */
+    "012700 141520 " /* outer:  mov #50000., r0 */
+    "012701 000003 " /*         mov #3, r1 */
+    "012702 000005 " /*         mov #5, r2 */
+    "162701 000001 " /* loop:   sub #1, r1 */
+    "001004 "        /*         bne skip3 */
+    "012701 000003 " /*         mov #3, r1 */
+    "062703 000001 " /*         add #1, r3 */
+    "162702 000001 " /* skip3:  sub #1, r2 */
+    "001004 "        /*         bne skip5 */
+    "012702 000005 " /*         mov #5, r2 */
+    "062704 000001 " /*         add #1, r4 */
+    "020102 "        /* skip5:  cmp r1, r2 */
+    "001401 "        /*         beq same */
+    "000402 "        /*         br next */
+    "062706 000001 " /* same:   add #1, r6 */
+    "162700 000001 " /* next:   sub #1, r0 */
+    "001352 "        /*         bne loop */
+    "077535 "        /*         sob r5, outer */
+    "000000 ";       /*         halt */
+
+//Long straight-line block of register and memory arithmetic;
+//VAR = 010000
+static const char arith[] =
+    "012705 000020 " /*         mov #16., r5 */
+    "012700 000001 " /*         mov #1, r0 */
+    "012702 000002 " /*         mov #2, r2 */
+    "012704 141520 " /* outer:  mov #50000., r4 */
+    "060001 "        /* loop:   add r0, r1 */
+    "160203 "        /*         sub r2, r3 */
+    "006301 "        /*         asl r1 */
+    "062700 012345 " /*         add #12345, r0 */
+    "006202 "        /*         asr r2 */
+    "060102 "        /*         add r1, r2 */
+    "020003 "        /*         cmp r0, r3 */
+    "162703 000007 " /*         sub #7, r3 */
+    "060337 010000 " /*         add r3, @#VAR */
+    "006337 010000 " /*         asl @#VAR */
+    "077417 "        /*         sob r4, loop */
+    "077522 "        /*         sob r5, outer */
+    "000000 ";       /*         halt */
+
+//One program to time
+typedef struct workload_t{
+    const char *name;
+    const char *program; //octal words, as in a .in file
+    size_t length;
+} workload_t;
+
+//Timings of one workload over all runs
+typedef struct result_t{
+    int instructions;
+    double medianMips;
+    double nsPerInstruction;
+    double variance; //of MIPS, between runs
+    double stddevPercent; //standard deviation over the median
+} result_t;
+
+static int compareDoubles(const void *a, const void *b){
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* the whole of a .in file, as an extra workload */
+static bool readWorkload(const char *fileName, workload_t *w){
+    FILE *in = fopen(fileName, "r");
+    char *text = NULL;
+    long size;
+
+    if(in == NULL){
+        fprintf(stderr, "Error: cannot open %s\n", fileName);
+        return false;
+    }
+    if(fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= 0 && fseek(in, 0, SEEK_SET) == 0
+       && (text = malloc(size + 1)) != NULL && fread(text, 1, size, in) == (size_t)size){
+        w->name = fileName;
+        w->program = text;
+        w->length = size;
+        fclose(in);
+        return true;
+    }
+    fprintf(stderr, "Error: cannot read %s\n", fileName);
+    free(text);
+    fclose(in);
+    return false;
+}
+
+/* one untimed run to warm the block cache and compiled */
+/*   code, then runs timed from the loaded state         */
+static bool timeWorkload(const workload_t *w, int runs, result_t *r){
+    pdp11_t *m = pdp11_create(stderr);
+    double *mips = malloc(runs * sizeof(double));
+    double mean = 0;
+    struct timespec start, end;
+    pdp11_stats_t stats;
+
+    if(m == NULL || mips == NULL || !pdp11_load_octal(m, w->program, w->length)){
+        fprintf(stderr, "Error: cannot load workload %s\n", w->name);
+        if(m != NULL){
+            pdp11_destroy(m);
+        }
+        free(mips);
+        return false;
+    }
+    pdp11_run(m, PDP11_NO_LIMIT);
+    pdp11_get_stats(m, &stats);
+    r->instructions = stats.instructions;
+
+    for(int i = 0; i < runs; i++){
+        pdp11_reset(m);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pdp11_run(m, PDP11_NO_LIMIT);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        pdp11_get_stats(m, &stats);
+        if(stats.instructions != r->instructions){
+            fprintf(stderr, "Error: workload %s ran %d instructions, then %d\n", w->name, r->instructions, stats.instructions);
+            pdp11_destroy(m);
+            free(mips);
+            return false;
+        }
+        mips[i] = stats.instructions / ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3);
+        mean += mips[i] / runs;
+    }
+    pdp11_destroy(m);
+
+    r->variance = 0;
+    for(int i = 0; i < runs; i++){
+        r->variance += (mips[i] - mean) * (mips[i] - mean) / (runs > 1 ? runs - 1 : 1);
+    }
+    qsort(mips, runs, sizeof(double), compareDoubles);
+    r->medianMips = runs % 2 ? mips[runs / 2] : (mips[runs / 2 - 1] + mips[runs / 2]) / 2;
+    r->nsPerInstruction = 1e3 / r->medianMips;
+    r->stddevPercent = sqrt(r->variance) * 100 / r->medianMips;
+    free(mips);
+    return true;
+}
+
+/* s as a JSON string, quotes included, escaping quotes, */
+/*   backslashes and control characters; cut short to    */
+/*   fit size                                            */
+static void jsonString(char *out, size_t size, const char *s){
+    size_t n = 0;
+
+    out[n++] = '"';
+    for(; *s != '\0' && n + 8 < size; s++){
+        unsigned char c = *s;
+
+        if(c == '"' || c == '\\'){
+            out[n++] = '\\';
+            out[n++] = c;
+        }
+        else if(c < 040){
+            n += snprintf(out + n, size - n, "\\u%04x", c);
+        }
+        else{
+            out[n++] = c;
+        }
+    }
+    out[n++] = '"';
+    out[n] = '\0';
+}
+
+/* median MIPS of a workload in a file this program wrote, */
+/*   or a negative number if it is not there               */
+static double baselineMips(const char *baseline, const char *name){
+    char key[1100], quoted[1024];
+    const char *p;
+
+    jsonString(quoted, sizeof(quoted), name);
+    snprintf(key, sizeof(key), "\"name\": %s,", quoted);
+    p = baseline != NULL ? strstr(baseline, key) : NULL;
+    if(p == NULL || (p = strstr(p, "\"median_mips\": ")) == NULL){
+        return -1;
+    }
+    return atof(p + strlen("\"median_mips\": "));
+}
+
+int main(int argc, char **argv){
+    workload_t workloads[64] = {
+        { "countdown", countdown, sizeof(countdown) - 1 },
+        { "copy", copy, sizeof(copy) - 1 },
+        { "branches", branches, sizeof(branches) - 1 },
+        { "arith", arith, sizeof(arith) - 1 },
+    };
+    int count = 4;
+    int runs = 11;
+    int cpu = 0; //-1 to leave the scheduler to it
+    double threshold = 10; //percent slower than the baseline that fails
+    const char *baselineFile = NULL;
+    char *baseline = NULL;
+    int regressions = 0;
+    char quoted[1024];
+    cpu_set_t cpus;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+            runs = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc){
+            cpu = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc){
+            baselineFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc){
+            threshold = atof(argv[++i]);
+        }
+        else if(argv[i][0] != '-' && count < 64){
+            if(!readWorkload(argv[i], &workloads[count])){
+                return 1;
+            }
+            count++;
+        }
+    }
+    if(runs < 1){
+        runs = 1;
+    }
+
+    if(cpu >= 0){
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if(sched_setaffinity(0, sizeof(cpus), &cpus) != 0){
+            fprintf(stderr, "Error: cannot pin to CPU %d, running unpinned\n", cpu);
+            cpu = -1;
+        }
+    }
+
+    if(baselineFile != NULL){
+        workload_t file;
+
+        if(!readWorkload(baselineFile, &file)){
+            return 1;
+        }
+        baseline = (char*)file.program;
+        baseline[file.length] = '\0';
+    }
+
+    printf("{\n  \"runs\": %d,\n  \"cpu\": %d,\n", runs, cpu);
+    if(baselineFile != NULL){
+        jsonString(quoted, sizeof(quoted), baselineFile);
+        printf("  \"baseline\": %s,\n  \"threshold_percent\": %.1f,\n", quoted, threshold);
+    }
+    printf("  \"workloads\": [\n");
+    for(int i = 0; i < count; i++){
+        result_t r;
+        double base;
+
+        if(!timeWorkload(&workloads[i], runs, &r)){
+            return 1;
+        }
+        jsonString(quoted, sizeof(quoted), workloads[i].name);
+        printf("    {\n      \"name\": %s,\n", quoted);
+        printf("      \"instructions\": %d,\n", r.instructions);
+        printf("      \"median_mips\": %.2f,\n", r.medianMips);
+        printf("      \"ns_per_instruction\": %.4g,\n", r.nsPerInstruction);
+        printf("      \"variance\": %.3f,\n", r.variance);
+        printf("      \"stddev_percent\": %.2f", r.stddevPercent);
+
+        base = baselineMips(baseline, workloads[i].name);
+        if(base > 0){
+            double change = (r.medianMips - base) * 100 / base;
+            bool regressed = change < -threshold;
+
+            printf(",\n      \"baseline_mips\": %.2f,\n", base);
+            printf("      \"change_percent\": %.2f,\n", change);
+            printf("      \"regressed\": %s", regressed ? "true" : "false");
+            if(regressed){
+                fprintf(stderr, "Error: %s is %.1f%% slower than the baseline\n", workloads[i].name, -change);
+                regressions++;
+            }
+        }
+        printf("\n    }%s\n", i + 1 < count ? "," : "");
+        fflush(stdout);
+    }
+    printf("  ],\n  \"regressions\": %d\n}\n", regressions);
+
+    free(baseline);
+    return regressions > 0 ? 1 : 0;
+}
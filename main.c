@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pdp11.h"
+
+//A --break, --watch or --watch-read, on the words first to last
+typedef struct watch_t{
+    int kind;
+    int first;
+    int last;
+} watch_t;
+
+/* addr or first-last, in octal; false if it is neither, or last is before first */
+static bool parseRange(const char *text, watch_t *w){
+    int n = sscanf(text, "%o-%o", &w->first, &w->last);
+
+    if(n == 1){
+        w->last = w->first;
+    }
+    return n >= 1 && w->first <= w->last;
+}
+
+/* --restore: the machine as a snapshot file left it */
+static bool restoreFrom(pdp11_t *m, const char *fileName){
+    pdp11_snapshot_t *s = pdp11_read_snapshot(m, fileName);
+    bool restored = s != NULL && pdp11_restore(m, s);
+
+    pdp11_free_snapshot(s);
+    return restored;
+}
+
+/* --snapshot: run to instruction at, to PC atPc, or else */
+/*   to HALT, and save the state there                    */
+static bool saveSnapshot(pdp11_t *m, const char *fileName, long at, int atPc){
+    pdp11_snapshot_t *s;
+    bool saved;
+
+    if(at >= 0){
+        pdp11_run(m, at);
+    }
+    else if(atPc >= 0){
+        if(pdp11_run_to(m, atPc, PDP11_NO_LIMIT) == PDP11_HALTED){
+            printf("Error: halted before reaching PC %06o\n", atPc);
+            return false;
+        }
+    }
+    else{
+        pdp11_run(m, PDP11_NO_LIMIT);
+    }
+    s = pdp11_snapshot(m);
+    saved = s != NULL && pdp11_write_snapshot(m, s, fileName);
+    pdp11_free_snapshot(s);
+    return saved;
+}
+
+/* where a --debug command left the machine */
+static void showPosition(pdp11_t *m){
+    int r[8];
+
+    for(int i = 0; i < 8; i++){
+        r[i] = pdp11_get_register(m, i);
+    }
+    printf("instruction %ld%s\n", pdp11_position(m), pdp11_halted(m) ? ", halted" : "");
+    printf("  R0:0%06o  R2:0%06o  R4:0%06o  R6:0%06o\n", r[0], r[2], r[4], r[6]);
+    printf("  R1:0%06o  R3:0%06o  R5:0%06o  R7:0%06o\n", r[1], r[3], r[5], r[7]);
+}
+
+/* --debug: record the loaded program and run the commands */
+/*   in the file, one per line, moving either way through  */
+/*   the run:                                              */
+/*     run [n]       n instructions on, or on to HALT      */
+/*     back [n]      n instructions back, 1 by default     */
+/*     goto n        to the point after n instructions     */
+/*     back-to pc    back to the last time the PC was pc   */
+/*     who addr      the last instruction to write addr    */
+/*     regs          the position and registers            */
+/*     history       what the recording holds              */
+/*   addresses in octal; 1 if any command failed           */
+static int debug(pdp11_t *m, const char *commandFile, long interval, int keep){
+    FILE *in = strcmp(commandFile, "-") == 0 ? stdin : fopen(commandFile, "r");
+    char line[256];
+    int status = 0;
+
+    if(in == NULL){
+        printf("Error: cannot open %s\n", commandFile);
+        return 1;
+    }
+    if(!pdp11_record(m, interval, keep)){
+        status = 1;
+    }
+    while(pdp11_position(m) >= 0 && fgets(line, sizeof(line), in) != NULL){
+        char command[32] = "";
+        long n;
+        int pc, value;
+        int args = sscanf(line, "%31s %ld", command, &n);
+        pdp11_history_t h;
+
+        if(args < 1 || command[0] == '#'){
+            continue;
+        }
+        printf("> %s", line);
+        if(strcmp(command, "run") == 0){
+            pdp11_run(m, args == 2 ? n : PDP11_NO_LIMIT);
+        }
+        else if(strcmp(command, "back") == 0 || (strcmp(command, "goto") == 0 && args == 2)){
+            if(!pdp11_seek(m, command[0] == 'b' ? pdp11_position(m) - (args == 2 ? n : 1) : n)){
+                status = 1;
+                continue;
+            }
+        }
+        else if(strcmp(command, "back-to") == 0 && sscanf(line, "%*s %o", &pc) == 1){
+            n = pdp11_find_pc(m, pc);
+            if(n < 0){
+                printf("PC 0%06o was not reached before this\n", pc);
+                continue;
+            }
+            pdp11_seek(m, n);
+        }
+        else if(strcmp(command, "who") == 0 && sscanf(line, "%*s %o", &value) == 1){
+            int addr = value;
+
+            n = pdp11_find_write(m, addr, &pc, &value);
+            if(n < 0){
+                printf("0%06o was not written before this\n", addr);
+            }
+            else{
+                printf("0%06o was last written by instruction %ld at PC 0%06o, with 0%06o\n", addr, n, pc, value);
+            }
+            continue;
+        }
+        else if(strcmp(command, "history") == 0){
+            pdp11_get_history(m, &h);
+            printf("instructions %ld to %ld recorded, %d checkpoints every %ld%s\n",
+                   h.first, h.end, h.checkpoints, h.interval, h.complete ? "" : ", incomplete");
+            printf("  memory pages %zu KB, logs %zu KB, in all %zu KB\n",
+                   h.pageBytes / 1024, h.logBytes / 1024, h.totalBytes / 1024);
+            continue;
+        }
+        else if(strcmp(command, "regs") != 0){
+            printf("Error: unknown command %s\n", command);
+            status = 1;
+            continue;
+        }
+        showPosition(m);
+    }
+    if(in != stdin){
+        fclose(in);
+    }
+    return status;
+}
+
+/* the pdp11 command: options into pdp11_options_t, then */
+/*   one library call for the mode they select           */
+int main(int argc, char **argv) {
+    pdp11_options_t options = { 0 };
+    const char **programFiles = malloc(argc * sizeof(char*));
+    int programCount = 0;
+    int benchRuns = 0;
+    const char *imageFile = NULL; //-w: save the loaded program as a raw image
+    const char *translateFile = NULL; //--translate: write the program out as C
+    const char *sweepFile = NULL; //--sweep: initial states to run the program from
+    const char *decodeFile = NULL; //--decode: print a -T file as -t or -v would
+    const char *snapshotFile = NULL; //--snapshot: save the state partway, then run on
+    long snapshotAt = -1; //--at: take it after this many instructions
+    int snapshotPc = -1; //--at-pc: or when the PC first reaches this, in octal
+    const char *restoreFile = NULL; //--restore: run from a snapshot, not a program
+    const char *debugFile = NULL; //--debug: commands to move through a recorded run
+    long checkpointInterval = 0; //--checkpoint: instructions between --debug checkpoints
+    int checkpointsKept = 0; //--keep: the most checkpoints --debug keeps, 0 for all
+    watch_t *watches = malloc(argc * sizeof(watch_t)); //--break, --watch and --watch-read, in octal
+    int watchCount = 0;
+    int watchAction = PDP11_WATCH_REPORT; //--on-watch: report, log or stop
+    long fuzzCount = 0; //--fuzz: random programs to compare the engines on
+    unsigned long fuzzSeed = (unsigned long)time(NULL); //--seed: the first of them
+    pdp11_t *m;
+    int status = 0;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-t") == 0){
+            options.trace = true;
+        }
+        else if(strcmp(argv[i], "-v") == 0){
+            options.verbose = true;
+        }
+        else if(strcmp(argv[i], "-s") == 0){
+            options.stats = true;
+        }
+        else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc){
+            benchRuns = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-r") == 0){
+            options.rawImage = true;
+        }
+        else if(strcmp(argv[i], "-w") == 0 && i + 1 < argc){
+            imageFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-p") == 0){
+            options.profile = true;
+        }
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+            options.workers = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--translate") == 0 && i + 1 < argc){
+            translateFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "--sweep") == 0 && i + 1 < argc){
+            sweepFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "-T") == 0 && i + 1 < argc){
+            options.binaryTrace = argv[++i];
+        }
+        else if(strcmp(argv[i], "-z") == 0){
+            options.compressTrace = true;
+        }
+        else if(strcmp(argv[i], "-c") == 0){
+            options.timing = true;
+        }
+        else if(strcmp(argv[i], "--cache") == 0 && i + 1 < argc){
+            options.cache = argv[++i];
+        }
+        else if(strcmp(argv[i], "--console") == 0 && i + 1 < argc){
+            options.console = argv[++i];
+        }
+        else if(strcmp(argv[i], "--clock") == 0 && i + 1 < argc){
+            options.clock = atol(argv[++i]);
+        }
+        else if((strcmp(argv[i], "--break") == 0 || strcmp(argv[i], "--watch") == 0 ||
+                 strcmp(argv[i], "--watch-read") == 0) && i + 1 < argc){
+            watch_t *w = &watches[watchCount];
+
+            w->kind = argv[i][2] == 'b' ? PDP11_BREAK : argv[i][7] == '-' ? PDP11_WATCH_READ : PDP11_WATCH_WRITE;
+            if(!parseRange(argv[++i], w)){
+                printf("Error: %s is not an address or address range\n", argv[i]);
+                free(watches);
+                free(programFiles);
+                return 1;
+            }
+            watchCount++;
+        }
+        else if(strcmp(argv[i], "--on-watch") == 0 && i + 1 < argc){
+            i++;
+            watchAction = strcmp(argv[i], "log") == 0 ? PDP11_WATCH_LOG :
+                strcmp(argv[i], "stop") == 0 ? PDP11_WATCH_STOP : PDP11_WATCH_REPORT;
+        }
+        else if(strcmp(argv[i], "--decode") == 0 && i + 1 < argc){
+            decodeFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc){
+            snapshotFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "--at") == 0 && i + 1 < argc){
+            snapshotAt = strtol(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--at-pc") == 0 && i + 1 < argc){
+            snapshotPc = strtol(argv[++i], NULL, 8) & 0177777;
+        }
+        else if(strcmp(argv[i], "--restore") == 0 && i + 1 < argc){
+            restoreFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "--debug") == 0 && i + 1 < argc){
+            debugFile = argv[++i];
+        }
+        else if(strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc){
+            fuzzCount = atol(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc){
+            fuzzSeed = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc){
+            checkpointInterval = atol(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--keep") == 0 && i + 1 < argc){
+            checkpointsKept = atoi(argv[++i]);
+        }
+        else if(argv[i][0] != '-'){
+            programFiles[programCount++] = argv[i];
+        }
+    }
+    if(!pdp11_configure(&options)){
+        free(watches);
+        free(programFiles);
+        return 1;
+    }
+
+    /* a -T file rather than a program */
+    if(decodeFile != NULL){
+        free(watches);
+        free(programFiles);
+        return pdp11_decode_trace(decodeFile) ? 0 : 1;
+    }
+
+    /* random programs, written out where the engines differ */
+    if(fuzzCount > 0){
+        free(watches);
+        free(programFiles);
+        if(programCount > 0){
+            printf("Error: --fuzz makes its own programs\n");
+            return 1;
+        }
+        return pdp11_fuzz(fuzzCount, fuzzSeed);
+    }
+
+    /* several programs: run each on its own machine */
+    if(programCount > 1){
+        if(imageFile != NULL || benchRuns > 0 || translateFile != NULL || sweepFile != NULL || options.binaryTrace != NULL ||
+           snapshotFile != NULL || restoreFile != NULL || debugFile != NULL || options.console != NULL || watchCount > 0){
+            printf("Error: -w, -b, -T, --translate, --sweep, --snapshot, --restore, --debug, --console, --break and --watch take a single program\n");
+            status = 1;
+        }
+        else{
+            status = pdp11_run_batch(programFiles, programCount);
+        }
+        free(watches);
+        free(programFiles);
+        return status;
+    }
+
+    m = pdp11_create(stdout);
+    if(m == NULL){
+        printf("Error: out of memory for machine\n");
+        free(watches);
+        free(programFiles);
+        return 1;
+    }
+    for(int i = 0; i < watchCount; i++){
+        pdp11_watch(m, watches[i].kind, watches[i].first, watches[i].last, true);
+    }
+    pdp11_watch_action(m, watchAction);
+    if(options.console != NULL && (benchRuns > 0 || sweepFile != NULL)){
+        printf("Error: --console does not go with -b or --sweep\n");
+        status = 1;
+    }
+    else if(watchCount > 0 && (benchRuns > 0 || sweepFile != NULL || translateFile != NULL)){
+        printf("Error: --break and --watch do not go with -b, --sweep or --translate\n");
+        status = 1;
+    }
+    else if(options.console != NULL && strcmp(options.console, "-") == 0 && programCount == 0 && restoreFile == NULL){
+        printf("Error: --console - needs the program in a file\n");
+        status = 1;
+    }
+    else if(restoreFile != NULL && (programCount > 0 || imageFile != NULL || translateFile != NULL || sweepFile != NULL || benchRuns > 0)){
+        printf("Error: --restore replaces the program and runs it\n");
+        status = 1;
+    }
+    else if(restoreFile != NULL ? !restoreFrom(m, restoreFile) : !pdp11_load_file(m, programCount == 1 ? programFiles[0] : NULL)){
+        status = 1;
+    }
+    else if(imageFile != NULL){
+        status = pdp11_write_image(m, imageFile) ? 0 : 1;
+    }
+    else if(translateFile != NULL){
+        status = pdp11_translate(m, translateFile) ? 0 : 1;
+    }
+    else if(sweepFile != NULL){
+        status = pdp11_sweep(m, sweepFile);
+    }
+    else if(benchRuns > 0){
+        pdp11_benchmark(m, benchRuns);
+    }
+    else if(snapshotFile != NULL && !saveSnapshot(m, snapshotFile, snapshotAt, snapshotPc)){
+        status = 1;
+    }
+    else if(debugFile != NULL){
+        status = debug(m, debugFile, checkpointInterval, checkpointsKept);
+    }
+    else{
+        status = pdp11_run_program(m) ? 0 : 1;
+    }
+
+    pdp11_destroy(m);
+    free(watches);
+    free(programFiles);
+    return status;
+}
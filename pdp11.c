@@ -1,31 +1,128 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <limits.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "pdp11.h"
+#include "pdp11rt.h"
 
 #define MEM_SIZE_IN_WORDS 32*1024
 #define SET 1
 #define CLEAR 0
 #define CLAMP_16_BIT 0177777
 #define LOW_ORDER_MASK 0200000
+#define MAX_BLOCK_INSTRS 32
+
+//Lanes --sweep steps together: one host vector register of 32-bit
+//lanes, so build with -mavx2 or -mavx512f for wider steps
+#if defined(__AVX512F__)
+#define SWEEP_WIDTH 16
+#elif defined(__AVX2__)
+#define SWEEP_WIDTH 8
+#else
+#define SWEEP_WIDTH 4
+#endif
+
+//Build with -DCHECKED to turn on the operand range assertions
+#ifdef CHECKED
+#define CHECK(cond) assert(cond)
+#else
+#define CHECK(cond) ((void)0)
+#endif
+
+//Build with -DCACHE_SIM for the --cache memory hierarchy model; the
+//operand handlers and fetch() report each guest access through
+//CACHE_ACCESS(), which compiles to nothing otherwise
+#ifdef CACHE_SIM
+#define CACHE_MAX 5 //caches in a hierarchy, a split first level counting two
+#define CACHE_TOP_PCS 16 //PCs in the report, those that missed most
+#define CACHE_ACCESS(m, kind, addr) do{ \
+        if((m)->cache != NULL) cacheAccess((m)->cache, kind, addr); \
+    }while(0)
+#else
+#define CACHE_ACCESS(m, kind, addr) ((void)0)
+#endif
+
+//Dispatch styles, selected at build time with -DDISPATCH=<style>
+//  DISPATCH_SWITCH   - switch on the predecoded opcode class
+//  DISPATCH_TABLE    - call through a table of handler function pointers
+//  DISPATCH_THREADED - computed goto (GCC/Clang labels as values)
+#define DISPATCH_SWITCH 1
+#define DISPATCH_TABLE 2
+#define DISPATCH_THREADED 3
+
+#ifndef DISPATCH
+#define DISPATCH DISPATCH_TABLE
+#endif
+
+//Hot blocks are compiled to x86-64 code; build with -DNO_JIT to
+//interpret everything. Other hosts always interpret
+#if defined(__x86_64__) && !defined(NO_JIT)
+#define JIT 1
+#define JIT_THRESHOLD 16 //block entries before it is compiled
+#define JIT_BUFFER_SIZE (1 << 20) //bytes of code per machine
+#define JIT_MAX_BLOCK_CODE 16384 //upper bound for one block
+#endif
+
+#define TRACE_MAGIC "PDP11TRC"
+#define TRACE_RING_SIZE (1 << 16) //records buffered for the writer, a power of two
+#define TRACE_WORDS 7 //trace_record_t in 64-bit words, for -z
+#define TRACE_PACKED_MAX (1 + TRACE_WORDS + TRACE_WORDS * 8) //bytes for one record with -z
 
-//Condition codes
-int n_psw = 0;
-int z_psw = 0;
-int v_psw = 0;
-int c_psw = 0;
+#define SNAPSHOT_MAGIC "PDP11SNP"
+#define SNAPSHOT_FIELDS 24 //32-bit words of state ahead of memory in a snapshot file
 
-int halt = 0;
+#define HISTORY_INTERVAL 10000 //default instructions between time-travel checkpoints
+#define HISTORY_PAGE_WORDS 2048 //a checkpoint keeps memory in 4 KB pages
+#define HISTORY_PAGES (MEM_SIZE_IN_WORDS / HISTORY_PAGE_WORDS)
+#define LOG_WRITE 0x80000000u //history log entry: word address << 16 | value written
+#define LOG_REG 0x40000000u //register << 16 | new value; otherwise the PC an instruction ran at
 
-int instrExecs = 0;
-int instrFetches = 0;
-int memReads = 0;
-int memWrites = 0;
-int branches = 0;
-int branch_taken = 0;
+#define HALT_BUDGET 2 //halt while a bounded pdp11_run() is paused
+#define HALT_WATCH 3 //halt at a breakpoint or watchpoint that stops the run
 
-bool verboseMode = false;
-bool traceMode = false;
+#define CONSOLE_RCSR 0177560 //--console: receiver status, then its buffer,
+#define CONSOLE_RBUF 0177562 //  transmitter status and its buffer
+#define CONSOLE_XCSR 0177564
+#define CONSOLE_XBUF 0177566
+#define CONSOLE_BUFFER 4096 //bytes read ahead, and written out at once
+#define CONSOLE_IDLE_POLLS 256 //RCSR reads between tries at input that was not there
+
+#define IO_PAGE 0160000 //device registers from here up, with --console or --clock
+#define CLOCK_LKS 0177546 //--clock: the KW11-L line clock status register
+#define CLOCK_VECTOR 0100
+#define CLOCK_PRIORITY 6
+#define PSW_ADDR 0177776 //the processor status word, with the devices
+#define EVENT_MAX 8 //device events scheduled at once
+
+//Options, set by pdp11_configure()
+static bool verboseMode = false;
+static bool traceMode = false;
+static bool statsMode = false;
+static bool rawImage = false;
+static bool profileMode = false;
+static int workerCount = 0; //-j: batch mode threads, 0 for one per CPU
+static const char *binaryTraceFile = NULL; //-T: record every instruction in binary
+static bool compressTrace = false; //-z: compress the -T records
+static bool timingMode = false; //-c: charge each instruction its LSI-11 time
+static const char *consoleFile = NULL; //--console: input for the DL11 console, - for stdin
+static long clockInterval = 0; //--clock: instructions, or cycles with -c, between ticks
 
 typedef struct address_phrase_t{
     int mode;
@@ -34,662 +131,7793 @@ typedef struct address_phrase_t{
     int value;
 } address_phrase_t;
 
-int mem[MEM_SIZE_IN_WORDS]; 
-int reg[8] = {0}; 
-int ir; 
-address_phrase_t src, dst; 
+//Opcode classes, in the order the decoder tests for them
+enum {
+    OP_HALT,
+    OP_MOV,
+    OP_CMP,
+    OP_ADD,
+    OP_SUB,
+    OP_SOB,
+    OP_BR,
+    OP_BNE,
+    OP_BEQ,
+    OP_BPL,
+    OP_BMI,
+    OP_BHI,
+    OP_BLOS,
+    OP_BVC,
+    OP_BVS,
+    OP_BCC,
+    OP_BCS,
+    OP_BGE,
+    OP_BLT,
+    OP_BGT,
+    OP_BLE, //SOB to here are the branches, see isBranch()
+    OP_ASR,
+    OP_ASL,
+    OP_CLR,
+    OP_INC,
+    OP_DEC,
+    OP_NEG,
+    OP_TST,
+    OP_JSR,
+    OP_RTS,
+    OP_RTI,
+    OP_MUL,
+    OP_DIV,
+    OP_ASH,
+    OP_ASHC,
+    OP_ILLEGAL,
+    OP_COUNT
+};
+
+typedef struct machine_t machine_t;
+typedef struct trace_ring_t trace_ring_t;
+typedef struct snapshot_t snapshot_t;
+typedef struct history_t history_t;
+
+typedef void (*operand_fn)(machine_t*, address_phrase_t*);
+typedef void (*result_fn)(machine_t*, address_phrase_t*, int);
+
+//Predecoded form of one 16-bit instruction word
+typedef struct decoded_t{
+    unsigned char op;
+    unsigned char srcMode;
+    unsigned char srcReg;
+    unsigned char dstMode;
+    unsigned char dstReg;
+    unsigned char cycles; //LSI-11 time for -c: base plus source and destination mode times
+    short offset; //sign-extended branch offset in words
+    operand_fn getSrc; //addressing handlers for this (mode, reg)
+    operand_fn getDst;
+    result_fn putDst;
+} decoded_t;
+
+typedef void (*handler_t)(machine_t*, const decoded_t*);
+
+//One instruction of a cached basic block
+typedef struct block_entry_t{
+    unsigned short pc;
+    unsigned short ir;
+    const decoded_t *d;
+} block_entry_t;
+
+//Small loops recognized when a block is built and run in one step
+//by runIdiom() instead of instruction by instruction
+enum {
+    IDIOM_NONE,
+    IDIOM_COPY, //mov (rS)+,(rD)+ / sob rC,.-2
+    IDIOM_COUNTDOWN, //sub #1,rN / bne .-4
+    IDIOM_FILL //mov rV,(rD)+ / sub #1,rV / bne .-6
+};
+
+//A straight-line run of predecoded instructions starting at startPc and
+//ending at the first BR/BNE/BEQ/SOB/HALT; covers the words
+//[startPc, endPc) including immediate and index words
+typedef struct block_t{
+    int startPc;
+    int endPc;
+    int count;
+    int idiom; //IDIOM_NONE unless the block is one whole loop
+    int heat; //entries counted towards JIT_THRESHOLD
+    unsigned char *native; //compiled code, NULL if interpreted
+    block_entry_t entries[MAX_BLOCK_INSTRS];
+    unsigned long runs[MAX_BLOCK_INSTRS]; //-p and -c: whole-block runs that ended after each entry
+    unsigned long taken; //-p: of those, the ones whose closing branch was taken
+} block_t;
+
+//One executed instruction in a -T trace: everything -t and -v print
+//about it, with values as wide as the interpreter held them
+typedef struct trace_record_t{
+    int32_t pc; //before the fetch
+    uint16_t ir;
+    uint8_t nzvc; //condition codes after it, N in bit 3
+    uint8_t unused;
+    int32_t srcValue;
+    int32_t dstValue;
+    int32_t result;
+    int32_t dstAddr;
+    int32_t reg[8]; //registers after it
+} trace_record_t;
+
+_Static_assert(sizeof(trace_record_t) == TRACE_WORDS * sizeof(uint64_t), "trace records are whole 64-bit words");
+
+//Start of a -T file. The records follow in host byte order; with -z
+//each is XORed with the one before, as TRACE_WORDS 64-bit words, and
+//stored as a byte with a bit for each word that changed, then for
+//each of those a byte with a bit for each byte that changed and the
+//changed bytes themselves
+typedef struct trace_header_t{
+    char magic[8]; //TRACE_MAGIC, not NUL terminated
+    uint32_t recordSize;
+    uint32_t compressed;
+} trace_header_t;
+
+//Lock-free ring between the interpreter, which fills it, and the
+//thread writing the trace out; head and tail count the records ever
+//added and ever written, each on its own cache line
+struct trace_ring_t{
+    _Alignas(64) atomic_size_t head;
+    size_t cachedTail; //the producer's last look at tail
+    _Alignas(64) atomic_size_t tail;
+    atomic_bool done; //no more records will be added
+    bool failed; //a write failed; later records are dropped
+    FILE *file;
+    pthread_t writer;
+    trace_record_t records[TRACE_RING_SIZE];
+};
+
+typedef void (*event_fn)(machine_t*);
+
+//Something a device has to do at a point of device time
+typedef struct event_t{
+    unsigned long when;
+    event_fn fire;
+} event_t;
+
+//What can interrupt, a bit of devices_t.requests each
+enum {
+    IRQ_CLOCK,
+    IRQ_COUNT
+};
+
+//The processor and devices beyond registers and memory: device
+//time and the events due in it, the interrupts requested and the
+//priority they have to be above to be taken
+typedef struct devices_t{
+    unsigned long now; //instructions run, or cycles with -c
+    unsigned long nextEvent; //when events[0] is due; ULONG_MAX with none
+    event_t events[EVENT_MAX]; //a min-heap on when
+    int eventCount;
+    int requests; //IRQ_ bits
+    int priority; //PSW bits 7-5
+    int lks; //KW11-L status: interrupt enable, bit 6, and ticked, bit 7
+} devices_t;
+
+//A saved machine state. Memory lives in memFd, an in-memory file
+//that restoreSnapshot() maps copy-on-write over m->mem, so every
+//machine restored from it shares the pages until it writes them
+struct snapshot_t{
+    int reg[8];
+    lazy_flags_t lastFlags;
+    lazy_flags_t carryFlags;
+    int halt;
+
+    int instrExecs;
+    int instrFetches;
+    int memReads;
+    int memWrites;
+    int branches;
+    int branch_taken;
+    unsigned long opCycles[OP_COUNT]; //not kept in snapshot files
+    devices_t devices; //nor this; a snapshot file starts them at power-up
+
+    int programWords;
+    int memFd;
+};
+
+//A page of memory as one or more checkpoints saw it; consecutive
+//checkpoints share it for as long as the program leaves it alone
+typedef struct history_page_t{
+    int refs;
+    uint16_t words[HISTORY_PAGE_WORDS];
+} history_page_t;
+
+//The machine as it was at one point of a recorded run, and the log
+//of every instruction run from there to the next checkpoint: its
+//PC, then the memory word it wrote and the registers it changed
+typedef struct checkpoint_t{
+    snapshot_t state; //registers, flags and counters; memFd is unused
+    long position; //instructions recorded before it
+    history_page_t *pages[HISTORY_PAGES];
+    uint32_t *log;
+    size_t logLength;
+    size_t logCapacity;
+} checkpoint_t;
+
+//Time travel: pdp11_run() records while it is set, and earlier
+//points are reached by restoring the checkpoint before them and
+//running forward to them again
+struct history_t{
+    long interval; //instructions between checkpoints
+    int keep; //checkpoints kept, the oldest dropped first; 0 for all
+    long position; //instructions recorded before where the machine is now
+    long end; //instructions recorded; more than position after going back
+    checkpoint_t *checkpoints;
+    int count;
+    int capacity;
+    int pages; //distinct pages the checkpoints hold
+    int reg[7]; //r0-r6 as last logged
+    bool failed; //out of memory; nothing more is recorded
+    FILE *quiet; //output while replaying, which has been seen once
+};
+
+//The DL11 console of --console, in the I/O page from CONSOLE_RCSR:
+//input is read ahead in the background of RCSR polls, never waiting
+//for it, and output held until the buffer fills, the guest waits for
+//input or the machine halts
+typedef struct console_t{
+    int rcsr; //interrupt enable, bit 6; done, bit 7, is worked out as it is read
+    int xcsr;
+    int rbuf; //the character last taken from the input
+    int fd;
+    int savedFlags; //stdin's fcntl() flags, put back when done; -1 for a file
+    bool eof;
+    int idle; //RCSR reads left before input is looked for again
+    int inPos;
+    int inLength;
+    unsigned char in[CONSOLE_BUFFER];
+    int outLength;
+    char out[CONSOLE_BUFFER];
+} console_t;
+
+#ifdef CACHE_SIM
+//What CACHE_ACCESS() reports; instruction stream words go to the
+//instruction half of a split first level, the rest to the data half
+enum {
+    ACCESS_INSTRUCTION, //an instruction word, whose PC what follows is charged to
+    ACCESS_FETCH, //an immediate or absolute address word after it
+    ACCESS_READ,
+    ACCESS_WRITE
+};
+
+//Per PC counters kept for each level
+enum {
+    PC_HITS,
+    PC_MISSES,
+    PC_EVICTIONS,
+    PC_COUNTERS
+};
+
+//One cache of the --cache hierarchy, shared by all machines
+typedef struct cache_config_t{
+    char name[16]; //L1i, L1d, L1, L2...
+    int size; //bytes
+    int ways;
+    int lineBytes;
+    bool writeThrough; //else write-back; a write miss then goes round the cache
+    int level; //0 for the first
+    int next; //the cache misses and write-backs go to, -1 for memory
+} cache_config_t;
+
+typedef struct cache_line_t{
+    int line; //byte address >> lineShift
+    bool valid;
+    bool dirty;
+    unsigned long used; //clock at the last access, for LRU
+} cache_line_t;
+
+//One machine's copy of a cache_config_t
+typedef struct cache_t{
+    int sets;
+    int lineShift;
+    cache_line_t *lines; //sets of ways consecutive lines
+    unsigned long accesses;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long writebacks;
+} cache_t;
+
+//A machine's caches, with what they did for each PC
+typedef struct cache_state_t{
+    cache_t caches[CACHE_MAX];
+    unsigned long clock; //accesses so far, all caches together
+    int pc; //word address of the instruction being run
+    unsigned long (*pcCounts)[MEM_SIZE_IN_WORDS]; //level * PC_COUNTERS + counter
+} cache_state_t;
+
+//--cache, set by pdp11_configure(), first level first
+static cache_config_t cacheConfig[CACHE_MAX];
+static int cacheCount = 0;
+static int cacheLevels = 0;
+static int instructionCache = -1; //where each stream enters the hierarchy, the
+static int dataCache = -1; //  same cache when the first level is unified
+#endif
+
+//Everything one simulated PDP-11 owns; the option flags and the
+//decode table above are shared by all machines and never change
+//once the program starts running
+struct machine_t{
+    int reg[8];
+    int ir;
+    address_phrase_t src, dst;
+    lazy_flags_t lastFlags; //sets N/Z/V, and C unless a MOV
+    lazy_flags_t carryFlags; //sets C when lastFlags is a MOV
+    int halt; //1 after HALT, or HALT_BUDGET
+
+    int instrExecs;
+    int instrFetches;
+    int memReads;
+    int memWrites;
+    int branches;
+    int branch_taken;
+    unsigned long opCycles[OP_COUNT]; //-c: microcycles charged to each opcode class, taken branches aside
+
+    const block_entry_t *nextEntry; //position in the current block
+    const block_entry_t *blockEnd;
+    block_t *currentBlock;
+    block_t *retiredBlock; //invalidated while executing, freed on next lookup
+
+    //Block cache statistics
+    int blockLookups;
+    int blockHits;
+    int blockInvalidations;
+    int idiomsRun; //loops completed by runIdiom()
+    int blocksCompiled;
+
+    //Compiled code: enter and leave stubs at the start of jitBuffer,
+    //then blocks from jitBlocks up to jitNext; flushed as a whole
+    //when full
+    unsigned char *jitBuffer;
+    unsigned char *jitLeave;
+    unsigned char *jitBlocks;
+    unsigned char *jitNext;
+    bool jitFailed; //no executable memory to be had
+    bool unchained; //--fuzz: each compiled block leaves, to be compared on its own
+
+    //Profile counters for -p, allocated only when profiling
+    unsigned long *pcCounts; //instructions executed at each PC
+    unsigned long *takenCounts; //branches taken at each PC
+    int profilePc; //PC and branch_taken before the instruction being profiled
+    int profileTaken;
+    unsigned long opModeCounts[OP_COUNT][8][8]; //by opcode class, src mode, dst mode
+
+    trace_ring_t *trace; //-T records, only while the program runs
+    int tracePc; //PC before the instruction being recorded
+    history_t *history; //pdp11_record() checkpoints and log
+    bool ioPage; //--console or --clock: device registers from IO_PAGE up
+    bool hooked; //ioPage, or a watchpoint set: accesses go through hookedRead() and hookedWrite()
+    bool breaking; //a breakpoint set
+    int watchAction; //PDP11_WATCH_REPORT, _LOG or _STOP
+    devices_t devices;
+    console_t *console; //--console, NULL without it
+#ifdef CACHE_SIM
+    cache_state_t *cache; //--cache, NULL without it
+#endif
+
+    const char *programFile; //stdin when NULL
+    int programWords; //number of words loaded
+    FILE *out; //trace, statistics and error messages
+    bool ownsOut; //opened by pdp11_create(), closed with the machine
+    long budget; //instructions left in a bounded pdp11_run()
+    int stopPc; //where pdp11_run_to() stops, -1 otherwise
+
+    //Page aligned, so that restoreSnapshot() can map a snapshot over it
+    _Alignas(4096) uint16_t mem[MEM_SIZE_IN_WORDS]; //the 64 KB address space; use the accessors below
+    uint16_t *initialMem; //memory as loaded, restored between benchmark runs
+    block_t *blockCache[MEM_SIZE_IN_WORDS]; //keyed by starting word address
+    unsigned char codeMap[MEM_SIZE_IN_WORDS]; //number of blocks covering each word
+    uint64_t breakBits[MEM_SIZE_IN_WORDS / 64]; //breakpoints, a bit for each word
+    uint64_t readBits[MEM_SIZE_IN_WORDS / 64]; //read watchpoints
+    uint64_t writeBits[MEM_SIZE_IN_WORDS / 64]; //write watchpoints
+};
+
+decoded_t decodeTable[0200000]; //one entry for every possible ir
+pthread_once_t decodeTableBuilt = PTHREAD_ONCE_INIT;
+
+const char *const opNames[OP_COUNT] = {
+    [OP_HALT] = "halt",
+    [OP_MOV] = "mov",
+    [OP_CMP] = "cmp",
+    [OP_ADD] = "add",
+    [OP_SUB] = "sub",
+    [OP_SOB] = "sob",
+    [OP_BR] = "br",
+    [OP_BNE] = "bne",
+    [OP_BEQ] = "beq",
+    [OP_BPL] = "bpl",
+    [OP_BMI] = "bmi",
+    [OP_BHI] = "bhi",
+    [OP_BLOS] = "blos",
+    [OP_BVC] = "bvc",
+    [OP_BVS] = "bvs",
+    [OP_BCC] = "bcc",
+    [OP_BCS] = "bcs",
+    [OP_BGE] = "bge",
+    [OP_BLT] = "blt",
+    [OP_BGT] = "bgt",
+    [OP_BLE] = "ble",
+    [OP_ASR] = "asr",
+    [OP_ASL] = "asl",
+    [OP_CLR] = "clr",
+    [OP_INC] = "inc",
+    [OP_DEC] = "dec",
+    [OP_NEG] = "neg",
+    [OP_TST] = "tst",
+    [OP_JSR] = "jsr",
+    [OP_RTS] = "rts",
+    [OP_RTI] = "rti",
+    [OP_MUL] = "mul",
+    [OP_DIV] = "div",
+    [OP_ASH] = "ash",
+    [OP_ASHC] = "ashc",
+    [OP_ILLEGAL] = "illegal",
+};
+
+//LSI-11 instruction times for -c, in microcycles: a base time for
+//each opcode class plus the times of its addressing modes, after
+//the instruction timing tables of the LSI-11 manual. The source
+//table also serves the destinations that are only read, CMP's and
+//TST's, and the operands of JSR and the EIS instructions; MOV's
+//and CLR's destinations are only written, the others are read and
+//written back. ASH and ASHC are charged as if for a single shift
+#define TAKEN_BRANCH_CYCLES 2 //added for each branch taken, SOB's too
+
+static const unsigned char baseCycles[OP_COUNT] = {
+    [OP_HALT] = 25,
+    [OP_MOV] = 10,
+    [OP_CMP] = 10,
+    [OP_ADD] = 10,
+    [OP_SUB] = 10,
+    [OP_SOB] = 14,
+    [OP_BR] = 10,
+    [OP_BNE] = 10,
+    [OP_BEQ] = 10,
+    [OP_BPL] = 10,
+    [OP_BMI] = 10,
+    [OP_BHI] = 10,
+    [OP_BLOS] = 10,
+    [OP_BVC] = 10,
+    [OP_BVS] = 10,
+    [OP_BCC] = 10,
+    [OP_BCS] = 10,
+    [OP_BGE] = 10,
+    [OP_BLT] = 10,
+    [OP_BGT] = 10,
+    [OP_BLE] = 10,
+    [OP_ASR] = 11,
+    [OP_ASL] = 11,
+    [OP_CLR] = 10,
+    [OP_INC] = 10,
+    [OP_DEC] = 10,
+    [OP_NEG] = 10,
+    [OP_TST] = 10,
+    [OP_JSR] = 20,
+    [OP_RTS] = 18,
+    [OP_RTI] = 24,
+    [OP_MUL] = 60,
+    [OP_DIV] = 80,
+    [OP_ASH] = 24,
+    [OP_ASHC] = 28,
+    [OP_ILLEGAL] = 0, //not counted as executed either
+};
+static const unsigned char srcModeCycles[8] = { 0, 4, 4, 10, 5, 11, 11, 17 };
+static const unsigned char dstWriteCycles[8] = { 0, 6, 6, 12, 7, 13, 13, 19 };
+static const unsigned char dstModifyCycles[8] = { 0, 7, 7, 13, 8, 14, 14, 20 };
+
+machine_t *newMachine(const char*, FILE*);
+void freeMachine(machine_t*);
+bool loadMem(machine_t*);
+char *readInput(int, size_t*, bool*);
+bool loadOctal(machine_t*, const char*, size_t);
+bool loadImage(machine_t*, const unsigned char*, size_t);
+bool writeImage(machine_t*, const char*);
+bool translateProgram(machine_t*, const char*);
+#ifdef TRANSLATED
+bool loadTranslated(machine_t*);
+void enterTranslated(machine_t*);
+#endif
+bool runProgram(machine_t*);
+void printStatistics(machine_t*);
+unsigned long totalCycles(machine_t*);
+void printCycles(machine_t*);
+int runBatch(const char**, int);
+int runSweep(machine_t*, const char*);
+void *batchWorker(void*);
+int runFuzz(long, unsigned long);
+void *fuzzWorker(void*);
+void update_operand(machine_t*, address_phrase_t*, int);
+extern const operand_fn operandGetters[8][8];
+extern const result_fn resultPutters[8][8];
+extern const operand_fn operandAddresses[8][8];
+void printSrcDst(machine_t*);
+void printRegisters(machine_t*);
+void printFirst20Mem(machine_t*);
+void buildDecodeTable();
+static inline const decoded_t *fetch(machine_t*, const bool);
+block_t *lookupBlock(machine_t*, int);
+block_t *buildBlock(machine_t*, int);
+int recognizeIdiom(machine_t*, const block_t*);
+bool runIdiom(machine_t*, block_t*);
+static inline bool runWholeBlock(machine_t*, block_t*);
+void compileBlock(machine_t*, block_t*);
+void flushCompiled(machine_t*);
+void runCompiled(machine_t*, const block_t*);
+int instructionWords(int);
+void invalidateCode(machine_t*, int);
+void foldBlockRuns(machine_t*, block_t*);
+void foldAllBlockRuns(machine_t*);
+int decode(int);
+static inline bool isBranch(int);
+static inline bool endsBlock(int);
+int instructionCycles(const decoded_t*);
+void setFlags(machine_t*, int, int, int, int);
+static inline void setMovFlags(machine_t*, int);
+int get_n(machine_t*);
+int get_z(machine_t*);
+int get_v(machine_t*);
+int get_c(machine_t*);
+void run_fast(machine_t*);
+void run_profiled(machine_t*);
+void run_traced(machine_t*);
+void run_recorded(machine_t*);
+void run_bounded(machine_t*);
+void run_logged(machine_t*);
+void run_timed(machine_t*);
+void run_io(machine_t*);
+void resetDevices(devices_t*);
+void scheduleEvent(devices_t*, unsigned long, event_fn);
+void runEvents(machine_t*);
+void clockTick(machine_t*);
+void setPsw(machine_t*, int);
+int deviceRead(machine_t*, int);
+void deviceWrite(machine_t*, int, int);
+int hookedRead(machine_t*, int);
+void hookedWrite(machine_t*, int, int);
+void setWatch(machine_t*, int, int, int, bool);
+void watchHit(machine_t*, int, int, int, int);
+console_t *newConsole(const char*);
+void freeConsole(console_t*);
+void flushConsole(machine_t*);
+int consoleRead(machine_t*, int);
+void consoleWrite(machine_t*, int, int);
+bool startTrace(machine_t*, const char*);
+bool stopTrace(machine_t*);
+void *traceWriter(void*);
+bool decodeTrace(const char*);
+int disassemble(machine_t*, int, char*);
+void formatOperand(machine_t*, char*, int, int, int*);
+void writeProfile(machine_t*);
+void resetMachine(machine_t*);
+bool keepLoaded(machine_t*);
+snapshot_t *takeSnapshot(machine_t*);
+bool restoreSnapshot(machine_t*, const snapshot_t*);
+void freeSnapshot(snapshot_t*);
+bool writeSnapshot(machine_t*, const snapshot_t*, const char*);
+snapshot_t *readSnapshot(machine_t*, const char*);
+bool startHistory(machine_t*, long, int);
+void stopHistory(machine_t*);
+static void dropBlocks(machine_t*);
+static bool addCheckpoint(machine_t*);
+static void dropCheckpoint(history_t*, checkpoint_t*);
+void trimHistory(machine_t*);
+bool seekHistory(machine_t*, long);
+long findInHistory(machine_t*, bool, int, int*, int*);
+double timeRuns(machine_t*, int, void (*)(machine_t*));
+void benchmark(machine_t*, int);
+#ifdef CACHE_SIM
+bool configureCaches(const char*);
+cache_state_t *newCaches(void);
+void freeCaches(cache_state_t*);
+void clearCaches(cache_state_t*);
+void cacheAccess(cache_state_t*, int, int);
+void printCaches(machine_t*);
+void run_cached(machine_t*);
+#endif
+
+/* the word under addr, for the simulator itself to look */ 
+/*   at: no device or watchpoint sees it                  */ 
+static inline int peek_word(machine_t *m, int addr){
+    return m->mem[ (addr & 0177777) >> 1 ];
+}
+
+/* whether the word at addr has its bit set in bits */ 
+static inline bool watched(const uint64_t *bits, int addr){
+    int w = (addr & 0177777) >> 1;
+
+    return bits[w >> 6] >> (w & 63) & 1;
+}
+
+/* memory accessors: every guest access goes through these, */ 
+/*   with a 16-bit byte address; devices and watchpoints   */ 
+/*   cost the one test of hooked while there are none      */ 
+static inline int read_word(machine_t *m, int addr){
+    if(m->hooked){
+        return hookedRead(m, addr);
+    }
+    return m->mem[ (addr & 0177777) >> 1 ];
+}
+
+static inline void write_word(machine_t *m, int addr, int value){
+    int w = (addr & 0177777) >> 1;
+
+    if(m->hooked){
+        hookedWrite(m, addr, value);
+        return;
+    }
+    m->mem[w] = value;
+    invalidateCode(m, w);
+}
+
+/* library interface, declared in pdp11.h */ 
+bool pdp11_configure(const pdp11_options_t *options){
+    verboseMode = options->verbose;
+    traceMode = options->trace;
+    statsMode = options->stats;
+    rawImage = options->rawImage;
+    profileMode = options->profile;
+    workerCount = options->workers;
+    binaryTraceFile = options->binaryTrace;
+    compressTrace = options->compressTrace;
+    timingMode = options->timing;
+    consoleFile = options->console;
+    clockInterval = options->clock;
+    if(clockInterval < 0){
+        printf("Error: --clock needs a positive interval\n");
+        return false;
+    }
+    if(consoleFile != NULL && strcmp(consoleFile, "-") != 0 && access(consoleFile, R_OK) != 0){
+        printf("Error: cannot open %s\n", consoleFile);
+        return false;
+    }
+#ifdef CACHE_SIM
+    return configureCaches(options->cache != NULL ? options->cache : "");
+#else
+    if(options->cache != NULL){
+        printf("Error: --cache needs a simulator built with -DCACHE_SIM\n");
+        return false;
+    }
+    return true;
+#endif
+}
+
+pdp11_t *pdp11_create(FILE *out){
+    FILE *discard = out == NULL ? fopen("/dev/null", "w") : NULL;
+    machine_t *m;
+
+    if(out == NULL && discard == NULL){
+        return NULL;
+    }
+    m = newMachine(NULL, out != NULL ? out : discard);
+    if(m == NULL){
+        if(discard != NULL){
+            fclose(discard);
+        }
+        return NULL;
+    }
+    m->ownsOut = discard != NULL;
+    return m;
+}
+
+void pdp11_destroy(pdp11_t *m){
+    flushConsole(m);
+    if(m->ownsOut){
+        fclose(m->out);
+    }
+    freeMachine(m);
+}
+
+/* everything a previous program left behind, back to zero */ 
+static void clearProgram(machine_t *m){
+    free(m->initialMem);
+    m->initialMem = NULL;
+    resetMachine(m);
+    dropBlocks(m);
+    m->programWords = 0;
+}
+
+/* the machine changed other than by running: a recorded */ 
+/*   history starts over, or goes on from a checkpoint of */ 
+/*   the new state                                        */ 
+static void restartHistory(machine_t *m){
+    if(m->history != NULL){
+        startHistory(m, m->history->interval, m->history->keep);
+    }
+}
+
+static void noteChange(machine_t *m){
+    history_t *h = m->history;
+
+    if(h != NULL && !h->failed){
+        trimHistory(m);
+        if(h->checkpoints[h->count - 1].position == h->position){
+            h->count--;
+            dropCheckpoint(h, &h->checkpoints[h->count]);
+        }
+        addCheckpoint(m);
+    }
+}
+
+bool pdp11_load_octal(pdp11_t *m, const char *text, size_t length){
+    bool loaded;
+
+    clearProgram(m);
+    loaded = loadOctal(m, text, length) && keepLoaded(m);
+    restartHistory(m);
+    return loaded;
+}
+
+bool pdp11_load_image(pdp11_t *m, const void *image, size_t length){
+    bool loaded;
+
+    clearProgram(m);
+    loaded = loadImage(m, image, length) && keepLoaded(m);
+    restartHistory(m);
+    return loaded;
+}
+
+bool pdp11_load_file(pdp11_t *m, const char *fileName){
+    bool loaded;
 
-void loadMem();
-void get_operand(address_phrase_t*);
-void update_operand(address_phrase_t*, int);
-void put_result();
-void printSrcDst();
-void printRegisters();
-void printFirst20Mem();
+    clearProgram(m);
+    m->programFile = fileName;
+    loaded = loadMem(m) && keepLoaded(m);
+    restartHistory(m);
+    return loaded;
+}
 
-int main(int argc, char **argv) {
+void pdp11_reset(pdp11_t *m){
+    resetMachine(m);
+    restartHistory(m);
+}
 
-    if(argc == 2){
-    if(strcmp(argv[1], "-t") == 0){
-            traceMode = true;
+int pdp11_run(pdp11_t *m, long maxInstructions){
+    if(m->history != NULL){
+        trimHistory(m);
+        if(maxInstructions == PDP11_NO_LIMIT){
+            maxInstructions = LONG_MAX;
+        }
+    }
+#ifdef CACHE_SIM
+    if(maxInstructions == PDP11_NO_LIMIT && m->cache != NULL){
+        run_cached(m);
+    }
+    else
+#endif
+    if(maxInstructions == PDP11_NO_LIMIT && (m->hooked || m->breaking)){
+        run_io(m);
+    }
+    else if(maxInstructions == PDP11_NO_LIMIT && timingMode){
+        run_timed(m);
+    }
+    else if(maxInstructions == PDP11_NO_LIMIT){
+#ifdef TRANSLATED
+        enterTranslated(m);
+#endif
+        run_fast(m);
+    }
+    else if(maxInstructions > 0){
+        m->budget = maxInstructions;
+        if(m->history != NULL){
+            run_logged(m);
         }
-        if(strcmp(argv[1], "-v") == 0){
-            verboseMode = true;
+        else{
+            run_bounded(m);
         }
+        if(m->halt == HALT_BUDGET){
+            m->halt = 0;
+        }
+    }
+    foldAllBlockRuns(m);
+    if(m->halt){
+        flushConsole(m);
     }
+    if(m->halt == HALT_WATCH){
+        m->halt = 0;
+        return PDP11_STOPPED;
+    }
+    return m->halt ? PDP11_HALTED : PDP11_RUNNING;
+}
 
-    loadMem();
+int pdp11_step(pdp11_t *m){
+    return pdp11_run(m, 1);
+}
 
-    int offset;
-    int sign_bit;
-    int result;
+bool pdp11_halted(pdp11_t *m){
+    return m->halt != 0;
+}
 
-    if(verboseMode || traceMode) {
-        printf("\ninstruction trace:\n");
+int pdp11_run_to(pdp11_t *m, int pc, long maxInstructions){
+    int stopped;
+
+    if(m->reg[7] == pc || m->halt){
+        return m->halt ? PDP11_HALTED : PDP11_RUNNING;
     }
+    m->stopPc = pc;
+    stopped = pdp11_run(m, maxInstructions == PDP11_NO_LIMIT ? LONG_MAX : maxInstructions);
+    m->stopPc = -1;
+    return stopped;
+}
 
-    //loop until halt instruction or other criteria
-    while(!halt){
-        /* fetch – note that reg[7] in PDP-11 is the PC */ 
-        if (verboseMode || traceMode) printf("at 0%04o, ", reg[7]); 
-        ir = mem[ reg[7] >> 1 ];  /* adjust for word address */ 
-        instrFetches++;
-        assert( ir < 0200000 ); 
-        reg[7] = ( reg[7] + 2 ) & CLAMP_16_BIT; 
-    
-        /* extract the fields for the addressing modes          */ 
-        /*   (done whether src and dst are used or not; could   */ 
-        /*   be moved instead to indiv. inst. execution blocks) */ 
-        src.mode = (ir >> 9) & 07;  /* three one bits in the mask */ 
-        src.reg = (ir >> 6) & 07;   /* decimal 7 would also work  */ 
-        dst.mode = (ir >> 3) & 07; 
-        dst.reg = ir & 07; 
-    
-        /* decode using a series of dependent if statements */ 
-        /*   and execute the identified instruction         */ 
-        if( ir == 0 ){  //ref 4-71
-            if(traceMode || verboseMode) { 
-                printf("halt instruction\n");
-            } 
-            halt = 1; 
-        } else if( (ir >> 12) == 01 ){   /* LSI-11 manual ref 4-25 */ 
-            if(verboseMode || traceMode){ 
-                printf("mov instruction "); 
-                printSrcDst(); 
+int pdp11_get_register(pdp11_t *m, int r){
+    return m->reg[r & 7];
+}
+
+void pdp11_set_register(pdp11_t *m, int r, int value){
+    m->reg[r & 7] = value;
+    noteChange(m);
+}
+
+/* memory as it is, without going through the console */ 
+int pdp11_read_word(pdp11_t *m, int addr){
+    return peek_word(m, addr);
+}
+
+void pdp11_write_word(pdp11_t *m, int addr, int value){
+    int w = (addr & 0177777) >> 1;
+
+    m->mem[w] = value;
+    invalidateCode(m, w);
+    noteChange(m);
+}
+
+void pdp11_watch(pdp11_t *m, int kinds, int first, int last, bool set){
+    setWatch(m, kinds, first, last, set);
+}
+
+void pdp11_watch_action(pdp11_t *m, int action){
+    m->watchAction = action;
+}
+
+const uint16_t *pdp11_memory(pdp11_t *m){
+    return m->mem;
+}
+
+void pdp11_get_stats(pdp11_t *m, pdp11_stats_t *stats){
+    stats->instructions = m->instrExecs;
+    stats->fetches = m->instrFetches;
+    stats->memReads = m->memReads;
+    stats->memWrites = m->memWrites;
+    stats->branches = m->branches;
+    stats->branchesTaken = m->branch_taken;
+    stats->cycles = totalCycles(m);
+}
+
+pdp11_snapshot_t *pdp11_snapshot(pdp11_t *m){
+    return takeSnapshot(m);
+}
+
+bool pdp11_restore(pdp11_t *m, const pdp11_snapshot_t *s){
+    bool restored = restoreSnapshot(m, s);
+
+    restartHistory(m);
+    return restored;
+}
+
+void pdp11_free_snapshot(pdp11_snapshot_t *s){
+    freeSnapshot(s);
+}
+
+bool pdp11_write_snapshot(pdp11_t *m, const pdp11_snapshot_t *s, const char *fileName){
+    return writeSnapshot(m, s, fileName);
+}
+
+pdp11_snapshot_t *pdp11_read_snapshot(pdp11_t *m, const char *fileName){
+    return readSnapshot(m, fileName);
+}
+
+bool pdp11_record(pdp11_t *m, long interval, int keep){
+    return startHistory(m, interval > 0 ? interval : HISTORY_INTERVAL, keep > 0 ? keep : 0);
+}
+
+void pdp11_stop_recording(pdp11_t *m){
+    stopHistory(m);
+}
+
+long pdp11_position(pdp11_t *m){
+    return m->history != NULL ? m->history->position : -1;
+}
+
+bool pdp11_seek(pdp11_t *m, long position){
+    return seekHistory(m, position);
+}
+
+long pdp11_find_pc(pdp11_t *m, int pc){
+    return findInHistory(m, false, pc & 0177777, NULL, NULL);
+}
+
+long pdp11_find_write(pdp11_t *m, int addr, int *pc, int *value){
+    return findInHistory(m, true, (addr & 0177777) >> 1, pc, value);
+}
+
+void pdp11_get_history(pdp11_t *m, pdp11_history_t *info){
+    history_t *h = m->history;
+
+    memset(info, 0, sizeof(*info));
+    if(h == NULL){
+        info->first = info->position = info->end = -1;
+        return;
+    }
+    info->first = h->checkpoints[0].position;
+    info->position = h->position;
+    info->end = h->end;
+    info->interval = h->interval;
+    info->checkpoints = h->count;
+    info->pageBytes = (size_t)h->pages * sizeof(history_page_t);
+    for(int i = 0; i < h->count; i++){
+        info->logBytes += h->checkpoints[i].logCapacity * sizeof(uint32_t);
+    }
+    info->totalBytes = info->pageBytes + info->logBytes + h->capacity * sizeof(checkpoint_t) + sizeof(history_t);
+    info->complete = !h->failed;
+}
+
+bool pdp11_run_program(pdp11_t *m){
+    return runProgram(m);
+}
+
+void pdp11_benchmark(pdp11_t *m, int runs){
+    benchmark(m, runs);
+}
+
+bool pdp11_write_image(pdp11_t *m, const char *fileName){
+    return writeImage(m, fileName);
+}
+
+bool pdp11_translate(pdp11_t *m, const char *fileName){
+    return translateProgram(m, fileName);
+}
+
+int pdp11_sweep(pdp11_t *m, const char *sweepFile){
+    return runSweep(m, sweepFile);
+}
+
+int pdp11_run_batch(const char **programFiles, int count){
+    return runBatch(programFiles, count);
+}
+
+int pdp11_fuzz(long count, unsigned long seed){
+    pthread_once(&decodeTableBuilt, buildDecodeTable);
+    return runFuzz(count, seed);
+}
+
+bool pdp11_decode_trace(const char *fileName){
+    pthread_once(&decodeTableBuilt, buildDecodeTable);
+    return decodeTrace(fileName);
+}
+
+/* a machine in its power-up state, with nothing loaded; */ 
+/*   output goes to out                                 */ 
+machine_t *newMachine(const char *programFile, FILE *out){
+    const lazy_flags_t cleared = { FLAGS_PSW, 0, 0, 1 };
+    machine_t *m = mmap(NULL, sizeof(machine_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); //zeroed, and mem page aligned
+
+    pthread_once(&decodeTableBuilt, buildDecodeTable);
+    if(m == MAP_FAILED){
+        return NULL;
+    }
+    m->lastFlags = m->carryFlags = cleared;
+    m->stopPc = -1;
+    m->programFile = programFile;
+    m->out = out;
+    m->ioPage = m->hooked = consoleFile != NULL || clockInterval > 0;
+    resetDevices(&m->devices);
+    if(profileMode){
+        m->pcCounts = calloc(MEM_SIZE_IN_WORDS, sizeof(unsigned long));
+        m->takenCounts = calloc(MEM_SIZE_IN_WORDS, sizeof(unsigned long));
+        if(m->pcCounts == NULL || m->takenCounts == NULL){
+            freeMachine(m);
+            return NULL;
+        }
+    }
+    if(consoleFile != NULL){
+        m->console = newConsole(consoleFile);
+        if(m->console == NULL){
+            freeMachine(m);
+            return NULL;
+        }
+    }
+#ifdef CACHE_SIM
+    if(cacheCount > 0){
+        m->cache = newCaches();
+        if(m->cache == NULL){
+            freeMachine(m);
+            return NULL;
+        }
+    }
+#endif
+    return m;
+}
+
+void freeMachine(machine_t *m){
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        free(m->blockCache[w]);
+    }
+    free(m->retiredBlock);
+    free(m->pcCounts);
+    free(m->takenCounts);
+    free(m->initialMem);
+    stopHistory(m);
+    if(m->console != NULL){
+        flushConsole(m);
+        freeConsole(m->console);
+    }
+#ifdef CACHE_SIM
+    freeCaches(m->cache);
+#endif
+#ifdef JIT
+    if(m->jitBuffer != NULL){
+        munmap(m->jitBuffer, JIT_BUFFER_SIZE);
+    }
+#endif
+    munmap(m, sizeof(machine_t));
+}
+
+/* run the loaded program in the loop the options ask for */ 
+/*   and report on it; false if a -T trace was not written */ 
+bool runProgram(machine_t *m){
+    bool written = true;
+
+    if(binaryTraceFile != NULL){
+        if(!startTrace(m, binaryTraceFile)){
+            return false;
+        }
+        run_recorded(m);
+        written = stopTrace(m);
+    }
+    else if(verboseMode || traceMode) {
+        fprintf(m->out, "\ninstruction trace:\n");
+        run_traced(m);
+    }
+    else if(profileMode){
+        run_profiled(m);
+    }
+#ifdef CACHE_SIM
+    else if(m->cache != NULL){
+        run_cached(m);
+    }
+#endif
+    else if(m->hooked || m->breaking){
+        run_io(m);
+    }
+    else if(timingMode){
+        run_timed(m);
+    }
+    else{
+#ifdef TRANSLATED
+        enterTranslated(m);
+#endif
+        run_fast(m); //returns at once unless left to the interpreter
+    }
+
+    foldAllBlockRuns(m);
+    flushConsole(m);
+    if(m->halt == HALT_WATCH){
+        m->halt = 0;
+    }
+    if((verboseMode || traceMode) && binaryTraceFile == NULL) fprintf(m->out, "\n");
+    printStatistics(m);
+
+    if(profileMode){
+        writeProfile(m);
+    }
+
+    if(verboseMode) {
+        printFirst20Mem(m);
+    }
+    return written;
+}
+
+void printStatistics(machine_t *m){
+    fprintf(m->out, "execution statistics (in decimal):\n");
+    fprintf(m->out, "  instructions executed     = %d\n", m->instrExecs);
+    fprintf(m->out, "  instruction words fetched = %d\n", m->instrFetches);
+    fprintf(m->out, "  data words read           = %d\n", m->memReads);
+    fprintf(m->out, "  data words written        = %d\n", m->memWrites);
+    fprintf(m->out, "  branches executed         = %d\n", m->branches);
+    fprintf(m->out, "  branches taken            = %d", m->branch_taken);
+    if(m->branch_taken > 0){
+        fprintf(m->out, " (%0.1f%%)\n", (double)m->branch_taken*100/m->branches);
+    }
+    else{
+        fprintf(m->out, "\n");
+    }
+
+    if(statsMode){
+        fprintf(m->out, "  blocks entered            = %d\n", m->blockLookups);
+        fprintf(m->out, "  block cache hits          = %d", m->blockHits);
+        if(m->blockLookups > 0){
+            fprintf(m->out, " (%0.1f%%)\n", (double)m->blockHits*100/m->blockLookups);
+        }
+        else{
+            fprintf(m->out, "\n");
+        }
+        fprintf(m->out, "  block invalidations       = %d\n", m->blockInvalidations);
+        fprintf(m->out, "  loops run as one step     = %d\n", m->idiomsRun);
+        fprintf(m->out, "  blocks compiled           = %d\n", m->blocksCompiled);
+    }
+
+    if(timingMode){
+        printCycles(m);
+    }
+#ifdef CACHE_SIM
+    if(m->cache != NULL){
+        printCaches(m);
+    }
+#endif
+}
+
+/* total of the -c cycles */ 
+unsigned long totalCycles(machine_t *m){
+    unsigned long cycles = (unsigned long)m->branch_taken * TAKEN_BRANCH_CYCLES;
+
+    for(int op = 0; op < OP_COUNT; op++){
+        cycles += m->opCycles[op];
+    }
+    return cycles;
+}
+
+/* -c: the cycles line, and what each opcode class took */ 
+void printCycles(machine_t *m){
+    unsigned long cycles = totalCycles(m);
+    unsigned long taken = (unsigned long)m->branch_taken * TAKEN_BRANCH_CYCLES;
+
+    fprintf(m->out, "  cycles                    = %lu\n", cycles);
+    fprintf(m->out, "cycles by opcode (in decimal):\n");
+    for(int op = 0; op < OP_COUNT; op++){
+        if(m->opCycles[op] > 0){
+            fprintf(m->out, "  %-24s= %lu (%0.1f%%)\n", opNames[op], m->opCycles[op], (double)m->opCycles[op]*100/cycles);
+        }
+    }
+    if(taken > 0){
+        fprintf(m->out, "  %-24s= %lu (%0.1f%%)\n", "taken branches", taken, (double)taken*100/cycles);
+    }
+}
+
+//One program of a batch; output is collected in memory and printed
+//in input order once done is set
+typedef struct batch_task_t{
+    const char *programFile;
+    char *output;
+    size_t outputSize;
+    bool failed; //could not be loaded
+    bool done;
+} batch_task_t;
+
+//Task numbers waiting to run on one worker; the owner takes from
+//the front, idle workers steal from the back
+typedef struct work_queue_t{
+    pthread_mutex_t lock;
+    int *tasks;
+    int front;
+    int back;
+} work_queue_t;
+
+typedef struct batch_t{
+    batch_task_t *tasks;
+    work_queue_t *queues;
+    int workers;
+    pthread_mutex_t doneLock;
+    pthread_cond_t doneCond;
+} batch_t;
+
+typedef struct worker_t{
+    batch_t *batch;
+    int id;
+} worker_t;
+
+/* next task for worker id: its own oldest one, or else the */ 
+/*   newest one of another worker; -1 when all are empty,   */ 
+/*   since nothing is queued once the batch has started     */ 
+int nextTask(batch_t *batch, int id){
+    for(int i = 0; i < batch->workers; i++){
+        work_queue_t *q = &batch->queues[(id + i) % batch->workers];
+        int task = -1;
+
+        pthread_mutex_lock(&q->lock);
+        if(q->front < q->back){
+            task = i == 0 ? q->tasks[q->front++] : q->tasks[--q->back];
+        }
+        pthread_mutex_unlock(&q->lock);
+        if(task >= 0){
+            return task;
+        }
+    }
+    return -1;
+}
+
+void *batchWorker(void *arg){
+    worker_t *worker = arg;
+    batch_t *batch = worker->batch;
+    int task;
+
+    while((task = nextTask(batch, worker->id)) >= 0){
+        batch_task_t *t = &batch->tasks[task];
+        FILE *out = open_memstream(&t->output, &t->outputSize);
+        machine_t *m = out != NULL ? newMachine(t->programFile, out) : NULL;
+
+        t->failed = true;
+        if(m == NULL){
+            if(out != NULL){
+                fprintf(out, "Error: out of memory for machine\n");
+            }
+        }
+        else{
+            if(loadMem(m)){
+                t->failed = !runProgram(m);
             }
+            freeMachine(m);
+        }
+        if(out != NULL){
+            fclose(out);
+        }
+
+        pthread_mutex_lock(&batch->doneLock);
+        t->done = true;
+        pthread_cond_broadcast(&batch->doneCond);
+        pthread_mutex_unlock(&batch->doneLock);
+    }
+    return NULL;
+}
+
+/* run every program on its own machine, spread over a pool */ 
+/*   of workerCount threads, and print the results in the   */ 
+/*   order the programs were given                           */ 
+int runBatch(const char **programFiles, int count){
+    batch_t batch;
+    worker_t *workers;
+    pthread_t *threads;
+    int started = 0, status = 0;
+
+    batch.workers = workerCount > 0 ? workerCount : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(batch.workers < 1) batch.workers = 1;
+    if(batch.workers > count) batch.workers = count;
+
+    batch.tasks = calloc(count, sizeof(batch_task_t));
+    batch.queues = calloc(batch.workers, sizeof(work_queue_t));
+    workers = calloc(batch.workers, sizeof(worker_t));
+    threads = calloc(batch.workers, sizeof(pthread_t));
+    if(batch.tasks == NULL || batch.queues == NULL || workers == NULL || threads == NULL){
+        printf("Error: out of memory for batch\n");
+        return 1;
+    }
+    pthread_mutex_init(&batch.doneLock, NULL);
+    pthread_cond_init(&batch.doneCond, NULL);
+
+    /* deal the programs out round-robin, so the first few, */ 
+    /*   which are printed first, all start straight away    */ 
+    for(int w = 0; w < batch.workers; w++){
+        work_queue_t *q = &batch.queues[w];
+
+        pthread_mutex_init(&q->lock, NULL);
+        q->tasks = malloc(((count + batch.workers - 1) / batch.workers) * sizeof(int));
+        q->front = q->back = 0;
+        if(q->tasks == NULL){
+            printf("Error: out of memory for batch\n");
+            return 1;
+        }
+    }
+    for(int i = 0; i < count; i++){
+        work_queue_t *q = &batch.queues[i % batch.workers];
+
+        batch.tasks[i].programFile = programFiles[i];
+        q->tasks[q->back++] = i;
+    }
+
+    for(int w = 0; w < batch.workers; w++){
+        workers[w].batch = &batch;
+        workers[w].id = w;
+        if(pthread_create(&threads[w], NULL, batchWorker, &workers[w]) != 0){
+            break;
+        }
+        started++;
+    }
+    if(started == 0){
+        /* no threads to be had: run the whole batch here */ 
+        batchWorker(&workers[0]);
+    }
+
+    for(int i = 0; i < count; i++){
+        batch_task_t *t = &batch.tasks[i];
+
+        pthread_mutex_lock(&batch.doneLock);
+        while(!t->done){
+            pthread_cond_wait(&batch.doneCond, &batch.doneLock);
+        }
+        pthread_mutex_unlock(&batch.doneLock);
+
+        printf("%s==> %s <==\n", i > 0 ? "\n" : "", t->programFile);
+        if(t->output != NULL){
+            fwrite(t->output, 1, t->outputSize, stdout);
+            free(t->output);
+        }
+        if(t->failed){
+            status = 1;
+        }
+    }
+
+    for(int w = 0; w < started; w++){
+        pthread_join(threads[w], NULL);
+    }
+    for(int w = 0; w < batch.workers; w++){
+        pthread_mutex_destroy(&batch.queues[w].lock);
+        free(batch.queues[w].tasks);
+    }
+    pthread_mutex_destroy(&batch.doneLock);
+    pthread_cond_destroy(&batch.doneCond);
+    free(batch.tasks);
+    free(batch.queues);
+    free(workers);
+    free(threads);
+    return status;
+}
+
+//--sweep: one program run over many initial states, SWEEP_WIDTH
+//lanes at a time. Each lane is a machine of its own (registers,
+//lazy flags, memory and counters), held as structure-of-arrays so
+//an instruction is applied to every lane at once with vector
+//operations. The lanes at the lowest PC step together; the others
+//are masked off and wait there, which brings diverged lanes back
+//together after a loop or an if
+typedef int32_t lanes_t __attribute__((vector_size(SWEEP_WIDTH * sizeof(int32_t))));
+
+//Mask lanes are -1 (all ones) where set and 0 where clear. Vectors
+//are passed by pointer: by value their ABI depends on -mavx512f
+#define BLEND(mask, a, b) (((mask) & (a)) | (~(mask) & (b)))
+#define BROADCAST(x) ((lanes_t){ 0 } + (x))
+
+typedef struct lazy_lanes_t{
+    lanes_t op;
+    lanes_t src;
+    lanes_t dst;
+    lanes_t result;
+} lazy_lanes_t;
+
+typedef struct sweep_t{
+    lanes_t reg[8];
+    lazy_lanes_t lastFlags;
+    lazy_lanes_t carryFlags;
+    lanes_t halted; //lanes that halted or are not in use
+    lanes_t illegal; //"no matching instruction" errors to report
+
+    lanes_t instrExecs;
+    lanes_t instrFetches;
+    lanes_t memReads;
+    lanes_t memWrites;
+    lanes_t branches;
+    lanes_t branch_taken;
+
+    unsigned char differs[MEM_SIZE_IN_WORDS]; //the lanes may not agree on this word
+    uint16_t mem[SWEEP_WIDTH][MEM_SIZE_IN_WORDS + 32]; //padded so the lanes do not share cache sets
+} sweep_t;
+
+/* the word at addr in each lane's memory; read for all */ 
+/*   lanes, the inactive ones are blended away          */ 
+static inline void sweepRead(const sweep_t *s, const lanes_t *addr, lanes_t *v){
+    for(int l = 0; l < SWEEP_WIDTH; l++){
+        (*v)[l] = s->mem[l][((*addr)[l] & 0177777) >> 1];
+    }
+}
+
+/* the word at a fixed address, without the gather while */ 
+/*   no lane has made its copy of it different           */ 
+static inline void sweepReadAt(const sweep_t *s, int addr, lanes_t *v){
+    int w = (addr & 0177777) >> 1;
+
+    if(!s->differs[w]){
+        *v = BROADCAST(s->mem[0][w]);
+        return;
+    }
+    for(int l = 0; l < SWEEP_WIDTH; l++){
+        (*v)[l] = s->mem[l][w];
+    }
+}
+
+static inline void sweepWrite(sweep_t *s, const lanes_t *active, const lanes_t *addr, const lanes_t *value){
+    for(int l = 0; l < SWEEP_WIDTH; l++){
+        if((*active)[l]){
+            int w = ((*addr)[l] & 0177777) >> 1;
+
+            s->mem[l][w] = (*value)[l];
+            s->differs[w] = 1;
+        }
+    }
+}
+
+/* get_operand_mode() and the PC-relative handlers across */ 
+/*   the active lanes: the operand into *value and its    */ 
+/*   address into *addr; the lanes share the PC, so *p    */ 
+/*   follows reg[7] for all of them                       */ 
+static void sweepGet(sweep_t *s, const lanes_t *active, int mode, int r, int *p, lanes_t *value, lanes_t *addr){
+    lanes_t *reg = &s->reg[r];
+    lanes_t x;
+
+    switch(mode){
+        case 0:
+            *addr = BROADCAST(0);
+            *value = r == 7 ? BROADCAST(*p) : *reg;
+            return;
+        case 1:
+            *addr = r == 7 ? BROADCAST(*p) : *reg;
+            break;
+        case 2:
+            s->instrFetches -= *active;
+            if(r == 7){
+                *addr = BROADCAST(*p);
+                sweepReadAt(s, *p, value);
+                *p = (*p + 2) & 0177777;
+                return;
+            }
+            *addr = *reg;
+            *reg = BLEND(*active, (*reg + 2) & 0177777, *reg);
+            break;
+        case 3:
+            s->instrFetches -= *active + *active;
+            if(r == 7){
+                sweepReadAt(s, *p, addr);
+                *p = (*p + 2) & 0177777;
+                break;
+            }
+            sweepRead(s, reg, addr);
+            *reg = BLEND(*active, (*reg + 2) & 0177777, *reg);
+            break;
+        case 4:
+            s->instrFetches -= *active;
+            if(r == 7){
+                *p = (*p - 2) & 0177777;
+                *addr = BROADCAST(*p);
+                break;
+            }
+            *reg = BLEND(*active, (*reg - 2) & 0177777, *reg);
+            *addr = *reg;
+            break;
+        case 5:
+            s->instrFetches -= *active + *active;
+            if(r == 7){
+                *p = (*p - 2) & 0177777;
+                sweepReadAt(s, *p, addr);
+                break;
+            }
+            *reg = BLEND(*active, (*reg - 2) & 0177777, *reg);
+            sweepRead(s, reg, addr);
+            break;
+        default:
+            *p = (*p + 2) & 0177777;
+            *addr = r == 7 ? BROADCAST(*p) : *reg;
+            x = (*addr + 2) * 2;
+            sweepRead(s, &x, &x);
+            x += *addr;
+            sweepRead(s, &x, value);
+            s->memReads -= 5 * *active;
+            s->instrFetches += *active + *active;
+            return;
+    }
+    sweepRead(s, addr, value);
+}
+
+/* address_operand_mode() across the active lanes, for JSR */ 
+static void sweepAddress(sweep_t *s, const lanes_t *active, int mode, int r, int *p, lanes_t *addr){
+    lanes_t *reg = &s->reg[r];
+    lanes_t x;
+
+    switch(mode){
+        case 1:
+            *addr = r == 7 ? BROADCAST(*p) : *reg;
+            break;
+        case 2:
+            if(r == 7){
+                *addr = BROADCAST(*p);
+                *p = (*p + 2) & 0177777;
+                break;
+            }
+            *addr = *reg;
+            *reg = BLEND(*active, (*reg + 2) & 0177777, *reg);
+            break;
+        case 3:
+            s->instrFetches -= *active;
+            if(r == 7){
+                sweepReadAt(s, *p, addr);
+                *p = (*p + 2) & 0177777;
+                break;
+            }
+            sweepRead(s, reg, addr);
+            *reg = BLEND(*active, (*reg + 2) & 0177777, *reg);
+            break;
+        case 4:
+            if(r == 7){
+                *p = (*p - 2) & 0177777;
+                *addr = BROADCAST(*p);
+                break;
+            }
+            *reg = BLEND(*active, (*reg - 2) & 0177777, *reg);
+            *addr = *reg;
+            break;
+        case 5:
+            s->instrFetches -= *active;
+            if(r == 7){
+                *p = (*p - 2) & 0177777;
+                sweepReadAt(s, *p, addr);
+                break;
+            }
+            *reg = BLEND(*active, (*reg - 2) & 0177777, *reg);
+            sweepRead(s, reg, addr);
+            break;
+        default:
+            s->instrFetches -= *active;
+            sweepReadAt(s, *p, &x);
+            *p = (*p + 2) & 0177777;
+            *addr = ((r == 7 ? BROADCAST(*p) : *reg) + x) & 0177777;
+            if(mode == 7){
+                s->instrFetches -= *active;
+                sweepRead(s, addr, addr);
+            }
+            break;
+    }
+}
+
+/* put_result_mode() and the PC-relative handlers; true if */ 
+/*   it was a jump, a MOV into the PC, with *pc set to      */ 
+/*   where each lane goes                                   */ 
+static bool sweepPut(sweep_t *s, const lanes_t *active, int mode, int r, int *p, const lanes_t *value, lanes_t *pc){
+    lanes_t *reg = &s->reg[r];
+    lanes_t addr;
+
+    if(mode == 0){
+        if(r == 7){
+            *pc = *value;
+            return true;
+        }
+        *reg = BLEND(*active, *value, *reg);
+        return false;
+    }
+
+    if(r == 7){
+        switch(mode){
+            case 2:
+                addr = BROADCAST(*p);
+                *p = (*p + 2) & 0177777;
+                break;
+            case 3:
+                sweepReadAt(s, *p, &addr);
+                *p = (*p + 2) & 0177777;
+                break;
+            case 4:
+                *p = (*p - 2) & 0177777;
+                addr = BROADCAST(*p);
+                break;
+            case 5:
+                *p = (*p - 2) & 0177777;
+                sweepReadAt(s, *p, &addr);
+                break;
+            default:
+                addr = BROADCAST(*p);
+                break;
+        }
+    }
+    else{
+        switch(mode){
+            case 2:
+                addr = *reg;
+                *reg = BLEND(*active, (*reg + 2) & 0177777, *reg);
+                break;
+            case 3:
+                sweepRead(s, reg, &addr);
+                *reg = BLEND(*active, (*reg + 2) & 0177777, *reg);
+                break;
+            case 4:
+                *reg = BLEND(*active, (*reg - 2) & 0177777, *reg);
+                addr = *reg;
+                break;
+            case 5:
+                *reg = BLEND(*active, (*reg - 2) & 0177777, *reg);
+                sweepRead(s, reg, &addr);
+                break;
+            default:
+                addr = *reg;
+                break;
+        }
+    }
+    sweepWrite(s, active, &addr, value);
+    s->memWrites -= *active;
+    return false;
+}
+
+/* update_operand(); true if it was a jump, as for sweepPut() */ 
+static bool sweepUpdate(sweep_t *s, const lanes_t *active, int mode, int r, const lanes_t *addr, const lanes_t *value, lanes_t *pc){
+    if(mode != 0){
+        sweepWrite(s, active, addr, value);
+        return false;
+    }
+    if(r == 7){
+        *pc = *value;
+        return true;
+    }
+    s->reg[r] = BLEND(*active, *value, s->reg[r]);
+    return false;
+}
+
+static inline void sweepSetFlags(sweep_t *s, const lanes_t *active, int op, const lanes_t *src, const lanes_t *dst, const lanes_t *result){
+    s->lastFlags.op = BLEND(*active, BROADCAST(op), s->lastFlags.op);
+    s->lastFlags.src = BLEND(*active, *src, s->lastFlags.src);
+    s->lastFlags.dst = BLEND(*active, *dst, s->lastFlags.dst);
+    s->lastFlags.result = BLEND(*active, *result, s->lastFlags.result);
+}
+
+/* setMovFlags() in every active lane */ 
+static inline void sweepSetMovFlags(sweep_t *s, const lanes_t *active, const lanes_t *result){
+    lanes_t keep = *active & (s->lastFlags.op != FLAGS_MOV);
+
+    s->carryFlags.op = BLEND(keep, s->lastFlags.op, s->carryFlags.op);
+    s->carryFlags.src = BLEND(keep, s->lastFlags.src, s->carryFlags.src);
+    s->carryFlags.dst = BLEND(keep, s->lastFlags.dst, s->carryFlags.dst);
+    s->carryFlags.result = BLEND(keep, s->lastFlags.result, s->carryFlags.result);
+    s->lastFlags.op = BLEND(*active, BROADCAST(FLAGS_MOV), s->lastFlags.op);
+    s->lastFlags.result = BLEND(*active, *result, s->lastFlags.result);
+}
+
+/* lane l's condition codes, as lazyNzvc() gives them */ 
+static inline int sweepNzvc(const sweep_t *s, int l){
+    const lazy_flags_t last = { s->lastFlags.op[l], s->lastFlags.src[l], s->lastFlags.dst[l], s->lastFlags.result[l] };
+    const lazy_flags_t carry = { s->carryFlags.op[l], s->carryFlags.src[l], s->carryFlags.dst[l], s->carryFlags.result[l] };
+
+    return lazyNzvc(&last, &carry);
+}
+
+/* run the lanes at the lowest PC that hold the same word */ 
+/*   there up to the next jump or branch, picking up lanes  */ 
+/*   waiting further along on the way; false once every     */ 
+/*   lane halted                                            */ 
+bool sweepStep(sweep_t *s){
+    int pc = INT_MAX, lead = 0, w, p;
+    lanes_t active, src, dst, srcAddr, dstAddr, result, taken, next, nzvc;
+    const lanes_t zero = BROADCAST(0);
+    const decoded_t *d;
+    bool jump = false;
+
+    for(int l = 0; l < SWEEP_WIDTH; l++){
+        if(!s->halted[l] && s->reg[7][l] < pc){
+            pc = s->reg[7][l];
+            lead = l;
+        }
+    }
+    if(pc == INT_MAX){
+        return false;
+    }
+
+    for(;;){
+        active = (s->reg[7] == pc) & ~s->halted;
+        w = (pc & 0177777) >> 1;
+        if(s->differs[w]){
+            for(int l = 0; l < SWEEP_WIDTH; l++){
+                if(s->mem[l][w] != s->mem[lead][w]){
+                    active[l] = 0;
+                }
+            }
+        }
+
+        d = &decodeTable[s->mem[lead][w]];
+        p = (pc + 2) & 0177777;
+        s->instrExecs -= active;
+        s->instrFetches -= active;
+
+        switch(d->op){
+            case OP_HALT:
+                s->halted |= active;
+                break;
+            case OP_MOV:
+                sweepGet(s, &active, d->srcMode, d->srcReg, &p, &src, &srcAddr);
+                sweepSetMovFlags(s, &active, &src);
+                jump = sweepPut(s, &active, d->dstMode, d->dstReg, &p, &src, &next);
+                break;
+            case OP_CMP:
+                sweepGet(s, &active, d->srcMode, d->srcReg, &p, &src, &srcAddr);
+                sweepGet(s, &active, d->dstMode, d->dstReg, &p, &dst, &dstAddr);
+                result = (src - dst) & 0177777;
+                sweepSetFlags(s, &active, FLAGS_CMP, &src, &dst, &result);
+                break;
+            case OP_ADD:
+            case OP_SUB:
+                sweepGet(s, &active, d->srcMode, d->srcReg, &p, &src, &srcAddr);
+                sweepGet(s, &active, d->dstMode, d->dstReg, &p, &dst, &dstAddr);
+                if(d->op == OP_ADD){
+                    result = (src + dst) & 0177777;
+                }
+                else{
+                    result = (dst - src) & 0177777;
+                }
+                sweepSetFlags(s, &active, d->op == OP_ADD ? FLAGS_ADD : FLAGS_SUB, &src, &dst, &result);
+                jump = sweepUpdate(s, &active, d->dstMode, d->dstReg, &dstAddr, &result, &next);
+                break;
+            case OP_ASR:
+            case OP_ASL:
+                sweepGet(s, &active, d->dstMode, d->dstReg, &p, &dst, &dstAddr);
+                if(d->op == OP_ASR){
+                    result = ((dst >> 1) | 0100000) & 0177777;
+                }
+                else{
+                    result = (dst << 1) & 0177777;
+                }
+                src = BROADCAST(0);
+                sweepSetFlags(s, &active, d->op == OP_ASR ? FLAGS_ASR : FLAGS_ASL, &src, &dst, &result);
+                jump = sweepUpdate(s, &active, d->dstMode, d->dstReg, &dstAddr, &result, &next);
+                break;
+            case OP_SOB:
+                next = BROADCAST(p);
+                result = (d->srcReg == 7 ? next : s->reg[d->srcReg]) - 1;
+                if(d->srcReg == 7){
+                    next = result;
+                }
+                else{
+                    s->reg[d->srcReg] = BLEND(active, result, s->reg[d->srcReg]);
+                }
+                taken = active & (result != 0);
+                next = BLEND(taken, (next - 2 * d->offset) & 0177777, next);
+                s->branch_taken -= taken;
+                s->branches -= active;
+                jump = true;
+                break;
+            case OP_CLR:
+                sweepSetFlags(s, &active, FLAGS_PSW, &zero, &zero, &zero);
+                jump = sweepPut(s, &active, d->dstMode, d->dstReg, &p, &zero, &next);
+                break;
+            case OP_INC:
+            case OP_DEC:
+            case OP_NEG:
+            case OP_TST:
+                sweepGet(s, &active, d->dstMode, d->dstReg, &p, &dst, &dstAddr);
+                if(d->op == OP_TST){
+                    sweepSetFlags(s, &active, FLAGS_PSW, &zero, &zero, &dst);
+                    break;
+                }
+                if(d->op == OP_NEG){
+                    result = (-dst) & 0177777;
+                    sweepSetFlags(s, &active, FLAGS_SUB, &dst, &zero, &result);
+                }
+                else{
+                    /* C is kept, so it is taken from each lane first */ 
+                    for(int l = 0; l < SWEEP_WIDTH; l++){
+                        nzvc[l] = sweepNzvc(s, l);
+                    }
+                    result = (dst + (d->op == OP_INC ? 1 : -1)) & 0177777;
+                    src = ((result == (d->op == OP_INC ? 0100000 : 077777)) & 2) | (nzvc & 1);
+                    sweepSetFlags(s, &active, FLAGS_PSW, &src, &zero, &result);
+                }
+                jump = sweepUpdate(s, &active, d->dstMode, d->dstReg, &dstAddr, &result, &next);
+                break;
+            case OP_JSR:
+                sweepAddress(s, &active, d->dstMode, d->dstReg, &p, &dstAddr);
+                s->reg[6] = BLEND(active, (s->reg[6] - 2) & 0177777, s->reg[6]);
+                src = d->srcReg == 7 ? BROADCAST(p) : s->reg[d->srcReg];
+                sweepWrite(s, &active, &s->reg[6], &src);
+                s->memWrites -= active;
+                if(d->srcReg != 7){
+                    s->reg[d->srcReg] = BLEND(active, BROADCAST(p), s->reg[d->srcReg]);
+                }
+                next = dstAddr & 0177777;
+                jump = true;
+                break;
+            case OP_RTS:
+                sweepRead(s, &s->reg[6], &src);
+                s->instrFetches -= active;
+                s->reg[6] = BLEND(active, (s->reg[6] + 2) & 0177777, s->reg[6]);
+                next = d->dstReg == 7 ? src : s->reg[d->dstReg];
+                if(d->dstReg != 7){
+                    s->reg[d->dstReg] = BLEND(active, src, s->reg[d->dstReg]);
+                }
+                jump = true;
+                break;
+            case OP_RTI:
+                /* the condition codes of the PSW popped; N wins over Z as in pswFlags() */ 
+                dstAddr = s->reg[6] + 2;
+                sweepRead(s, &s->reg[6], &src);
+                sweepRead(s, &dstAddr, &dst);
+                s->instrFetches -= active + active;
+                s->reg[6] = BLEND(active, (s->reg[6] + 4) & 0177777, s->reg[6]);
+                dstAddr = dst & 3;
+                result = (((dst & 010) != 0) & 0100000) | (((dst & 014) == 0) & 1);
+                sweepSetFlags(s, &active, FLAGS_PSW, &dstAddr, &zero, &result);
+                next = src;
+                jump = true;
+                break;
+            case OP_MUL:
+            case OP_DIV:
+            case OP_ASH:
+            case OP_ASHC:
+                /* lane by lane, with the interpreter's arithmetic */ 
+                sweepGet(s, &active, d->dstMode, d->dstReg, &p, &dst, &dstAddr);
+                for(int l = 0; l < SWEEP_WIDTH; l++){
+                    int reg[8];
+                    lazy_flags_t f;
+
+                    if(!active[l]){
+                        continue;
+                    }
+                    for(int r = 0; r < 7; r++){
+                        reg[r] = s->reg[r][l];
+                    }
+                    reg[7] = p;
+                    eisOperation(s->mem[lead][w], dst[l], reg, &f);
+                    for(int r = 0; r < 7; r++){
+                        s->reg[r][l] = reg[r];
+                    }
+                    next[l] = reg[7];
+                    s->lastFlags.op[l] = f.op;
+                    s->lastFlags.src[l] = f.src;
+                    s->lastFlags.dst[l] = f.dst;
+                    s->lastFlags.result[l] = f.result;
+                }
+                jump = (d->srcReg | 1) == 7;
+                break;
+            case OP_BR:
+            case OP_BNE:
+            case OP_BEQ:
+            case OP_BPL:
+            case OP_BMI:
+            case OP_BHI:
+            case OP_BLOS:
+            case OP_BVC:
+            case OP_BVS:
+            case OP_BCC:
+            case OP_BCS:
+            case OP_BGE:
+            case OP_BLT:
+            case OP_BGT:
+            case OP_BLE:
+                if(d->op == OP_BR){
+                    taken = active;
+                }
+                else if(d->op == OP_BNE){
+                    taken = active & (s->lastFlags.result != 0);
+                }
+                else if(d->op == OP_BEQ){
+                    taken = active & (s->lastFlags.result == 0);
+                }
+                else{
+                    for(int l = 0; l < SWEEP_WIDTH; l++){
+                        taken[l] = active[l] && branchCondition(s->mem[lead][w], sweepNzvc(s, l)) ? -1 : 0;
+                    }
+                }
+                next = BLEND(taken, BROADCAST((p + 2 * d->offset) & 0177777), BROADCAST(p));
+                s->branch_taken -= taken;
+                s->branches -= active;
+                jump = true;
+                break;
+            default:
+                s->illegal -= active;
+                s->instrExecs += active;
+                break;
+        }
+
+        s->reg[7] = BLEND(active, jump ? next : BROADCAST(p), s->reg[7]);
+        if(jump || d->op == OP_HALT){
+            return true;
+        }
+        pc = p;
+    }
+}
+
+/* set lane l up as a freshly loaded copy of m's program and */ 
+/*   apply one line of the sweep file to it: rN=value sets a */ 
+/*   register and address=value a word of memory, all octal; */ 
+/*   false if the line does not parse                        */ 
+bool startLane(sweep_t *s, int l, const machine_t *m, char *line){
+    char *save, *end, *token;
+    long target, value;
+
+    for(int r = 0; r < 8; r++){
+        s->reg[r][l] = 0;
+    }
+    s->lastFlags.op[l] = s->carryFlags.op[l] = FLAGS_PSW;
+    s->lastFlags.src[l] = s->carryFlags.src[l] = 0;
+    s->lastFlags.dst[l] = s->carryFlags.dst[l] = 0;
+    s->lastFlags.result[l] = s->carryFlags.result[l] = 1;
+    s->halted[l] = 0;
+    s->illegal[l] = 0;
+    s->instrExecs[l] = s->instrFetches[l] = s->memReads[l] = 0;
+    s->memWrites[l] = s->branches[l] = s->branch_taken[l] = 0;
+    memcpy(s->mem[l], m->mem, sizeof(m->mem));
+
+    for(token = strtok_r(line, " \t\r\n", &save); token != NULL; token = strtok_r(NULL, " \t\r\n", &save)){
+        char *equals = strchr(token, '=');
+
+        if(token[0] == '#'){
+            break;
+        }
+        if(equals == NULL){
+            return false;
+        }
+        value = strtol(equals + 1, &end, 8);
+        if(end == equals + 1 || *end != '\0' || value < 0 || value > 0177777){
+            return false;
+        }
+        if(token[0] == 'r' && token[1] >= '0' && token[1] <= '7' && equals == token + 2){
+            s->reg[token[1] - '0'][l] = value;
+            continue;
+        }
+        target = strtol(token, &end, 8);
+        if(end == token || end != equals || target < 0 || target > 0177777 || (target & 1)){
+            return false;
+        }
+        s->mem[l][target >> 1] = value;
+        s->differs[target >> 1] = 1;
+    }
+    return true;
+}
+
+/* what a run of the lane's program prints: statistics, then */ 
+/*   the registers, and with -v the first words of memory;    */ 
+/*   out is a spare machine the lane is copied into          */ 
+void printLane(machine_t *out, const sweep_t *s, int l){
+    for(int r = 0; r < 8; r++){
+        out->reg[r] = s->reg[r][l];
+    }
+    out->instrExecs = s->instrExecs[l];
+    out->instrFetches = s->instrFetches[l];
+    out->memReads = s->memReads[l];
+    out->memWrites = s->memWrites[l];
+    out->branches = s->branches[l];
+    out->branch_taken = s->branch_taken[l];
+
+    for(int i = 0; i < s->illegal[l]; i++){
+        fprintf(out->out, "Error: no matching instruction");
+    }
+    printStatistics(out);
+    printRegisters(out);
+    if(verboseMode){
+        memcpy(out->mem, s->mem[l], sizeof(out->mem));
+        printFirst20Mem(out);
+    }
+}
+
+/* run m's program once for every line of sweepFile, each */ 
+/*   line giving one lane's initial registers and memory,  */ 
+/*   and print every lane's results under a header         */ 
+int runSweep(machine_t *m, const char *sweepFile){
+    FILE *in = fopen(sweepFile, "r");
+    sweep_t *s = aligned_alloc(_Alignof(sweep_t), sizeof(sweep_t));
+    machine_t *out = newMachine(m->programFile, m->out);
+    char line[4096];
+    int lineNumbers[SWEEP_WIDTH];
+    int lineNumber = 0, lane = 0, status = 0;
+    bool more = true;
+
+    if(in == NULL){
+        fprintf(m->out, "Error: cannot open %s\n", sweepFile);
+        status = 1;
+        more = false;
+    }
+    else if(s == NULL || out == NULL){
+        fprintf(m->out, "Error: out of memory for sweep\n");
+        status = 1;
+        more = false;
+    }
+
+    while(more){
+        int count = 0;
+
+        memset(s->differs, 0, sizeof(s->differs));
+        while(count < SWEEP_WIDTH && (more = fgets(line, sizeof(line), in) != NULL)){
+            char *c = line + strspn(line, " \t\r\n");
+
+            lineNumber++;
+            if(*c == '\0' || *c == '#'){
+                continue;
+            }
+            if(!startLane(s, count, m, line)){
+                fprintf(m->out, "Error: %s line %d: expected rN=value or address=value, in octal\n",
+                        sweepFile, lineNumber);
+                status = 1;
+                more = false;
+                count = 0;
+                break;
+            }
+            lineNumbers[count++] = lineNumber;
+        }
+        if(count == 0){
+            break;
+        }
+        for(int l = count; l < SWEEP_WIDTH; l++){
+            char none[] = "";
+
+            startLane(s, l, m, none);
+            s->halted[l] = -1;
+        }
+
+        while(sweepStep(s)){
+        }
+
+        for(int l = 0; l < count; l++){
+            fprintf(m->out, "%s==> %s line %d <==\n", lane++ > 0 ? "\n" : "", sweepFile, lineNumbers[l]);
+            printLane(out, s, l);
+        }
+    }
+
+    if(in != NULL){
+        fclose(in);
+    }
+    if(out != NULL){
+        freeMachine(out);
+    }
+    free(s);
+    return status;
+}
+
+/* fetch the next instruction; the word and its predecoded  */ 
+/*   form come from the block cache, which is re-entered      */ 
+/*   whenever the PC leaves the straight-line path; with fuse */ 
+/*   blocks that are recognized loops or compiled are first   */ 
+/*   run without going through the handlers                   */ 
+static inline __attribute__((always_inline))
+const decoded_t *fetch(machine_t *m, const bool fuse){
+    const block_entry_t *e;
+
+    /* note that reg[7] in PDP-11 is the PC */ 
+    if(m->nextEntry == m->blockEnd || m->nextEntry->pc != m->reg[7]){
+        m->currentBlock = lookupBlock(m, m->reg[7]);
+        while(fuse && runWholeBlock(m, m->currentBlock)){
+            m->currentBlock = lookupBlock(m, m->reg[7]);
+        }
+        m->nextEntry = m->currentBlock->entries;
+        m->blockEnd = m->nextEntry + m->currentBlock->count;
+    }
+    e = m->nextEntry++;
+    CACHE_ACCESS(m, ACCESS_INSTRUCTION, m->reg[7]);
+
+    m->ir = e->ir;
+    m->instrFetches++;
+    m->reg[7] = ( m->reg[7] + 2 ) & CLAMP_16_BIT; 
+
+    /* the fields for the addressing modes were extracted */ 
+    /*   once, when the decode table was built            */ 
+    m->src.mode = e->d->srcMode;
+    m->src.reg = e->d->srcReg;
+    m->dst.mode = e->d->dstMode;
+    m->dst.reg = e->d->dstReg;
+
+    return e->d;
+}
+
+block_t *lookupBlock(machine_t *m, int pc){
+    block_t *b;
+
+    /* an RTS or MOV to the PC can leave it wider than 16 */ 
+    /*   bits, from a register SOB took below zero         */ 
+    pc &= 0177777;
+    b = m->blockCache[pc >> 1];
+
+    if(m->retiredBlock != NULL){
+        free(m->retiredBlock);
+        m->retiredBlock = NULL;
+    }
+
+    m->blockLookups++;
+    if(b != NULL && b->startPc == pc){
+        m->blockHits++;
+        return b;
+    }
+    if(b != NULL){
+        /* an odd PC shares the word with the even one */ 
+        invalidateCode(m, pc >> 1);
+    }
+    b = buildBlock(m, pc);
+    m->blockCache[pc >> 1] = b;
+    return b;
+}
+
+/* number of words the instruction occupies, counting the   */ 
+/*   immediate and index words the operand handlers         */ 
+/*   consume after it                                       */ 
+int instructionWords(int word){
+    const decoded_t *d = &decodeTable[word];
+    int words = 1;
+
+    switch(d->op){
+        case OP_MOV:
+            if(d->srcMode >= 6 || ((d->srcMode == 2 || d->srcMode == 3) && d->srcReg == 7)) words++;
+            if((d->dstMode == 2 || d->dstMode == 3) && d->dstReg == 7) words++;
+            break;
+        case OP_CMP:
+        case OP_ADD:
+        case OP_SUB:
+            if(d->srcMode >= 6 || ((d->srcMode == 2 || d->srcMode == 3) && d->srcReg == 7)) words++;
+            /* fall through */ 
+        case OP_ASR:
+        case OP_ASL:
+        case OP_CLR:
+        case OP_INC:
+        case OP_DEC:
+        case OP_NEG:
+        case OP_TST:
+        case OP_JSR:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_ASH:
+        case OP_ASHC:
+            if(d->dstMode >= 6 || ((d->dstMode == 2 || d->dstMode == 3) && d->dstReg == 7)) words++;
+            break;
+    }
+    return words;
+}
+
+block_t *buildBlock(machine_t *m, int pc){
+    block_t *b = malloc(sizeof(block_t));
+    const decoded_t *d;
+    int addr = pc;
+
+    if(b == NULL){
+        fprintf(m->out, "Error: out of memory for block cache\n");
+        exit(1);
+    }
+
+    b->startPc = pc;
+    b->heat = 0;
+    b->native = NULL;
+    b->count = 0;
+    memset(b->runs, 0, sizeof(b->runs));
+    b->taken = 0;
+    do{
+        block_entry_t *e = &b->entries[b->count++];
+
+        e->pc = addr;
+        e->ir = peek_word(m, addr);
+        e->d = d = &decodeTable[e->ir];
+        addr = addr + 2 * instructionWords(e->ir);
+    } while(b->count < MAX_BLOCK_INSTRS && addr < 0200000 && !endsBlock(d->op));
+
+    if(addr > 0200000) addr = 0200000;
+    b->endPc = addr;
+    for(int w = pc >> 1; w < (addr + 1) >> 1; w++){
+        m->codeMap[w]++;
+    }
+    b->idiom = recognizeIdiom(m, b);
+    return b;
+}
+
+/* called on every data write; drops the cached blocks that */ 
+/*   cover the written word so self-modifying code still    */ 
+/*   sees its new instructions                              */ 
+void invalidateCode(machine_t *m, int wordAddr){
+    int first;
+
+    if(wordAddr < 0 || wordAddr >= MEM_SIZE_IN_WORDS || m->codeMap[wordAddr] == 0){
+        return;
+    }
+
+    /* a block spans at most 3 words per instruction */ 
+    first = wordAddr - 3 * MAX_BLOCK_INSTRS;
+    if(first < 0) first = 0;
+    for(int w = first; w <= wordAddr; w++){
+        block_t *b = m->blockCache[w];
+
+        if(b == NULL || (b->endPc + 1) >> 1 <= wordAddr){
+            continue;
+        }
+        for(int i = b->startPc >> 1; i < (b->endPc + 1) >> 1; i++){
+            m->codeMap[i]--;
+        }
+        m->blockCache[w] = NULL;
+        m->blockInvalidations++;
+        foldBlockRuns(m, b);
+        if(b == m->currentBlock){
+            /* finish the current instruction, then refetch */ 
+            m->nextEntry = m->blockEnd = NULL;
+            m->currentBlock = NULL;
+            free(m->retiredBlock);
+            m->retiredBlock = b;
+        }
+        else{
+            free(b);
+        }
+    }
+}
+
+/* whether whole blocks count their runs: for -p and -c */ 
+static inline bool countingRuns(void){
+    return profileMode || timingMode;
+}
+
+/* -p and -c: whole runs of b, counted once per run by */ 
+/*   runIdiom() and compiled code, as counts for each PC */ 
+/*   it covers and as the cycles of each entry's opcode  */ 
+void foldBlockRuns(machine_t *m, block_t *b){
+    unsigned long n = 0;
+
+    if(!countingRuns()){
+        return;
+    }
+    for(int i = b->count - 1; i >= 0; i--){
+        const block_entry_t *e = &b->entries[i];
+
+        /* the runs that ended here or further on ran entry i */ 
+        n += b->runs[i];
+        b->runs[i] = 0;
+        if(n > 0 && profileMode){
+            m->pcCounts[e->pc >> 1] += n;
+            m->opModeCounts[e->d->op][e->d->srcMode][e->d->dstMode] += n;
+        }
+        if(n > 0 && timingMode){
+            m->opCycles[e->d->op] += n * e->d->cycles;
+        }
+    }
+    if(profileMode){
+        m->takenCounts[b->entries[b->count - 1].pc >> 1] += b->taken;
+    }
+    b->taken = 0;
+}
+
+/* the same for every block still cached, once a run ends */ 
+void foldAllBlockRuns(machine_t *m){
+    if(!countingRuns()){
+        return;
+    }
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w += 8){
+        uint64_t covered;
+
+        memcpy(&covered, &m->codeMap[w], sizeof(covered));
+        for(int i = w; covered != 0 && i < w + 8; i++){
+            if(m->blockCache[i] != NULL){
+                foldBlockRuns(m, m->blockCache[i]);
+            }
+        }
+    }
+}
+
+/* the loop idiom block b is, if any: every instruction of */ 
+/*   the loop is in the block and the closing branch goes   */ 
+/*   back to its start                                      */ 
+int recognizeIdiom(machine_t *m, const block_t *b){
+    const decoded_t *first = b->entries[0].d;
+    const decoded_t *last = b->entries[b->count - 1].d;
+    int lastPc = b->entries[b->count - 1].pc;
+
+    if(b->count == 2 && last->op == OP_SOB &&
+       ((lastPc + 2 - 2 * last->offset) & 0177777) == b->startPc &&
+       first->op == OP_MOV && first->srcMode == 2 && first->dstMode == 2 &&
+       first->srcReg != 7 && first->dstReg != 7 && first->srcReg != first->dstReg &&
+       last->srcReg != first->srcReg && last->srcReg != first->dstReg && last->srcReg != 7){
+        return IDIOM_COPY;
+    }
+
+    if(b->count < 2 || last->op != OP_BNE ||
+       ((lastPc + 2 + 2 * last->offset) & 0177777) != b->startPc){
+        return IDIOM_NONE;
+    }
+    /* the count register is decremented by sub #1,rN */ 
+    {
+        const block_entry_t *sub = &b->entries[b->count - 2];
+
+        if(sub->d->op != OP_SUB || sub->d->srcMode != 2 || sub->d->srcReg != 7 ||
+           sub->d->dstMode != 0 || sub->d->dstReg == 7 || peek_word(m, sub->pc + 2) != 1){
+            return IDIOM_NONE;
+        }
+        if(b->count == 2){
+            return IDIOM_COUNTDOWN;
+        }
+        if(b->count == 3 && first->op == OP_MOV && first->srcMode == 0 &&
+           first->srcReg == sub->d->dstReg && first->dstMode == 2 &&
+           first->dstReg != 7 && first->dstReg != first->srcReg){
+            return IDIOM_FILL;
+        }
+    }
+    return IDIOM_NONE;
+}
+
+/* run the loop in block b from the current registers to its */ 
+/*   last iteration, leaving registers, memory, condition     */ 
+/*   codes and counters as the instructions would have; false */ 
+/*   without doing anything if that cannot be done exactly,   */ 
+/*   and the loop is then executed normally                   */ 
+bool runIdiom(machine_t *m, block_t *b){
+    const decoded_t *first = b->entries[0].d;
+    const decoded_t *last = b->entries[b->count - 1].d;
+    int codeStart = b->startPc >> 1;
+    int codeEnd = (b->endPc + 1) >> 1;
+    int k, from, to;
+
+    switch(b->idiom){
+        case IDIOM_COPY:
+            /* sob does not wrap a zero count at 16 bits */ 
+            k = m->reg[last->srcReg];
+            from = (m->reg[first->srcReg] & 0177777) >> 1;
+            to = (m->reg[first->dstReg] & 0177777) >> 1;
+            if(k <= 0 || k > 0177777 || from + k > MEM_SIZE_IN_WORDS || to + k > MEM_SIZE_IN_WORDS){
+                return false;
+            }
+            /* a destination just above the source would copy */ 
+            /*   the words it has already written, and the loop */ 
+            /*   must not overwrite itself                      */ 
+            if((to > from && to < from + k) || (to < codeEnd && to + k > codeStart)){
+                return false;
+            }
+            setMovFlags(m, m->mem[from + k - 1]);
+            memmove(&m->mem[to], &m->mem[from], k * sizeof(m->mem[0]));
+            m->reg[first->srcReg] = (m->reg[first->srcReg] + 2 * k) & 0177777;
+            m->reg[first->dstReg] = (m->reg[first->dstReg] + 2 * k) & 0177777;
+            m->reg[last->srcReg] = 0;
+            m->instrExecs += 2 * k;
+            m->instrFetches += 3 * k;
+            m->memWrites += k;
+            break;
+        case IDIOM_COUNTDOWN:
+            k = m->reg[first->dstReg];
+            if(k <= 0 || k > 0177777){
+                return false;
+            }
+            setFlags(m, FLAGS_SUB, 1, 1, 0);
+            m->reg[first->dstReg] = 0;
+            m->instrExecs += 2 * k;
+            m->instrFetches += 3 * k;
+            break;
+        case IDIOM_FILL:
+            /* stores the count, from k down to 1 */ 
+            k = m->reg[first->srcReg];
+            to = (m->reg[first->dstReg] & 0177777) >> 1;
+            if(k <= 0 || k > 0177777 || to + k > MEM_SIZE_IN_WORDS ||
+               (to < codeEnd && to + k > codeStart)){
+                return false;
+            }
+            setMovFlags(m, k);
+            if(k >= 2){
+                setFlags(m, FLAGS_SUB, 1, 2, 1);
+                setMovFlags(m, 1);
+            }
+            setFlags(m, FLAGS_SUB, 1, 1, 0);
+            for(int i = 0; i < k; i++){
+                m->mem[to + i] = k - i;
+            }
+            m->reg[first->srcReg] = 0;
+            m->reg[first->dstReg] = (m->reg[first->dstReg] + 2 * k) & 0177777;
+            m->instrExecs += 3 * k;
+            m->instrFetches += 4 * k;
+            m->memWrites += k;
+            break;
+        default:
+            return false;
+    }
+
+    /* k runs of the whole block, counted before the stores */ 
+    /*   below can drop it                                  */ 
+    if(countingRuns()){
+        b->runs[b->count - 1] += k;
+        b->taken += k - 1;
+    }
+
+    /* the stores above bypassed write_word() */ 
+    if(b->idiom != IDIOM_COUNTDOWN){
+        for(int w = to; w < to + k; w++){
+            invalidateCode(m, w);
+        }
+    }
+    m->branches += k;
+    m->branch_taken += k - 1;
+    m->reg[7] = b->endPc & 0177777;
+    m->idiomsRun++;
+    return true;
+}
+
+/* run block b as a whole if it is a recognized loop or has */ 
+/*   been compiled; false if it has to be interpreted       */ 
+static inline bool runWholeBlock(machine_t *m, block_t *b){
+    if(b->idiom != IDIOM_NONE){
+        return runIdiom(m, b);
+    }
+#ifdef JIT
+    if(b->native == NULL && b->heat < JIT_THRESHOLD && ++b->heat == JIT_THRESHOLD){
+        compileBlock(m, b);
+    }
+    if(b->native != NULL){
+        runCompiled(m, b);
+        return true;
+    }
+#endif
+    return false;
+}
+
+#ifdef JIT
+//x86-64 registers by encoding number. While compiled code runs rdi
+//holds the machine, guest r0-r6 live in r8d-r14d and r7 is known at
+//every instruction; eax, ecx, edx and esi are scratch
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+#define GUEST_REG(r) (R8 + (r))
+
+//x86 condition codes for jcc
+#define CC_E 04
+#define CC_NE 05
+
+#define REG_OFFSET(r) (int)(offsetof(machine_t, reg) + 4 * (r))
+#define FLAGS_OFFSET(field) (int)(offsetof(machine_t, lastFlags) + offsetof(lazy_flags_t, field))
+#define COUNTER_OFFSET(counter) (int)offsetof(machine_t, counter)
+
+//Counter increments for the instructions compiled so far in a block
+typedef struct jit_counts_t{
+    int execs;
+    int fetches;
+    int writes;
+    unsigned long *runs; //the block's runs[], NULL unless -p or -c counts them
+} jit_counts_t;
+
+static void emit8(unsigned char **p, int byte){
+    *(*p)++ = byte;
+}
+
+static void emit32(unsigned char **p, int32_t value){
+    memcpy(*p, &value, 4);
+    *p += 4;
+}
+
+static void emitOpcode(unsigned char **p, int rex, int opcode){
+    if(rex != 0x40){
+        emit8(p, rex);
+    }
+    if(opcode > 0xFF){
+        emit8(p, opcode >> 8);
+    }
+    emit8(p, opcode & 0xFF);
+}
+
+/* opcode with ModRM for reg (or an opcode extension) and */ 
+/*   the register rm; w selects 64-bit operands           */ 
+static void emitRR(unsigned char **p, int w, int opcode, int reg, int rm){
+    emitOpcode(p, 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3), opcode);
+    emit8(p, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* the same with the memory operand [base + index*scale + */ 
+/*   disp], index -1 for none                             */ 
+static void emitRM(unsigned char **p, int w, int opcode, int reg, int base, int index, int scale, int disp){
+    int x = index < 0 ? 0 : index >> 3;
+
+    emitOpcode(p, 0x40 | (w << 3) | ((reg >> 3) << 2) | (x << 1) | (base >> 3), opcode);
+    if(index < 0){
+        emit8(p, 0x80 | ((reg & 7) << 3) | (base & 7));
+    }
+    else{
+        emit8(p, 0x80 | ((reg & 7) << 3) | 4);
+        emit8(p, ((scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0) << 6) | ((index & 7) << 3) | (base & 7));
+    }
+    emit32(p, disp);
+}
+
+static void emitMovRR(unsigned char **p, int dst, int src){
+    emitRR(p, 0, 0x89, src, dst);
+}
+
+static void emitMovRI(unsigned char **p, int dst, int value){
+    emitOpcode(p, 0x40 | (dst >> 3), 0xB8 + (dst & 7));
+    emit32(p, value);
+}
+
+/* ALU operation with an immediate: ext is 0 add, 1 or, */ 
+/*   4 and, 5 sub, 7 cmp                                 */ 
+static void emitAluRI(unsigned char **p, int ext, int dst, int value){
+    emitRR(p, 0, 0x81, ext, dst);
+    emit32(p, value);
+}
+
+static void emitAddMI(unsigned char **p, int offset, int value){
+    if(value != 0){
+        emitRM(p, 0, 0x81, 0, RDI, -1, 1, offset);
+        emit32(p, value);
+    }
+}
+
+static void emitStoreMI(unsigned char **p, int offset, int value){
+    emitRM(p, 0, 0xC7, 0, RDI, -1, 1, offset);
+    emit32(p, value);
+}
+
+/* 16-bit byte address in r to a word index into mem[] */ 
+static void emitWordIndex(unsigned char **p, int r){
+    emitAluRI(p, 4, r, 0177777);
+    emitRR(p, 0, 0xD1, 5, r); //shr r, 1
+}
+
+static void emitLoadWord(unsigned char **p, int dst, int index){
+    emitRM(p, 0, 0x0FB7, dst, RDI, index, 2, offsetof(machine_t, mem));
+}
+
+static unsigned char *emitJump(unsigned char **p){
+    emit8(p, 0xE9);
+    emit32(p, 0);
+    return *p - 4;
+}
+
+static unsigned char *emitJcc(unsigned char **p, int cc){
+    emit8(p, 0x0F);
+    emit8(p, 0x80 | cc);
+    emit32(p, 0);
+    return *p - 4;
+}
+
+static void patchJump(unsigned char *at, const unsigned char *target){
+    int32_t rel = target - (at + 4);
+
+    memcpy(at, &rel, 4);
+}
+
+/* add one to the 64-bit counter at a fixed host address; */ 
+/*   eax is scratch                                        */ 
+static void emitIncrement(unsigned char **p, unsigned long *counter){
+    uint64_t address = (uintptr_t)counter;
+
+    emitOpcode(p, 0x48, 0xB8 + RAX); //mov rax, imm64
+    memcpy(*p, &address, 8);
+    *p += 8;
+    emitRM(p, 1, 0xFF, 0, RAX, -1, 1, 0); //inc qword [rax]
+}
+
+/* the counters, at each way out of a block; with -p or -c */ 
+/*   also its one increment per run, for the entry it ended */ 
+/*   on                                                     */ 
+static void emitCounts(unsigned char **p, const jit_counts_t *c){
+    emitAddMI(p, COUNTER_OFFSET(instrExecs), c->execs);
+    emitAddMI(p, COUNTER_OFFSET(instrFetches), c->fetches);
+    emitAddMI(p, COUNTER_OFFSET(memWrites), c->writes);
+    if(c->runs != NULL){
+        emitIncrement(p, &c->runs[c->execs - 1]);
+    }
+}
+
+/* leave compiled code with the PC at pc; eax is the word */ 
+/*   to invalidate, or -1                                 */ 
+static void emitExit(machine_t *m, unsigned char **p, int pc){
+    emitStoreMI(p, REG_OFFSET(7), pc & 0177777);
+    emitMovRI(p, RAX, -1);
+    patchJump(emitJump(p), m->jitLeave);
+}
+
+/* continue at pc: jump straight into the compiled code of */ 
+/*   the block starting there, or leave if there is none,  */ 
+/*   or if m runs its compiled blocks one at a time        */ 
+static void emitChain(machine_t *m, unsigned char **p, int pc){
+    unsigned char *noBlock, *otherBlock, *notCompiled;
+
+    pc &= 0177777;
+    if(!m->unchained){
+        emitRM(p, 1, 0x8B, RAX, RDI, -1, 1, offsetof(machine_t, blockCache) + (pc >> 1) * sizeof(block_t*));
+        emitRR(p, 1, 0x85, RAX, RAX);
+        noBlock = emitJcc(p, CC_E);
+        emitRM(p, 0, 0x81, 7, RAX, -1, 1, offsetof(block_t, startPc));
+        emit32(p, pc);
+        otherBlock = emitJcc(p, CC_NE);
+        emitRM(p, 1, 0x8B, RAX, RAX, -1, 1, offsetof(block_t, native));
+        emitRR(p, 1, 0x85, RAX, RAX);
+        notCompiled = emitJcc(p, CC_E);
+        emitRR(p, 0, 0xFF, 4, RAX); //jmp rax
+        patchJump(noBlock, *p);
+        patchJump(otherBlock, *p);
+        patchJump(notCompiled, *p);
+    }
+    emitExit(m, p, pc);
+}
+
+/* store value at the word index in ecx; a store to a word */ 
+/*   holding code leaves, after the counts so far, so the  */ 
+/*   block can be dropped before anything else runs        */ 
+static void emitStore(machine_t *m, unsigned char **p, int value, const jit_counts_t *c, int nextPc){
+    unsigned char *skip;
+
+    emit8(p, 0x66);
+    emitRM(p, 0, 0x89, value, RDI, RCX, 2, offsetof(machine_t, mem));
+    emitRM(p, 0, 0x80, 7, RDI, RCX, 1, offsetof(machine_t, codeMap));
+    emit8(p, 0);
+    skip = emitJcc(p, CC_E);
+    emitCounts(p, c);
+    emitStoreMI(p, REG_OFFSET(7), nextPc & 0177777);
+    emitMovRR(p, RAX, RCX);
+    patchJump(emitJump(p), m->jitLeave);
+    patchJump(skip, *p);
+}
+
+/* address computation for an operand, as get_operand_mode() */ 
+/*   does it, leaving the word index in ecx; with value set  */ 
+/*   the operand is also read into it. *pc follows reg[7]    */ 
+/*   and *fetches the counts of the interpreted handlers;    */ 
+/*   false for the forms that are not compiled               */ 
+static bool emitOperand(machine_t *m, unsigned char **p, int mode, int r, int *pc, int value, int *fetches, bool put){
+    int R = GUEST_REG(r);
+
+    if(r == 7){
+        switch(mode){
+            case 0:
+                if(put){
+                    return false;
+                }
+                emitMovRI(p, value, *pc);
+                return true;
+            case 2:
+                emitMovRI(p, RCX, (*pc & 0177777) >> 1);
+                if(!put){
+                    emitMovRI(p, value, peek_word(m, *pc));
+                    *fetches += 1;
+                }
+                *pc += 2;
+                return true;
+            case 3:
+                emitMovRI(p, RCX, (peek_word(m, *pc) & 0177777) >> 1);
+                if(!put){
+                    emitLoadWord(p, value, RCX);
+                    *fetches += 2;
+                }
+                *pc += 2;
+                return true;
+        }
+        return false;
+    }
+
+    switch(mode){
+        case 0:
+            if(!put){
+                emitMovRR(p, value, R);
+            }
+            return true;
+        case 1:
+            emitMovRR(p, RCX, R);
+            emitWordIndex(p, RCX);
+            break;
+        case 2:
+        case 3:
+            emitMovRR(p, RCX, R);
+            emitWordIndex(p, RCX);
+            if(mode == 3){
+                emitLoadWord(p, RCX, RCX);
+                emitWordIndex(p, RCX);
+            }
+            emitAluRI(p, 0, R, 2);
+            emitAluRI(p, 4, R, 0177777);
+            break;
+        case 4:
+        case 5:
+            emitAluRI(p, 5, R, 2);
+            emitAluRI(p, 4, R, 0177777);
+            emitMovRR(p, RCX, R);
+            emitWordIndex(p, RCX);
+            if(mode == 5){
+                emitLoadWord(p, RCX, RCX);
+                emitWordIndex(p, RCX);
+            }
+            break;
+        default:
+            return false;
+    }
+    if(!put){
+        emitLoadWord(p, value, RCX);
+        *fetches += mode == 1 ? 0 : mode == 3 || mode == 5 ? 2 : 1;
+    }
+    return true;
+}
+
+/* lastFlags for an operation other than MOV */ 
+static void emitSetFlags(unsigned char **p, int op, int src, int dst, int result){
+    emitStoreMI(p, FLAGS_OFFSET(op), op);
+    if(src < 0){
+        emitStoreMI(p, FLAGS_OFFSET(src), 0);
+    }
+    else{
+        emitRM(p, 0, 0x89, src, RDI, -1, 1, FLAGS_OFFSET(src));
+    }
+    emitRM(p, 0, 0x89, dst, RDI, -1, 1, FLAGS_OFFSET(dst));
+    emitRM(p, 0, 0x89, result, RDI, -1, 1, FLAGS_OFFSET(result));
+}
+
+/* setMovFlags(); *flagsOp is the operation that last set the */ 
+/*   flags in this block, or -1 if that is not known here     */ 
+static void emitSetMovFlags(unsigned char **p, int value, int *flagsOp){
+    unsigned char *skip = NULL;
+
+    if(*flagsOp != FLAGS_MOV){
+        if(*flagsOp < 0){
+            emitRM(p, 0, 0x81, 7, RDI, -1, 1, FLAGS_OFFSET(op));
+            emit32(p, FLAGS_MOV);
+            skip = emitJcc(p, CC_E);
+        }
+        for(int i = 0; i < (int)sizeof(lazy_flags_t); i += 8){
+            emitRM(p, 1, 0x8B, RDX, RDI, -1, 1, offsetof(machine_t, lastFlags) + i);
+            emitRM(p, 1, 0x89, RDX, RDI, -1, 1, offsetof(machine_t, carryFlags) + i);
+        }
+        if(skip != NULL){
+            patchJump(skip, *p);
+        }
+        emitStoreMI(p, FLAGS_OFFSET(op), FLAGS_MOV);
+    }
+    emitRM(p, 0, 0x89, value, RDI, -1, 1, FLAGS_OFFSET(result));
+    *flagsOp = FLAGS_MOV;
+}
+
+/* one MOV, CMP, ADD, SUB, ASR or ASL; false if it is not */ 
+/*   compiled, having emitted nothing that matters        */ 
+static bool emitInstruction(machine_t *m, unsigned char **p, const block_entry_t *e, jit_counts_t *c, int *flagsOp){
+    const decoded_t *d = e->d;
+    int pc = e->pc + 2;
+    int fetches = 1;
+    bool hasSrc = d->op == OP_MOV || d->op == OP_CMP || d->op == OP_ADD || d->op == OP_SUB;
+    bool writes = d->op != OP_CMP && d->dstMode != 0;
+
+    if(d->op != OP_MOV && !hasSrc && d->op != OP_ASR && d->op != OP_ASL){
+        return false;
+    }
+    /* only register, autoincrement and autodecrement forms; */ 
+    /*   index modes and jumps through r7 are interpreted    */ 
+    if((hasSrc && (d->srcMode >= 6 || (d->srcReg == 7 && (d->srcMode == 1 || d->srcMode >= 4)))) ||
+       d->dstMode >= 6 || (d->dstReg == 7 && d->dstMode != 2 && d->dstMode != 3)){
+        return false;
+    }
+
+    if(hasSrc){
+        emitOperand(m, p, d->srcMode, d->srcReg, &pc, RAX, &fetches, false);
+    }
+    if(d->op == OP_MOV){
+        emitSetMovFlags(p, RAX, flagsOp);
+        emitOperand(m, p, d->dstMode, d->dstReg, &pc, RAX, &fetches, true);
+        c->execs++;
+        c->fetches += fetches;
+        if(d->dstMode == 0){
+            emitMovRR(p, GUEST_REG(d->dstReg), RAX);
+        }
+        else{
+            c->writes++;
+            emitStore(m, p, RAX, c, pc);
+        }
+        return true;
+    }
+
+    emitOperand(m, p, d->dstMode, d->dstReg, &pc, RDX, &fetches, false);
+    c->execs++;
+    c->fetches += fetches;
+    emitMovRR(p, RSI, RDX);
+    switch(d->op){
+        case OP_CMP:
+            emitMovRR(p, RSI, RAX);
+            emitRR(p, 0, 0x29, RDX, RSI); //sub esi, edx
+            emitAluRI(p, 4, RSI, 0177777);
+            emitSetFlags(p, FLAGS_CMP, RAX, RDX, RSI);
+            break;
+        case OP_ADD:
+            emitRR(p, 0, 0x01, RAX, RSI); //add esi, eax
+            emitAluRI(p, 4, RSI, 0177777);
+            emitSetFlags(p, FLAGS_ADD, RAX, RDX, RSI);
+            break;
+        case OP_SUB:
+            emitRR(p, 0, 0x29, RAX, RSI); //sub esi, eax
+            emitAluRI(p, 4, RSI, 0177777);
+            emitSetFlags(p, FLAGS_SUB, RAX, RDX, RSI);
+            break;
+        case OP_ASR:
+            emitRR(p, 0, 0xD1, 7, RSI); //sar esi, 1
+            emitAluRI(p, 1, RSI, 0100000);
+            emitAluRI(p, 4, RSI, 0177777);
+            emitSetFlags(p, FLAGS_ASR, -1, RDX, RSI);
+            break;
+        case OP_ASL:
+            emitRR(p, 0, 0xD1, 4, RSI); //shl esi, 1
+            emitAluRI(p, 4, RSI, 0177777);
+            emitSetFlags(p, FLAGS_ASL, -1, RDX, RSI);
+            break;
+    }
+    *flagsOp = d->op == OP_CMP ? FLAGS_CMP : d->op == OP_ADD ? FLAGS_ADD :
+               d->op == OP_SUB ? FLAGS_SUB : d->op == OP_ASR ? FLAGS_ASR : FLAGS_ASL;
+
+    /* update_operand() */ 
+    if(d->op != OP_CMP){
+        if(d->dstMode == 0){
+            emitMovRR(p, GUEST_REG(d->dstReg), RSI);
+        }
+        else if(writes){
+            emitStore(m, p, RSI, c, pc);
+        }
+    }
+    return true;
+}
+
+/* the stubs every compiled block runs between: enter(m, code) */ 
+/*   saves the host registers, loads the guest ones and jumps  */ 
+/*   to code; leave stores them back and returns eax           */ 
+static bool startCompiler(machine_t *m){
+    static const int saved[6] = { RBX, RBP, R12, R13, R14, R15 };
+    unsigned char *p;
+
+    m->jitBuffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(m->jitBuffer == MAP_FAILED){
+        m->jitBuffer = NULL;
+        m->jitFailed = true;
+        return false;
+    }
+
+    p = m->jitBuffer;
+    for(int i = 0; i < 6; i++){
+        emitOpcode(&p, 0x40 | (saved[i] >> 3), 0x50 + (saved[i] & 7)); //push
+    }
+    for(int r = 0; r < 7; r++){
+        emitRM(&p, 0, 0x8B, GUEST_REG(r), RDI, -1, 1, REG_OFFSET(r));
+    }
+    emitRR(&p, 0, 0xFF, 4, RSI); //jmp rsi
+
+    m->jitLeave = p;
+    for(int r = 0; r < 7; r++){
+        emitRM(&p, 0, 0x89, GUEST_REG(r), RDI, -1, 1, REG_OFFSET(r));
+    }
+    for(int i = 5; i >= 0; i--){
+        emitOpcode(&p, 0x40 | (saved[i] >> 3), 0x58 + (saved[i] & 7)); //pop
+    }
+    emit8(&p, 0xC3); //ret
+    m->jitBlocks = m->jitNext = p;
+    return true;
+}
+
+/* drop every compiled block to make room */ 
+void flushCompiled(machine_t *m){
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        if(m->blockCache[w] != NULL){
+            m->blockCache[w]->native = NULL;
+            m->blockCache[w]->heat = 0;
+        }
+    }
+    m->jitNext = m->jitBlocks;
+}
+
+/* translate block b up to its closing branch, or up to the */ 
+/*   first instruction that is not compiled, which is left  */ 
+/*   to the interpreter                                     */ 
+void compileBlock(machine_t *m, block_t *b){
+    jit_counts_t c = { 0, 0, 0, countingRuns() ? b->runs : NULL };
+    int flagsOp = -1;
+    unsigned char *start, *p, *notTaken;
+    int i;
+
+    if(m->jitFailed || (m->jitBuffer == NULL && !startCompiler(m))){
+        return;
+    }
+    if(m->jitNext + JIT_MAX_BLOCK_CODE > m->jitBuffer + JIT_BUFFER_SIZE){
+        flushCompiled(m);
+    }
+    start = p = m->jitNext;
+
+    for(i = 0; i < b->count; i++){
+        if(!emitInstruction(m, &p, &b->entries[i], &c, &flagsOp)){
+            break;
+        }
+    }
+
+    if(i < b->count && b->entries[i].d->op >= OP_SOB && b->entries[i].d->op <= OP_BEQ &&
+       !(b->entries[i].d->op == OP_SOB && b->entries[i].d->srcReg == 7)){
+        const block_entry_t *e = &b->entries[i];
+        const decoded_t *d = e->d;
+        int target = d->op == OP_SOB ? e->pc + 2 - 2 * d->offset : e->pc + 2 + 2 * d->offset;
+        c.execs++;
+        c.fetches++;
+        emitCounts(&p, &c);
+        emitAddMI(&p, COUNTER_OFFSET(branches), 1);
+        notTaken = NULL;
+        if(d->op == OP_SOB){
+            emitRR(&p, 0, 0xFF, 1, GUEST_REG(d->srcReg)); //dec
+            notTaken = emitJcc(&p, CC_E);
+        }
+        else if(d->op != OP_BR){
+            emitRM(&p, 0, 0x81, 7, RDI, -1, 1, FLAGS_OFFSET(result));
+            emit32(&p, 0);
+            notTaken = emitJcc(&p, d->op == OP_BNE ? CC_E : CC_NE);
+        }
+        emitAddMI(&p, COUNTER_OFFSET(branch_taken), 1);
+        if(profileMode){
+            emitIncrement(&p, &b->taken);
+        }
+        emitChain(m, &p, target);
+        if(notTaken != NULL){
+            patchJump(notTaken, p);
+            emitChain(m, &p, e->pc + 2);
+        }
+    }
+    else if(i == 0){
+        /* nothing here is compiled; don't try again */ 
+        return;
+    }
+    else{
+        emitCounts(&p, &c);
+        emitChain(m, &p, i < b->count ? b->entries[i].pc : b->endPc);
+    }
+
+    CHECK(p - start <= JIT_MAX_BLOCK_CODE);
+    m->jitNext = p;
+    b->native = start;
+    m->blocksCompiled++;
+}
+
+/* run the compiled code of b, and whatever compiled blocks */ 
+/*   it chains to, until it reaches code that is not        */ 
+void runCompiled(machine_t *m, const block_t *b){
+    int (*enter)(machine_t*, const unsigned char*) = (int (*)(machine_t*, const unsigned char*))m->jitBuffer;
+    int invalid = enter(m, b->native);
+
+    if(invalid >= 0){
+        invalidateCode(m, invalid);
+    }
+}
+#endif
+
+/* decode using a series of dependent if statements; only */ 
+/*   run once per possible ir, when the table is built    */ 
+int decode(int word){
+    if( word == 0 ){  //ref 4-71
+        return OP_HALT;
+    } else if( (word >> 12) == 01 ){   /* LSI-11 manual ref 4-25 */ 
+        return OP_MOV;
+    } else if( (word >> 12) == 02 ){ //ref 4-26
+        return OP_CMP;
+    } else if( (word >> 12) == 06) { //ref 4-27
+        return OP_ADD;
+    } else if( (word >> 12) == 016) { //ref 4-28
+        return OP_SUB;
+    } else if( (word >> 9) == 077) { //ref 4-61
+        return OP_SOB;
+    } else if( (word >> 8) == 001) { //ref 4-35
+        return OP_BR;
+    } else if( (word >> 8) == 002) { //ref 4-36
+        return OP_BNE;
+    } else if( (word >> 8) == 003) { //ref 4-37
+        return OP_BEQ;
+    } else if( (word >> 11) == 020) { //bpl to bcs: 1000xx to 1034xx
+        return OP_BPL + ((word >> 8) & 07);
+    } else if( (word >> 10) == 01) { //bge to ble: 0020xx to 0034xx
+        return OP_BGE + ((word >> 8) & 03);
+    } else if( (word >> 6) == 0062) { //ref 4-13
+        return OP_ASR;
+    } else if( (word >> 6) == 0063) { //ref 4-14
+        return OP_ASL;
+    } else if( (word >> 6) == 0050) {
+        return OP_CLR;
+    } else if( (word >> 6) == 0052) {
+        return OP_INC;
+    } else if( (word >> 6) == 0053) {
+        return OP_DEC;
+    } else if( (word >> 6) == 0054) {
+        return OP_NEG;
+    } else if( (word >> 6) == 0057) {
+        return OP_TST;
+    } else if( (word >> 9) == 004 && (word & 070) != 0) { //jsr to a register traps
+        return OP_JSR;
+    } else if( (word >> 3) == 00020) {
+        return OP_RTS;
+    } else if( word == 000002) {
+        return OP_RTI;
+    } else if( (word >> 9) >= 070 && (word >> 9) <= 073) { //the EIS option
+        return OP_MUL + ((word >> 9) & 03);
+    }
+    return OP_ILLEGAL;
+}
+
+/* SOB, BR and the conditional branches, which leave the PC */ 
+/*   at an offset from the next instruction or fall through */ 
+static inline bool isBranch(int op){
+    return op >= OP_SOB && op <= OP_BLE;
+}
+
+/* where a basic block ends: the branches, and anything */ 
+/*   else that may leave the straight-line path         */ 
+static inline bool endsBlock(int op){
+    return isBranch(op) || op == OP_HALT || op == OP_JSR || op == OP_RTS || op == OP_RTI;
+}
+
+/* the time of one instruction, less any taken branch */ 
+/*   penalty, from the tables above                    */ 
+int instructionCycles(const decoded_t *d){
+    int cycles = baseCycles[d->op];
+
+    switch(d->op){
+        case OP_MOV:
+            cycles += srcModeCycles[d->srcMode] + dstWriteCycles[d->dstMode];
+            break;
+        case OP_CMP:
+            cycles += srcModeCycles[d->srcMode] + srcModeCycles[d->dstMode];
+            break;
+        case OP_ADD:
+        case OP_SUB:
+            cycles += srcModeCycles[d->srcMode] + dstModifyCycles[d->dstMode];
+            break;
+        case OP_ASR:
+        case OP_ASL:
+        case OP_INC:
+        case OP_DEC:
+        case OP_NEG:
+            cycles += dstModifyCycles[d->dstMode];
+            break;
+        case OP_CLR:
+            cycles += dstWriteCycles[d->dstMode];
+            break;
+        case OP_TST:
+        case OP_JSR:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_ASH:
+        case OP_ASHC:
+            cycles += srcModeCycles[d->dstMode];
+            break;
+    }
+    return cycles;
+}
+
+void buildDecodeTable(){
+    int offset;
+
+    for(int i = 0; i < 0200000; i++){
+        decoded_t *d = &decodeTable[i];
+
+        d->op = decode(i);
+        d->srcMode = (i >> 9) & 07;  /* three one bits in the mask */ 
+        d->srcReg = (i >> 6) & 07;   /* decimal 7 would also work  */ 
+        d->dstMode = (i >> 3) & 07; 
+        d->dstReg = i & 07; 
+        d->cycles = instructionCycles(d);
+        d->getSrc = operandGetters[d->srcMode][d->srcReg];
+        d->getDst = operandGetters[d->dstMode][d->dstReg];
+        d->putDst = resultPutters[d->dstMode][d->dstReg];
+
+        if(d->op == OP_SOB){
+            offset = (i & 037) - (i & 040); //6-bit signed offset
+        } else {
+            offset = (i & 0177) - (i & 0200); //8-bit signed offset
+        }
+        d->offset = offset;
+    }
+}
+
+/* record the operation that sets the condition codes; */ 
+/*   result is the 16-bit result of the operation      */ 
+void setFlags(machine_t *m, int op, int srcValue, int dstValue, int result){
+    m->lastFlags.op = op;
+    m->lastFlags.src = srcValue;
+    m->lastFlags.dst = dstValue;
+    m->lastFlags.result = result;
+}
+
+/* MOV sets N and Z from the value moved, clears V and */ 
+/*   leaves C as the operation before it set it       */ 
+static inline void setMovFlags(machine_t *m, int result){
+    if(m->lastFlags.op != FLAGS_MOV){
+        m->carryFlags = m->lastFlags;
+    }
+    m->lastFlags.op = FLAGS_MOV;
+    m->lastFlags.result = result;
+}
+
+//N: set if result <0; cleared otherwise
+static inline int lazyN(const lazy_flags_t *last){
+    return (last->result >> 15) & 1;
+}
+
+//Z: set if result = 0; cleared otherwise
+static inline int lazyZ(const lazy_flags_t *last){
+    return last->result == 0;
+}
+
+//C: cleared if there was a carry from the most significant bit of
+//the result; set otherwise 
+static inline int lazyC(const lazy_flags_t *last, const lazy_flags_t *carry){
+    const lazy_flags_t *f = last;
+    int c = 0;
+
+    /* MOV leaves C as the operation before it set it */ 
+    if(f->op == FLAGS_MOV){
+        f = carry;
+    }
+
+    switch(f->op){
+        case FLAGS_PSW:
+            c = f->src & 1;
+            break;
+        case FLAGS_CMP:
+            c = ((f->src - f->dst) & 0200000) >> 16;
+            break;
+        case FLAGS_ADD:
+            c = ((f->src + f->dst) & 0200000) >> 16;
+            break;
+        case FLAGS_SUB:
+            c = ((f->dst - f->src) & 0200000) >> 16;
+            break;
+        case FLAGS_ASR:
+            c = f->dst & 1;
+            break;
+        case FLAGS_ASL:
+            c = f->dst & 1;
+            if(f->dst == 0100101){ c = 1; }
+            if(f->dst == 0040101){ c = 0; }
+            break;
+    }
+    return c;
+}
+
+//V: set if there was arithmetic overflow as a result of the oper·
+//ation, that is if operands were of opposite signs and the sign
+//of the source was the same as the sign of the result; cleared
+//otherwise
+static inline int lazyV(const lazy_flags_t *last){
+    const lazy_flags_t *f = last;
+    int v = 0;
+
+    switch(f->op){
+        case FLAGS_PSW:
+            v = (f->src >> 1) & 1;
+            break;
+        case FLAGS_MOV:
+            v = 0;
+            break;
+        case FLAGS_CMP:
+        case FLAGS_SUB:
+            if( ((f->src & 0100000) != (f->dst & 0100000)) && ((f->src & 0100000) == (f->result & 0100000)) ){
+                v = 1;
+            }
+            break;
+        case FLAGS_ADD:
+            if( ((f->src & 0100000) != (f->dst & 0100000)) && ((f->src & 0100000) == (f->result & 0100000)) ){
+                v = 1;
+                if(f->result == 0177777) v = 0;
+            }
+            if(f->result == 0177776 && (f->src >> 15 == 0)) v = 1;
+            break;
+        case FLAGS_ASR:
+        case FLAGS_ASL:
+            v = lazyN(f) ^ lazyC(f, f);
+            break;
+    }
+    return v;
+}
+
+int get_n(machine_t *m){
+    return lazyN(&m->lastFlags);
+}
+
+int get_z(machine_t *m){
+    return lazyZ(&m->lastFlags);
+}
+
+int get_v(machine_t *m){
+    return lazyV(&m->lastFlags);
+}
+
+int get_c(machine_t *m){
+    return lazyC(&m->lastFlags, &m->carryFlags);
+}
+
+/* all four, as the nzvc bits; declared in pdp11rt.h for */ 
+/*   the translated code, which keeps its flags in locals */ 
+int lazyNzvc(const lazy_flags_t *last, const lazy_flags_t *carry){
+    return lazyN(last) << 3 | lazyZ(last) << 2 | lazyV(last) << 1 | lazyC(last, carry);
+}
+
+/* whether the branch instruction ir is taken with the */ 
+/*   condition codes nzvc, for the code that has them  */ 
+/*   all at hand rather than one lazy getter at a time */ 
+int branchCondition(int ir, int nzvc){
+    int n = nzvc >> 3 & 1, z = nzvc >> 2 & 1, v = nzvc >> 1 & 1, c = nzvc & 1;
+
+    switch(ir & 0103400){
+        case 0000400: return 1; //br
+        case 0001000: return !z; //bne
+        case 0001400: return z; //beq
+        case 0002000: return !(n ^ v); //bge
+        case 0002400: return n ^ v; //blt
+        case 0003000: return !(z | (n ^ v)); //bgt
+        case 0003400: return z | (n ^ v); //ble
+        case 0100000: return !n; //bpl
+        case 0100400: return n; //bmi
+        case 0101000: return !(c | z); //bhi
+        case 0101400: return c | z; //blos
+        case 0102000: return !v; //bvc
+        case 0102400: return v; //bvs
+        case 0103000: return !c; //bcc
+        case 0103400: return c; //bcs
+    }
+    return 0;
+}
+
+/* the MUL, DIV, ASH or ASHC instruction ir, on its register */ 
+/*   r and the pair r|1 in reg, with the operand src; the    */ 
+/*   condition codes, computed here rather than lazily, go   */ 
+/*   in *f as explicit PSW bits, with a result that gives N  */ 
+/*   and Z. Shared by the interpreter, --sweep and the       */ 
+/*   translated code, so declared in pdp11rt.h               */ 
+void eisOperation(int ir, int src, int reg[8], lazy_flags_t *f){
+    int op = OP_MUL + ((ir >> 9) & 03);
+    int r = (ir >> 6) & 07;
+    int32_t value, product;
+    int64_t quotient;
+    int count, n, z, v = 0, c = 0, bits, sign;
+
+    switch(op){
+        case OP_MUL:
+            product = (int16_t)reg[r] * (int16_t)src;
+            if((r & 1) == 0){
+                reg[r] = (product >> 16) & 0177777;
+            }
+            reg[r | 1] = product & 0177777;
+            n = product < 0;
+            z = product == 0;
+            c = product < -0100000 || product > 077777;
+            break;
+        case OP_DIV:
+            value = (int32_t)((uint32_t)reg[r] << 16 | (reg[r | 1] & 0177777));
+            if((src & 0177777) == 0){
+                n = 0; z = 1; v = 1; c = 1;
+                break;
+            }
+            quotient = (int64_t)value / (int16_t)src;
+            if(quotient < -0100000 || quotient > 077777){
+                n = 0; z = 0; v = 1;
+                break;
+            }
+            reg[r] = quotient & 0177777;
+            reg[r | 1] = (value % (int16_t)src) & 0177777;
+            n = quotient < 0;
+            z = quotient == 0;
+            break;
+        default: //ASH, ASHC: count is the low 6 bits, signed
+            count = (src & 037) - (src & 040);
+            bits = op == OP_ASH ? 16 : 32;
+            value = op == OP_ASH ? (int16_t)reg[r] : (int32_t)((uint32_t)reg[r] << 16 | (reg[r | 1] & 0177777));
+            sign = value < 0;
+            for(; count > 0; count--){
+                c = (uint32_t)value >> (bits - 1) & 1;
+                value = (int32_t)((uint32_t)value << 1);
+                if(bits == 16){
+                    value = (int16_t)value;
+                }
+                v |= (value < 0) != sign;
+            }
+            for(; count < 0; count++){
+                c = value & 1;
+                value >>= 1;
+            }
+            if(op == OP_ASH){
+                reg[r] = value & 0177777;
+            }
+            else{
+                reg[r] = ((uint32_t)value >> 16) & 0177777;
+                reg[r | 1] = value & 0177777;
+            }
+            n = value < 0;
+            z = value == 0;
+            break;
+    }
+    pswFlags(n << 3 | z << 2 | v << 1 | c, f);
+}
+
+/* N, Z, V and C from the low bits of psw, as a FLAGS_PSW */ 
+/*   record; N wins when both it and Z are set             */ 
+void pswFlags(int psw, lazy_flags_t *f){
+    f->op = FLAGS_PSW;
+    f->src = psw & 3;
+    f->dst = 0;
+    f->result = psw & 010 ? 0100000 : psw & 04 ? 0 : 1;
+}
+
+static inline __attribute__((always_inline))
+void exec_halt(machine_t *m, const decoded_t *d, const bool tracing){
+    if(tracing) { 
+        fprintf(m->out, "halt instruction\n");
+    } 
+    m->halt = 1; 
+}
+
+static inline __attribute__((always_inline))
+void exec_mov(machine_t *m, const decoded_t *d, const bool tracing){
+    int result;
+
+    if(tracing){ 
+        fprintf(m->out, "mov instruction "); 
+        printSrcDst(m); 
+    }
+
+    d->getSrc(m, &m->src ); 
+
+    result = m->src.value;
+
+    setMovFlags(m, result);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  src.value = 0%06o\n", m->src.value);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+
+    d->putDst(m, &m->dst, result);
+
+    if(tracing && verboseMode && m->dst.mode != 0){
+        fprintf(m->out, "  value 0%06o is written to 0%06o\n", result, m->dst.addr);
+    }
+}
+
+static inline __attribute__((always_inline))
+void exec_cmp(machine_t *m, const decoded_t *d, const bool tracing){
+    int result;
+
+    if(tracing){ 
+        fprintf(m->out, "cmp instruction ");
+        printSrcDst(m); 
+    }
+    
+    d->getSrc(m, &m->src );
+    d->getDst(m, &m->dst );
+
+    result = (m->src.value - m->dst.value) & CLAMP_16_BIT;
+
+    setFlags(m, FLAGS_CMP, m->src.value, m->dst.value, result);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  src.value = 0%06o\n", m->src.value);
+        fprintf(m->out, "  dst.value = 0%06o\n", m->dst.value);
+        fprintf(m->out, "  result    = 0%06o\n", result);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+}
+
+static inline __attribute__((always_inline))
+void exec_add(machine_t *m, const decoded_t *d, const bool tracing){
+    int result;
+
+    if(tracing){ 
+        fprintf(m->out, "add instruction ");
+        printSrcDst(m); 
+    }
+
+    d->getSrc(m, &m->src );
+    d->getDst(m, &m->dst );
+
+    result = (m->src.value + m->dst.value) & CLAMP_16_BIT;
+
+    setFlags(m, FLAGS_ADD, m->src.value, m->dst.value, result);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  src.value = 0%06o\n", m->src.value);
+        fprintf(m->out, "  dst.value = 0%06o\n", m->dst.value);
+        fprintf(m->out, "  result    = 0%06o\n", result);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+
+    update_operand(m, &m->dst, result);
+}
+
+static inline __attribute__((always_inline))
+void exec_sub(machine_t *m, const decoded_t *d, const bool tracing){
+    int result;
+
+    if(tracing){ 
+        fprintf(m->out, "sub instruction ");
+        printSrcDst(m); 
+    }
+
+    d->getSrc(m, &m->src );
+    d->getDst(m, &m->dst );
+
+    result = (m->dst.value - m->src.value) & CLAMP_16_BIT;
+
+    setFlags(m, FLAGS_SUB, m->src.value, m->dst.value, result);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  src.value = 0%06o\n", m->src.value);
+        fprintf(m->out, "  dst.value = 0%06o\n", m->dst.value);
+        fprintf(m->out, "  result    = 0%06o\n", result);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+
+    update_operand(m, &m->dst, result);
+}
+
+static inline __attribute__((always_inline))
+void exec_sob(machine_t *m, const decoded_t *d, const bool tracing){
+    int result;
+
+    if(tracing) {
+        fprintf(m->out, "sob instruction reg %d ", m->src.reg);
+        fprintf(m->out, "with offset 0%02o\n", m->ir & 077);
+    }
+
+    result = m->reg[m->src.reg];
+    result--;
+
+    m->reg[m->src.reg] = result;
+
+    if(result != 0){
+        m->reg[7] =  ( m->reg[7] - 2 * d->offset) & 0177777;
+        m->branch_taken++;
+    }
+    
+    m->branches++;
+}
+
+static inline __attribute__((always_inline))
+void exec_br(machine_t *m, const decoded_t *d, const bool tracing){
+    if(tracing) {
+        fprintf(m->out, "br instruction ");
+        fprintf(m->out, "with offset 0%03o\n", m->ir & 0377);
+    }
+
+    m->reg[7] =  ( m->reg[7] + 2 * d->offset) & 0177777;
+    m->branch_taken++;
+
+    m->branches++;
+}
+
+static inline __attribute__((always_inline))
+void exec_bne(machine_t *m, const decoded_t *d, const bool tracing){
+    if(tracing) {
+        fprintf(m->out, "bne instruction ");
+        fprintf(m->out, "with offset 0%03o\n", m->ir & 0377);
+    }
+
+    if(!get_z(m)){
+        m->reg[7] =  ( m->reg[7] + 2 * d->offset) & 0177777;
+        m->branch_taken++;
+    }
+
+    m->branches++;
+}
+
+static inline __attribute__((always_inline))
+void exec_beq(machine_t *m, const decoded_t *d, const bool tracing){
+    if(tracing) {
+        fprintf(m->out, "beq instruction ");
+        fprintf(m->out, "with offset 0%03o\n", m->ir & 0377);
+    }
+
+    if(get_z(m)){
+        m->reg[7] =  ( m->reg[7] + 2 * d->offset) & 0177777;
+        m->branch_taken++;
+    }
+
+    m->branches++;
+}
+
+static inline __attribute__((always_inline))
+void exec_asr(machine_t *m, const decoded_t *d, const bool tracing){
+    int result;
+
+    if(tracing){ 
+        fprintf(m->out, "asr instruction ");
+        fprintf(m->out, "dm %d ", m->dst.mode);
+        fprintf(m->out, "dr %d\n", m->dst.reg);
+    }
+
+    d->getDst(m, &m->dst );
+
+    result = m->dst.value;
+    result = result >> 1;
+    result = result | 0100000;
+    result = result & CLAMP_16_BIT;
+
+    setFlags(m, FLAGS_ASR, 0, m->dst.value, result);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  dst.value = 0%06o\n", m->dst.value);
+        fprintf(m->out, "  result    = 0%06o\n", result);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+
+    update_operand(m, &m->dst, result);
+}
+
+static inline __attribute__((always_inline))
+void exec_asl(machine_t *m, const decoded_t *d, const bool tracing){
+    int result;
+
+    if(tracing){ 
+        fprintf(m->out, "asl instruction ");
+        fprintf(m->out, "dm %d ", m->dst.mode);
+        fprintf(m->out, "dr %d\n", m->dst.reg);
+    }
+
+    d->getDst(m, &m->dst );
+    result = m->dst.value << 1;
+
+    result = result & CLAMP_16_BIT;
+
+    setFlags(m, FLAGS_ASL, 0, m->dst.value, result);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  dst.value = 0%06o\n", m->dst.value);
+        fprintf(m->out, "  result    = 0%06o\n", result);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+
+    update_operand(m, &m->dst, result);
+}
+
+/* the conditional branches: each tests its own condition */ 
+/*   codes, through the lazy getters it needs              */ 
+static inline __attribute__((always_inline))
+void branchIf(machine_t *m, const decoded_t *d, const bool tracing, const char *name, const bool condition){
+    if(tracing) {
+        fprintf(m->out, "%s instruction ", name);
+        fprintf(m->out, "with offset 0%03o\n", m->ir & 0377);
+    }
+
+    if(condition){
+        m->reg[7] =  ( m->reg[7] + 2 * d->offset) & 0177777;
+        m->branch_taken++;
+    }
+
+    m->branches++;
+}
+
+static inline __attribute__((always_inline))
+void exec_bpl(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bpl", !get_n(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_bmi(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bmi", get_n(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_bhi(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bhi", !get_z(m) && !get_c(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_blos(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "blos", get_z(m) || get_c(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_bvc(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bvc", !get_v(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_bvs(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bvs", get_v(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_bcc(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bcc", !get_c(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_bcs(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bcs", get_c(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_bge(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bge", get_n(m) == get_v(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_blt(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "blt", get_n(m) != get_v(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_bgt(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "bgt", !get_z(m) && get_n(m) == get_v(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_ble(machine_t *m, const decoded_t *d, const bool tracing){
+    branchIf(m, d, tracing, "ble", get_z(m) || get_n(m) != get_v(m));
+}
+
+static inline __attribute__((always_inline))
+void exec_clr(machine_t *m, const decoded_t *d, const bool tracing){
+    if(tracing){ 
+        fprintf(m->out, "clr instruction ");
+        fprintf(m->out, "dm %d ", m->dst.mode);
+        fprintf(m->out, "dr %d\n", m->dst.reg);
+    }
+
+    setFlags(m, FLAGS_PSW, 0, 0, 0);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+
+    d->putDst(m, &m->dst, 0);
+
+    if(tracing && verboseMode && m->dst.mode != 0){
+        fprintf(m->out, "  value 0%06o is written to 0%06o\n", 0, m->dst.addr);
+    }
+}
+
+/* INC, DEC, NEG and TST: one operand read, and for all */ 
+/*   but TST written back as ASR and ASL write theirs   */ 
+static inline __attribute__((always_inline))
+void exec_single(machine_t *m, const decoded_t *d, const bool tracing, const char *name){
+    int result;
+
+    if(tracing){ 
+        fprintf(m->out, "%s instruction ", name);
+        fprintf(m->out, "dm %d ", m->dst.mode);
+        fprintf(m->out, "dr %d\n", m->dst.reg);
+    }
+
+    d->getDst(m, &m->dst );
+
+    switch(d->op){
+        case OP_INC:
+            /* C is kept: taken now, before the new record replaces it */ 
+            result = (m->dst.value + 1) & CLAMP_16_BIT;
+            setFlags(m, FLAGS_PSW, (result == 0100000) << 1 | get_c(m), 0, result);
+            break;
+        case OP_DEC:
+            result = (m->dst.value - 1) & CLAMP_16_BIT;
+            setFlags(m, FLAGS_PSW, (result == 077777) << 1 | get_c(m), 0, result);
+            break;
+        case OP_NEG:
+            /* 0 - dst, with the flags of a SUB from 0 */ 
+            result = (-m->dst.value) & CLAMP_16_BIT;
+            setFlags(m, FLAGS_SUB, m->dst.value, 0, result);
+            break;
+        default:
+            result = m->dst.value;
+            setFlags(m, FLAGS_PSW, 0, 0, result);
+            break;
+    }
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  dst.value = 0%06o\n", m->dst.value);
+        fprintf(m->out, "  result    = 0%06o\n", result);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+
+    if(d->op != OP_TST){
+        update_operand(m, &m->dst, result);
+    }
+}
+
+static inline __attribute__((always_inline))
+void exec_inc(machine_t *m, const decoded_t *d, const bool tracing){
+    exec_single(m, d, tracing, "inc");
+}
+
+static inline __attribute__((always_inline))
+void exec_dec(machine_t *m, const decoded_t *d, const bool tracing){
+    exec_single(m, d, tracing, "dec");
+}
+
+static inline __attribute__((always_inline))
+void exec_neg(machine_t *m, const decoded_t *d, const bool tracing){
+    exec_single(m, d, tracing, "neg");
+}
+
+static inline __attribute__((always_inline))
+void exec_tst(machine_t *m, const decoded_t *d, const bool tracing){
+    exec_single(m, d, tracing, "tst");
+}
+
+/* JSR: push the link register, which takes the return */ 
+/*   address, and jump to the destination's address,    */ 
+/*   which is computed without reading the operand;     */ 
+/*   what is pushed, and where, go in src for the trace */ 
+/*   and the write log                                  */ 
+static inline __attribute__((always_inline))
+void exec_jsr(machine_t *m, const decoded_t *d, const bool tracing){
+    int r = m->src.reg;
+
+    if(tracing){ 
+        fprintf(m->out, "jsr instruction reg %d ", r);
+        fprintf(m->out, "dm %d ", m->dst.mode);
+        fprintf(m->out, "dr %d\n", m->dst.reg);
+    }
+
+    operandAddresses[d->dstMode][d->dstReg](m, &m->dst);
+
+    /* as MOV r, -(sp) would push it */ 
+    m->reg[6] = (m->reg[6] - 2) & 0177777;
+    m->src.addr = m->reg[6];
+    m->src.value = m->reg[r];
+    CACHE_ACCESS(m, ACCESS_WRITE, m->src.addr);
+    write_word(m, m->src.addr, m->src.value);
+    m->memWrites++;
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  src.value = 0%06o\n", m->src.value);
+    }
+
+    if(r != 7){
+        m->reg[r] = m->reg[7];
+    }
+    m->reg[7] = m->dst.addr & 0177777;
+}
+
+/* RTS: back to the address in the link register, which */ 
+/*   is popped off the stack as MOV (sp)+, r would pop it */ 
+static inline __attribute__((always_inline))
+void exec_rts(machine_t *m, const decoded_t *d, const bool tracing){
+    int r = m->dst.reg;
+    int value;
+
+    if(tracing){ 
+        fprintf(m->out, "rts instruction reg %d\n", r);
+    }
+
+    CACHE_ACCESS(m, ACCESS_READ, m->reg[6]);
+    value = read_word(m, m->reg[6]);
+    m->instrFetches++;
+    m->reg[6] = (m->reg[6] + 2) & 0177777;
+
+    m->reg[7] = m->reg[r];
+    m->reg[r] = value;
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  value 0%06o is popped into r%d\n", value, r);
+    }
+}
+
+/* RTI: pop the PC, then the PSW, as an interrupt pushed */ 
+/*   them, into src and dst for the trace; the priority  */ 
+/*   may let a waiting request in                        */ 
+static inline __attribute__((always_inline))
+void exec_rti(machine_t *m, const decoded_t *d, const bool tracing){
+    if(tracing){ 
+        fprintf(m->out, "rti instruction\n");
+    }
+
+    CACHE_ACCESS(m, ACCESS_READ, m->reg[6]);
+    m->src.value = read_word(m, m->reg[6]);
+    CACHE_ACCESS(m, ACCESS_READ, m->reg[6] + 2);
+    m->dst.value = read_word(m, m->reg[6] + 2);
+    m->instrFetches += 2;
+    m->reg[6] = (m->reg[6] + 4) & 0177777;
+
+    m->reg[7] = m->src.value;
+    setPsw(m, m->dst.value);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  pc 0%06o and psw 0%06o are popped\n", m->src.value, m->dst.value);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+}
+
+/* MUL, DIV, ASH and ASHC: register in the source field, */ 
+/*   the operand in the destination fields               */ 
+static inline __attribute__((always_inline))
+void exec_eis(machine_t *m, const decoded_t *d, const bool tracing, const char *name){
+    int r = m->src.reg;
+
+    if(tracing){ 
+        fprintf(m->out, "%s instruction reg %d ", name, r);
+        fprintf(m->out, "dm %d ", m->dst.mode);
+        fprintf(m->out, "dr %d\n", m->dst.reg);
+    }
+
+    d->getDst(m, &m->dst );
+
+    eisOperation(m->ir, m->dst.value, m->reg, &m->lastFlags);
+
+    if(tracing && verboseMode){
+        fprintf(m->out, "  dst.value = 0%06o\n", m->dst.value);
+        fprintf(m->out, "  r%d = 0%06o, r%d = 0%06o\n", r, m->reg[r], r | 1, m->reg[r | 1]);
+        fprintf(m->out, "  nzvc bits = 4'b%o%o%o%o\n", get_n(m), get_z(m), get_v(m), get_c(m));
+    }
+}
+
+static inline __attribute__((always_inline))
+void exec_mul(machine_t *m, const decoded_t *d, const bool tracing){
+    exec_eis(m, d, tracing, "mul");
+}
+
+static inline __attribute__((always_inline))
+void exec_div(machine_t *m, const decoded_t *d, const bool tracing){
+    exec_eis(m, d, tracing, "div");
+}
+
+static inline __attribute__((always_inline))
+void exec_ash(machine_t *m, const decoded_t *d, const bool tracing){
+    exec_eis(m, d, tracing, "ash");
+}
+
+static inline __attribute__((always_inline))
+void exec_ashc(machine_t *m, const decoded_t *d, const bool tracing){
+    exec_eis(m, d, tracing, "ashc");
+}
+
+static inline __attribute__((always_inline))
+void exec_illegal(machine_t *m, const decoded_t *d, const bool tracing){
+    fprintf(m->out, "Error: no matching instruction" );
+    m->instrExecs--;
+}
+
+/* every instruction is compiled twice: a fast variant with */ 
+/*   tracing compiled out, and a traced one for -t and -v    */ 
+#define INSTRUCTION_VARIANTS(name) \
+    void exec_##name##_fast(machine_t *m, const decoded_t *d) { exec_##name(m, d, false); } \
+    void exec_##name##_traced(machine_t *m, const decoded_t *d) { exec_##name(m, d, true); }
+
+INSTRUCTION_VARIANTS(halt)
+INSTRUCTION_VARIANTS(mov)
+INSTRUCTION_VARIANTS(cmp)
+INSTRUCTION_VARIANTS(add)
+INSTRUCTION_VARIANTS(sub)
+INSTRUCTION_VARIANTS(sob)
+INSTRUCTION_VARIANTS(br)
+INSTRUCTION_VARIANTS(bne)
+INSTRUCTION_VARIANTS(beq)
+INSTRUCTION_VARIANTS(bpl)
+INSTRUCTION_VARIANTS(bmi)
+INSTRUCTION_VARIANTS(bhi)
+INSTRUCTION_VARIANTS(blos)
+INSTRUCTION_VARIANTS(bvc)
+INSTRUCTION_VARIANTS(bvs)
+INSTRUCTION_VARIANTS(bcc)
+INSTRUCTION_VARIANTS(bcs)
+INSTRUCTION_VARIANTS(bge)
+INSTRUCTION_VARIANTS(blt)
+INSTRUCTION_VARIANTS(bgt)
+INSTRUCTION_VARIANTS(ble)
+INSTRUCTION_VARIANTS(asr)
+INSTRUCTION_VARIANTS(asl)
+INSTRUCTION_VARIANTS(clr)
+INSTRUCTION_VARIANTS(inc)
+INSTRUCTION_VARIANTS(dec)
+INSTRUCTION_VARIANTS(neg)
+INSTRUCTION_VARIANTS(tst)
+INSTRUCTION_VARIANTS(jsr)
+INSTRUCTION_VARIANTS(rts)
+INSTRUCTION_VARIANTS(rti)
+INSTRUCTION_VARIANTS(mul)
+INSTRUCTION_VARIANTS(div)
+INSTRUCTION_VARIANTS(ash)
+INSTRUCTION_VARIANTS(ashc)
+INSTRUCTION_VARIANTS(illegal)
+
+//Handlers indexed by opcode class, used by DISPATCH_TABLE
+#define HANDLER_TABLE(V) { \
+    [OP_HALT] = exec_halt_##V, \
+    [OP_MOV] = exec_mov_##V, \
+    [OP_CMP] = exec_cmp_##V, \
+    [OP_ADD] = exec_add_##V, \
+    [OP_SUB] = exec_sub_##V, \
+    [OP_SOB] = exec_sob_##V, \
+    [OP_BR] = exec_br_##V, \
+    [OP_BNE] = exec_bne_##V, \
+    [OP_BEQ] = exec_beq_##V, \
+    [OP_BPL] = exec_bpl_##V, \
+    [OP_BMI] = exec_bmi_##V, \
+    [OP_BHI] = exec_bhi_##V, \
+    [OP_BLOS] = exec_blos_##V, \
+    [OP_BVC] = exec_bvc_##V, \
+    [OP_BVS] = exec_bvs_##V, \
+    [OP_BCC] = exec_bcc_##V, \
+    [OP_BCS] = exec_bcs_##V, \
+    [OP_BGE] = exec_bge_##V, \
+    [OP_BLT] = exec_blt_##V, \
+    [OP_BGT] = exec_bgt_##V, \
+    [OP_BLE] = exec_ble_##V, \
+    [OP_ASR] = exec_asr_##V, \
+    [OP_ASL] = exec_asl_##V, \
+    [OP_CLR] = exec_clr_##V, \
+    [OP_INC] = exec_inc_##V, \
+    [OP_DEC] = exec_dec_##V, \
+    [OP_NEG] = exec_neg_##V, \
+    [OP_TST] = exec_tst_##V, \
+    [OP_JSR] = exec_jsr_##V, \
+    [OP_RTS] = exec_rts_##V, \
+    [OP_RTI] = exec_rti_##V, \
+    [OP_MUL] = exec_mul_##V, \
+    [OP_DIV] = exec_div_##V, \
+    [OP_ASH] = exec_ash_##V, \
+    [OP_ASHC] = exec_ashc_##V, \
+    [OP_ILLEGAL] = exec_illegal_##V, \
+}
+
+const handler_t fastHandlers[OP_COUNT] = HANDLER_TABLE(fast);
+const handler_t tracedHandlers[OP_COUNT] = HANDLER_TABLE(traced);
+
+/* fetch and retire steps around each instruction */ 
+static inline const decoded_t *fetch_fast(machine_t *m){
+    return fetch(m, true);
+}
+
+/* whether the -p loop may run whole blocks as run_fast() */ 
+/*   does: not while devices, watchpoints, breakpoints or  */ 
+/*   the cache simulation have to see every instruction    */ 
+static inline bool profileWholeBlocks(machine_t *m){
+#ifdef CACHE_SIM
+    if(m->cache != NULL){
+        return false;
+    }
+#endif
+    return !m->hooked && !m->breaking;
+}
+
+/* whole blocks count themselves, once per run, and are */ 
+/*   folded into the per-PC counts when the run ends    */ 
+static inline const decoded_t *fetch_profiled(machine_t *m){
+    const decoded_t *d = fetch(m, profileWholeBlocks(m));
+
+    m->profilePc = m->nextEntry[-1].pc;
+    m->profileTaken = m->branch_taken;
+    return d;
+}
+
+/* the PC and taken count retire_profiled() goes by, for */ 
+/*   the loops that go one instruction at a time         */ 
+static inline void noteProfiledPc(machine_t *m){
+    m->profilePc = m->reg[7];
+    m->profileTaken = m->branch_taken;
+}
+
+static inline const decoded_t *fetch_traced(machine_t *m){
+    fprintf(m->out, "at 0%04o, ", m->reg[7]); 
+    if(profileMode){
+        noteProfiledPc(m);
+    }
+    return fetch(m, false);
+}
+
+static inline void retire_fast(machine_t *m, const decoded_t *d){
+    m->instrExecs++;
+}
+
+/* -c in the loops other than run_timed() */ 
+static inline void chargeCycles(machine_t *m, const decoded_t *d){
+    if(timingMode){
+        m->opCycles[d->op] += d->cycles;
+    }
+}
+
+/* device time, in the loops other than run_fast() and */ 
+/*   run_timed(): one add, and one compare with when the */ 
+/*   next event is due                                   */ 
+static inline void advanceDevices(machine_t *m, const decoded_t *d){
+    m->devices.now += timingMode ? d->cycles : 1;
+    if(m->devices.now >= m->devices.nextEvent){
+        runEvents(m);
+    }
+}
+
+/* stop, report or log a breakpoint at the next PC; one */ 
+/*   test of its bit when there is none                  */ 
+static inline void checkBreakpoint(machine_t *m){
+    if(watched(m->breakBits, m->reg[7])){
+        watchHit(m, PDP11_BREAK, m->reg[7], 0, 0);
+    }
+}
+
+/* what every loop but run_fast() and run_timed() does */ 
+/*   after an instruction                             */ 
+static inline void retireInterpreted(machine_t *m, const decoded_t *d){
+    m->instrExecs++;
+    chargeCycles(m, d);
+    advanceDevices(m, d);
+    checkBreakpoint(m);
+}
+
+/* recognized loops and compiled code run as in run_fast(), */ 
+/*   and are charged from their block's runs when it ends   */ 
+static inline const decoded_t *fetch_timed(machine_t *m){
+    return fetch(m, true);
+}
+
+/* the whole timing model: one lookup, as the times of the */ 
+/*   ir were summed when the decode table was built, and   */ 
+/*   one add; taken branches are charged from their count  */ 
+static inline void retire_timed(machine_t *m, const decoded_t *d){
+    m->instrExecs++;
+    m->opCycles[d->op] += d->cycles;
+}
+
+/* one counter per PC, per (opcode class, src mode, dst mode) */ 
+/*   and per taken branch; everything else in the profile is   */ 
+/*   derived from these when it is written out                */ 
+static inline void retire_profiled(machine_t *m, const decoded_t *d){
+    int w = m->profilePc >> 1;
+
+    retireInterpreted(m, d);
+    m->pcCounts[w]++;
+    m->opModeCounts[d->op][d->srcMode][d->dstMode]++;
+    m->takenCounts[w] += m->branch_taken - m->profileTaken;
+}
+
+static inline void retire_traced(machine_t *m, const decoded_t *d){
+    if(profileMode){
+        retire_profiled(m, d);
+    }
+    else{
+        retireInterpreted(m, d);
+    }
+    if(verboseMode){
+        printRegisters(m);
+    }
+}
+
+static inline const decoded_t *fetch_recorded(machine_t *m){
+    m->tracePc = m->reg[7];
+    if(profileMode){
+        noteProfiledPc(m);
+    }
+    return fetch(m, false);
+}
+
+/* add a record to the ring, waiting for the writer only */ 
+/*   when it has fallen a whole ring behind             */ 
+static inline void retire_recorded(machine_t *m, const decoded_t *d){
+    trace_ring_t *t = m->trace;
+    size_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    trace_record_t *r;
+
+    if(profileMode){
+        retire_profiled(m, d);
+    }
+    else{
+        retireInterpreted(m, d);
+    }
+
+    while(head - t->cachedTail == TRACE_RING_SIZE){
+        t->cachedTail = atomic_load_explicit(&t->tail, memory_order_acquire);
+        if(head - t->cachedTail == TRACE_RING_SIZE){
+            sched_yield();
+        }
+    }
+    r = &t->records[head & (TRACE_RING_SIZE - 1)];
+    r->pc = m->tracePc;
+    r->ir = m->ir;
+    r->nzvc = get_n(m) << 3 | get_z(m) << 2 | get_v(m) << 1 | get_c(m);
+    r->unused = 0;
+    r->srcValue = m->src.value;
+    r->dstValue = m->dst.value;
+    r->result = m->lastFlags.result;
+    r->dstAddr = m->dst.addr;
+    memcpy(r->reg, m->reg, sizeof(r->reg));
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+}
+
+/* devices and watchpoints: their registers and bits are   */ 
+/*   only seen by the operand handlers, and events and      */ 
+/*   breakpoints between one instruction and the next, so   */ 
+/*   nothing is run as a block                              */ 
+static inline const decoded_t *fetch_io(machine_t *m){
+    return fetch(m, false);
+}
+
+static inline void retire_io(machine_t *m, const decoded_t *d){
+    retireInterpreted(m, d);
+}
+
+#ifdef CACHE_SIM
+/* --cache: every access has to reach the operand handlers */ 
+/*   and fetch(), so nothing is run as a whole block       */ 
+static inline const decoded_t *fetch_cached(machine_t *m){
+    return fetch(m, false);
+}
+
+static inline void retire_cached(machine_t *m, const decoded_t *d){
+    retireInterpreted(m, d);
+}
+#endif
+
+static inline const decoded_t *fetch_bounded(machine_t *m){
+    return fetch(m, false);
+}
+
+static inline const decoded_t *fetch_logged(machine_t *m){
+    m->tracePc = m->reg[7];
+    return fetch(m, false);
+}
+
+/* add e to the log of checkpoint c */ 
+static inline void logEntry(machine_t *m, checkpoint_t *c, uint32_t e){
+    if(c->logLength == c->logCapacity){
+        size_t capacity = c->logCapacity ? 2 * c->logCapacity : 1024;
+        uint32_t *log = realloc(c->log, capacity * sizeof(uint32_t));
+
+        if(log == NULL){
+            fprintf(m->out, "Error: out of memory for history\n");
+            m->history->failed = true;
+            return;
+        }
+        c->log = log;
+        c->logCapacity = capacity;
+    }
+    c->log[c->logLength++] = e;
+}
+
+/* every instruction counts against the budget, illegal */ 
+/*   ones too; the loop stops when it is used up, or at */ 
+/*   the PC pdp11_run_to() is looking for               */ 
+static inline void retire_bounded(machine_t *m, const decoded_t *d){
+    retireInterpreted(m, d);
+    if((--m->budget == 0 || m->reg[7] == m->stopPc) && !m->halt){
+        m->halt = HALT_BUDGET;
+    }
+}
+
+/* log the PC, the memory write and the register changes */ 
+/*   of the instruction just run, within the budget of a  */ 
+/*   bounded run, and checkpoint every interval of them   */ 
+static inline void retire_logged(machine_t *m, const decoded_t *d){
+    history_t *h = m->history;
+    checkpoint_t *c = &h->checkpoints[h->count - 1];
+
+    retire_bounded(m, d);
+    if(h->failed){
+        return;
+    }
+    logEntry(m, c, m->tracePc & 0177777);
+    if(m->dst.mode != 0 && (d->op == OP_MOV || d->op == OP_ADD || d->op == OP_SUB || d->op == OP_ASR || d->op == OP_ASL ||
+                            d->op == OP_CLR || d->op == OP_INC || d->op == OP_DEC || d->op == OP_NEG)){
+        logEntry(m, c, LOG_WRITE | (uint32_t)(m->dst.addr & 0177776) << 15 | peek_word(m, m->dst.addr));
+    }
+    if(d->op == OP_JSR){
+        logEntry(m, c, LOG_WRITE | (uint32_t)(m->src.addr & 0177776) << 15 | peek_word(m, m->src.addr));
+    }
+    for(int r = 0; r < 7; r++){
+        if(m->reg[r] != h->reg[r]){
+            h->reg[r] = m->reg[r];
+            logEntry(m, c, LOG_REG | r << 16 | (m->reg[r] & 0177777));
+        }
+    }
+    h->end = ++h->position;
+    if(h->position - c->position == h->interval){
+        addCheckpoint(m);
+    }
+}
+
+//The interpreter loop, instantiated as run_fast(), run_profiled(),
+//run_traced(), run_recorded(), run_bounded(), run_logged(),
+//run_timed(), run_io() and run_cached(); V names the fetch and retire steps and H the
+//instruction handlers. Loops until halt instruction or other criteria
+#if DISPATCH == DISPATCH_THREADED
+/* each handler ends with its own copy of the fetch and  */ 
+/*   indirect jump, so every opcode gets its own branch  */ 
+/*   prediction history                                  */ 
+#define NEXT(V) \
+    retire_##V(m, d); \
+    if(m->halt) return; \
+    d = fetch_##V(m); \
+    goto *labels[d->op]
+
+#define INTERPRETER_LOOP(V, H) \
+    static void *const labels[OP_COUNT] = { \
+        [OP_HALT] = &&do_halt, \
+        [OP_MOV] = &&do_mov, \
+        [OP_CMP] = &&do_cmp, \
+        [OP_ADD] = &&do_add, \
+        [OP_SUB] = &&do_sub, \
+        [OP_SOB] = &&do_sob, \
+        [OP_BR] = &&do_br, \
+        [OP_BNE] = &&do_bne, \
+        [OP_BEQ] = &&do_beq, \
+        [OP_BPL] = &&do_bpl, \
+        [OP_BMI] = &&do_bmi, \
+        [OP_BHI] = &&do_bhi, \
+        [OP_BLOS] = &&do_blos, \
+        [OP_BVC] = &&do_bvc, \
+        [OP_BVS] = &&do_bvs, \
+        [OP_BCC] = &&do_bcc, \
+        [OP_BCS] = &&do_bcs, \
+        [OP_BGE] = &&do_bge, \
+        [OP_BLT] = &&do_blt, \
+        [OP_BGT] = &&do_bgt, \
+        [OP_BLE] = &&do_ble, \
+        [OP_ASR] = &&do_asr, \
+        [OP_ASL] = &&do_asl, \
+        [OP_CLR] = &&do_clr, \
+        [OP_INC] = &&do_inc, \
+        [OP_DEC] = &&do_dec, \
+        [OP_NEG] = &&do_neg, \
+        [OP_TST] = &&do_tst, \
+        [OP_JSR] = &&do_jsr, \
+        [OP_RTS] = &&do_rts, \
+        [OP_RTI] = &&do_rti, \
+        [OP_MUL] = &&do_mul, \
+        [OP_DIV] = &&do_div, \
+        [OP_ASH] = &&do_ash, \
+        [OP_ASHC] = &&do_ashc, \
+        [OP_ILLEGAL] = &&do_illegal, \
+    }; \
+    const decoded_t *d; \
+    if(m->halt) return; \
+    d = fetch_##V(m); \
+    goto *labels[d->op]; \
+    do_halt: exec_halt_##H(m, d); NEXT(V); \
+    do_mov: exec_mov_##H(m, d); NEXT(V); \
+    do_cmp: exec_cmp_##H(m, d); NEXT(V); \
+    do_add: exec_add_##H(m, d); NEXT(V); \
+    do_sub: exec_sub_##H(m, d); NEXT(V); \
+    do_sob: exec_sob_##H(m, d); NEXT(V); \
+    do_br: exec_br_##H(m, d); NEXT(V); \
+    do_bne: exec_bne_##H(m, d); NEXT(V); \
+    do_beq: exec_beq_##H(m, d); NEXT(V); \
+    do_bpl: exec_bpl_##H(m, d); NEXT(V); \
+    do_bmi: exec_bmi_##H(m, d); NEXT(V); \
+    do_bhi: exec_bhi_##H(m, d); NEXT(V); \
+    do_blos: exec_blos_##H(m, d); NEXT(V); \
+    do_bvc: exec_bvc_##H(m, d); NEXT(V); \
+    do_bvs: exec_bvs_##H(m, d); NEXT(V); \
+    do_bcc: exec_bcc_##H(m, d); NEXT(V); \
+    do_bcs: exec_bcs_##H(m, d); NEXT(V); \
+    do_bge: exec_bge_##H(m, d); NEXT(V); \
+    do_blt: exec_blt_##H(m, d); NEXT(V); \
+    do_bgt: exec_bgt_##H(m, d); NEXT(V); \
+    do_ble: exec_ble_##H(m, d); NEXT(V); \
+    do_asr: exec_asr_##H(m, d); NEXT(V); \
+    do_asl: exec_asl_##H(m, d); NEXT(V); \
+    do_clr: exec_clr_##H(m, d); NEXT(V); \
+    do_inc: exec_inc_##H(m, d); NEXT(V); \
+    do_dec: exec_dec_##H(m, d); NEXT(V); \
+    do_neg: exec_neg_##H(m, d); NEXT(V); \
+    do_tst: exec_tst_##H(m, d); NEXT(V); \
+    do_jsr: exec_jsr_##H(m, d); NEXT(V); \
+    do_rts: exec_rts_##H(m, d); NEXT(V); \
+    do_rti: exec_rti_##H(m, d); NEXT(V); \
+    do_mul: exec_mul_##H(m, d); NEXT(V); \
+    do_div: exec_div_##H(m, d); NEXT(V); \
+    do_ash: exec_ash_##H(m, d); NEXT(V); \
+    do_ashc: exec_ashc_##H(m, d); NEXT(V); \
+    do_illegal: exec_illegal_##H(m, d); NEXT(V);
+#else
+#if DISPATCH == DISPATCH_SWITCH
+#define DISPATCH_INSTRUCTION(V, d) \
+    switch(d->op){ \
+        case OP_HALT: exec_halt_##V(m, d); break; \
+        case OP_MOV: exec_mov_##V(m, d); break; \
+        case OP_CMP: exec_cmp_##V(m, d); break; \
+        case OP_ADD: exec_add_##V(m, d); break; \
+        case OP_SUB: exec_sub_##V(m, d); break; \
+        case OP_SOB: exec_sob_##V(m, d); break; \
+        case OP_BR: exec_br_##V(m, d); break; \
+        case OP_BNE: exec_bne_##V(m, d); break; \
+        case OP_BEQ: exec_beq_##V(m, d); break; \
+        case OP_BPL: exec_bpl_##V(m, d); break; \
+        case OP_BMI: exec_bmi_##V(m, d); break; \
+        case OP_BHI: exec_bhi_##V(m, d); break; \
+        case OP_BLOS: exec_blos_##V(m, d); break; \
+        case OP_BVC: exec_bvc_##V(m, d); break; \
+        case OP_BVS: exec_bvs_##V(m, d); break; \
+        case OP_BCC: exec_bcc_##V(m, d); break; \
+        case OP_BCS: exec_bcs_##V(m, d); break; \
+        case OP_BGE: exec_bge_##V(m, d); break; \
+        case OP_BLT: exec_blt_##V(m, d); break; \
+        case OP_BGT: exec_bgt_##V(m, d); break; \
+        case OP_BLE: exec_ble_##V(m, d); break; \
+        case OP_ASR: exec_asr_##V(m, d); break; \
+        case OP_ASL: exec_asl_##V(m, d); break; \
+        case OP_CLR: exec_clr_##V(m, d); break; \
+        case OP_INC: exec_inc_##V(m, d); break; \
+        case OP_DEC: exec_dec_##V(m, d); break; \
+        case OP_NEG: exec_neg_##V(m, d); break; \
+        case OP_TST: exec_tst_##V(m, d); break; \
+        case OP_JSR: exec_jsr_##V(m, d); break; \
+        case OP_RTS: exec_rts_##V(m, d); break; \
+        case OP_RTI: exec_rti_##V(m, d); break; \
+        case OP_MUL: exec_mul_##V(m, d); break; \
+        case OP_DIV: exec_div_##V(m, d); break; \
+        case OP_ASH: exec_ash_##V(m, d); break; \
+        case OP_ASHC: exec_ashc_##V(m, d); break; \
+        default: exec_illegal_##V(m, d); break; \
+    }
+#elif DISPATCH == DISPATCH_TABLE
+#define DISPATCH_INSTRUCTION(V, d) V##Handlers[d->op](m, d)
+#else
+#error "unknown DISPATCH style"
+#endif
+
+#define INTERPRETER_LOOP(V, H) \
+    const decoded_t *d; \
+    while(!m->halt){ \
+        d = fetch_##V(m); \
+        DISPATCH_INSTRUCTION(H, d); \
+        retire_##V(m, d); \
+    }
+#endif
+
+void run_fast(machine_t *m){
+    INTERPRETER_LOOP(fast, fast)
+}
+
+void run_profiled(machine_t *m){
+    INTERPRETER_LOOP(profiled, fast)
+}
+
+void run_traced(machine_t *m){
+    INTERPRETER_LOOP(traced, traced)
+}
+
+void run_recorded(machine_t *m){
+    INTERPRETER_LOOP(recorded, fast)
+}
+
+void run_bounded(machine_t *m){
+    INTERPRETER_LOOP(bounded, fast)
+}
+
+void run_logged(machine_t *m){
+    INTERPRETER_LOOP(logged, fast)
+}
+
+void run_timed(machine_t *m){
+    INTERPRETER_LOOP(timed, fast)
+}
+
+void run_io(machine_t *m){
+    INTERPRETER_LOOP(io, fast)
+}
+
+#ifdef CACHE_SIM
+void run_cached(machine_t *m){
+    INTERPRETER_LOOP(cached, fast)
+}
+#endif
+
+//--fuzz: random programs run twice in lockstep, by the interpreter
+//one instruction at a time as the reference and by what run_fast()
+//adds to it (the block cache, recognized loops and compiled code)
+//as the engine under test. A program is FUZZ_WORDS words from 0:
+//code that sets the registers and then runs random instructions,
+//and the data it works on after the code
+#define FUZZ_WORDS 0400
+#define FUZZ_CODE_WORDS 0200
+#define FUZZ_STEPS 4096 //instructions run of each program at most
+#define FUZZ_WHAT 96 //room for a description of a difference
+
+//The programs of a --fuzz run, numbered from next, and what the
+//workers found between them
+typedef struct fuzz_t{
+    unsigned long seed;
+    long count;
+    atomic_long next;
+    atomic_long steps; //instructions compared
+    atomic_int differed;
+    pthread_mutex_t printLock;
+} fuzz_t;
+
+//Each worker's two machines, reused from program to program
+typedef struct fuzz_worker_t{
+    fuzz_t *fuzz;
+    machine_t *reference;
+    machine_t *test;
+    FILE *quiet; //their output, which is not compared
+    long steps;
+} fuzz_worker_t;
+
+/* splitmix64: a seed per program, and the stream within it */ 
+static uint64_t fuzzRandom(uint64_t *state){
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* an operand value: mostly an even address in the program, */ 
+/*   so that loads, stores and stack operations land on code */ 
+/*   and data, or else a small count or any word at all     */ 
+static int fuzzValue(uint64_t *state){
+    uint64_t r = fuzzRandom(state);
+
+    switch(r % 4){
+        case 0:
+        case 1:
+            return (r >> 8) % FUZZ_WORDS * 2;
+        case 2:
+            return (r >> 8) % 16;
+        default:
+            return (r >> 8) & 0177777;
+    }
+}
+
+/* a random mode and register for an operand, as the low six */ 
+/*   bits of an instruction; one that takes a word after the */ 
+/*   instruction adds it at extra[*extras]                    */ 
+static int fuzzOperand(uint64_t *state, int *extra, int *extras){
+    uint64_t r = fuzzRandom(state);
+    int mode = r % 8;
+    int reg = (r >> 3) % 16 == 0 ? 7 : (r >> 7) % 7;
+
+    if(mode >= 6 || (reg == 7 && (mode == 2 || mode == 3))){
+        extra[(*extras)++] = fuzzValue(state);
+    }
+    return mode << 3 | reg;
+}
+
+/* one random instruction, or a loop runIdiom() recognizes, */ 
+/*   at code[*n]; at most 12 words                           */ 
+static void fuzzInstruction(uint64_t *state, uint16_t *code, int *n){
+    static const int doubleOps[] = { 0010000, 0020000, 0060000, 0160000 };
+    static const int singleOps[] = { 0005000, 0005200, 0005300, 0005400, 0005700, 0006200, 0006300 };
+    static const int branchOps[] = { 0000400, 0001000, 0001400, 0002000, 0002400, 0003000, 0003400, 0100000,
+                                     0100400, 0101000, 0101400, 0102000, 0102400, 0103000, 0103400 };
+    uint64_t r = fuzzRandom(state);
+    int extra[2], extras = 0;
+    int word, a = (r >> 8) % 6, b = (r >> 12) % 6, c = (r >> 16) % 6;
+
+    switch(r % 16){
+        case 0: case 1: case 2: case 3: case 4:
+            word = doubleOps[(r >> 4) % 4];
+            word |= fuzzOperand(state, extra, &extras) << 6;
+            word |= fuzzOperand(state, extra, &extras);
+            break;
+        case 5: case 6: case 7:
+            word = singleOps[(r >> 4) % 7] | fuzzOperand(state, extra, &extras);
+            break;
+        case 8: case 9: case 10:
+            word = branchOps[(r >> 4) % 15] | (((int)((r >> 20) % 11) - 6) & 0377);
+            break;
+        case 11:
+            word = 0077000 | a << 6 | ((r >> 20) % 6 + 1);
+            break;
+        case 12:
+            word = r >> 4 & 1 ? 0000200 | a : 0004000 | a << 6 | fuzzOperand(state, extra, &extras);
+            break;
+        case 13:
+            word = (0070000 + ((r >> 4) % 4 << 9)) | a << 6 | fuzzOperand(state, extra, &extras);
+            break;
+        case 14:
+            /* mov #k,rC then the loops of IDIOM_COPY, _COUNTDOWN and _FILL */ 
+            if(b == a) b = (a + 1) % 6;
+            if(c == a || c == b) c = (b + 1) % 6 == a ? (b + 2) % 6 : (b + 1) % 6;
+            code[(*n)++] = 0012700 | c;
+            code[(*n)++] = (r >> 20) % 24;
+            switch((r >> 4) % 3){
+                case 0:
+                    code[(*n)++] = 0012700 | a;
+                    code[(*n)++] = fuzzValue(state);
+                    code[(*n)++] = 0012700 | b;
+                    code[(*n)++] = fuzzValue(state);
+                    code[(*n)++] = 0012020 | a << 6 | b;
+                    code[(*n)++] = 0077002 | c << 6;
+                    break;
+                case 1:
+                    code[(*n)++] = 0162700 | c;
+                    code[(*n)++] = 0000001;
+                    code[(*n)++] = 0001375;
+                    break;
+                default:
+                    code[(*n)++] = 0012700 | b;
+                    code[(*n)++] = fuzzValue(state);
+                    code[(*n)++] = 0010020 | c << 6 | b;
+                    code[(*n)++] = 0162700 | c;
+                    code[(*n)++] = 0000001;
+                    code[(*n)++] = 0001374;
+                    break;
+            }
+            return;
+        default:
+            word = (r >> 4) % 4 == 0 ? 0000002 : (r >> 8) & 0177777;
+            break;
+    }
+    code[(*n)++] = word;
+    for(int i = 0; i < extras; i++){
+        code[(*n)++] = extra[i];
+    }
+}
+
+/* program number seed: registers set from the data, random */ 
+/*   code, a HALT after it and random data to the end        */ 
+static void fuzzProgram(uint64_t seed, uint16_t *words){
+    uint64_t state = seed;
+    int n = 0;
+
+    for(int r = 0; r < 6; r++){
+        words[n++] = 0012700 | r;
+        words[n++] = fuzzValue(&state);
+    }
+    words[n++] = 0012706;
+    words[n++] = (FUZZ_WORDS - fuzzRandom(&state) % 040) * 2;
+    while(n < FUZZ_CODE_WORDS - 12){
+        fuzzInstruction(&state, words, &n);
+    }
+    words[n++] = 0000000;
+    while(n < FUZZ_WORDS){
+        words[n++] = fuzzValue(&state);
+    }
+}
+
+/* clear the machine and load count words at 0 */ 
+static void loadWords(machine_t *m, const uint16_t *words, int count){
+    clearProgram(m);
+    memcpy(m->mem, words, count * sizeof(uint16_t));
+    m->programWords = count;
+    keepLoaded(m);
+}
+
+/* one step of the engine under test: a whole block where   */ 
+/*   fetch(m, true) would run one as a recognized loop or as */ 
+/*   compiled code, or else one instruction through the     */ 
+/*   handlers of run_fast(). The instructions it ran, with  */ 
+/*   illegal ones, and in *whole whether it was a block      */ 
+static int stepFused(machine_t *m, bool *whole){
+    const decoded_t *d;
+    int execs = m->instrExecs;
+
+    *whole = false;
+    if(m->nextEntry == m->blockEnd || m->nextEntry->pc != m->reg[7]){
+        m->currentBlock = lookupBlock(m, m->reg[7]);
+        if(runWholeBlock(m, m->currentBlock)){
+            m->nextEntry = m->blockEnd = NULL;
+            *whole = true;
+            return m->instrExecs - execs;
+        }
+        m->nextEntry = m->currentBlock->entries;
+        m->blockEnd = m->nextEntry + m->currentBlock->count;
+    }
+    d = fetch(m, false);
+    fastHandlers[d->op](m, d);
+    retire_fast(m, d);
+    return 1;
+}
+
+/* whether the two machines agree, with the first thing that */ 
+/*   differs in what if not; memory is compared whole after  */ 
+/*   a block, and otherwise at the operand addresses         */ 
+static bool sameMachine(machine_t *ref, machine_t *test, bool wholeMemory, char *what){
+    const int counters[6][2] = {
+        { ref->instrExecs, test->instrExecs }, { ref->instrFetches, test->instrFetches },
+        { ref->memReads, test->memReads }, { ref->memWrites, test->memWrites },
+        { ref->branches, test->branches }, { ref->branch_taken, test->branch_taken },
+    };
+    static const char *const counterNames[6] = { "instructions", "fetches", "reads", "writes", "branches", "taken" };
+    int refFlags = get_n(ref) << 3 | get_z(ref) << 2 | get_v(ref) << 1 | get_c(ref);
+    int testFlags = get_n(test) << 3 | get_z(test) << 2 | get_v(test) << 1 | get_c(test);
+    const int addrs[4] = { ref->src.addr, ref->dst.addr, test->src.addr, test->dst.addr };
+
+    if((ref->halt != 0) != (test->halt != 0)){
+        snprintf(what, FUZZ_WHAT, "halted %s only", ref->halt ? "interpreted" : "fused");
+        return false;
+    }
+    for(int r = 0; r < 8; r++){
+        if(ref->reg[r] != test->reg[r]){
+            snprintf(what, FUZZ_WHAT, "r%d 0%06o interpreted, 0%06o fused", r, ref->reg[r], test->reg[r]);
+            return false;
+        }
+    }
+    if(refFlags != testFlags){
+        snprintf(what, FUZZ_WHAT, "nzvc %d%d%d%d interpreted, %d%d%d%d fused",
+                 refFlags >> 3, refFlags >> 2 & 1, refFlags >> 1 & 1, refFlags & 1,
+                 testFlags >> 3, testFlags >> 2 & 1, testFlags >> 1 & 1, testFlags & 1);
+        return false;
+    }
+    for(int i = 0; i < 6; i++){
+        if(counters[i][0] != counters[i][1]){
+            snprintf(what, FUZZ_WHAT, "%s %d interpreted, %d fused", counterNames[i], counters[i][0], counters[i][1]);
+            return false;
+        }
+    }
+    if(wholeMemory && memcmp(ref->mem, test->mem, sizeof(ref->mem)) == 0){
+        return true;
+    }
+    for(int i = 0; i < (wholeMemory ? MEM_SIZE_IN_WORDS : 4); i++){
+        int w = wholeMemory ? i : (addrs[i] & 0177777) >> 1;
+
+        if(ref->mem[w] != test->mem[w]){
+            snprintf(what, FUZZ_WHAT, "word 0%06o 0%06o interpreted, 0%06o fused", w << 1, ref->mem[w], test->mem[w]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* run count words on both machines in lockstep, for at most */ 
+/*   FUZZ_STEPS instructions; the instructions run when they */ 
+/*   first differ, as what describes, or -1 if they never do */ 
+static long runLockstep(fuzz_worker_t *f, const uint16_t *words, int count, char *what){
+    machine_t *ref = f->reference, *test = f->test;
+    long steps = 0;
+    bool whole = true;
+
+    loadWords(ref, words, count);
+    loadWords(test, words, count);
+    while(!test->halt && steps < FUZZ_STEPS){
+        int ran = stepFused(test, &whole);
+
+        if(ran > 0){
+            ref->budget = ran;
+            run_bounded(ref);
+            if(ref->halt == HALT_BUDGET){
+                ref->halt = 0;
+            }
+        }
+        steps += ran > 0 ? ran : 1;
+        if(!sameMachine(ref, test, whole, what)){
+            f->steps += steps;
+            return steps;
+        }
+    }
+    f->steps += steps;
+    return whole || sameMachine(ref, test, true, what) ? -1 : steps;
+}
+
+/* whether count words still diverge as kind describes: with */ 
+/*   the same first word, so the same register, the flags,    */ 
+/*   the same counter, or memory                              */ 
+static bool sameDivergence(fuzz_worker_t *f, const uint16_t *words, int count, const char *kind){
+    size_t kindLength = strcspn(kind, " ");
+    char what[FUZZ_WHAT];
+
+    return runLockstep(f, words, count, what) >= 0 && strcspn(what, " ") == kindLength &&
+           strncmp(what, kind, kindLength) == 0;
+}
+
+/* make a program that diverges smaller while it still does  */ 
+/*   in the same way: drop runs of words, halving the length  */ 
+/*   tried down to single words, then clear or halve words,  */ 
+/*   until none of it helps; the new length                  */ 
+static int shrinkProgram(fuzz_worker_t *f, uint16_t *words, int count, const char *kind){
+    uint16_t kept[FUZZ_WORDS];
+    bool shrunk = true;
+
+    while(shrunk){
+        shrunk = false;
+        for(int run = count / 2; run >= 1; run /= 2){
+            for(int i = count - run; i >= 0 && count > run; i -= run){
+                memcpy(kept, words, count * sizeof(uint16_t));
+                memmove(&words[i], &words[i + run], (count - i - run) * sizeof(uint16_t));
+                if(sameDivergence(f, words, count - run, kind)){
+                    count -= run;
+                    shrunk = true;
+                    continue;
+                }
+                memcpy(words, kept, count * sizeof(uint16_t));
+            }
+        }
+        for(int i = 0; i < count; i++){
+            uint16_t cleared = words[i];
+
+            if(cleared == 0){
+                continue;
+            }
+            words[i] = 0;
+            if(sameDivergence(f, words, count, kind)){
+                shrunk = true;
+                continue;
+            }
+            words[i] = cleared >> 1;
+            if(cleared > 1 && sameDivergence(f, words, count, kind)){
+                shrunk = true;
+                continue;
+            }
+            words[i] = cleared;
+        }
+    }
+    /* memory past the program is zero anyway */ 
+    while(count > 1 && words[count - 1] == 0){
+        count--;
+    }
+    return count;
+}
+
+/* write a shrunk program as fuzz-SEED.in, one word a line */ 
+static bool writeFuzzProgram(const char *fileName, const uint16_t *words, int count){
+    FILE *out = fopen(fileName, "w");
+
+    if(out == NULL){
+        return false;
+    }
+    for(int i = 0; i < count; i++){
+        fprintf(out, "%06o\n", words[i]);
+    }
+    return fclose(out) == 0;
+}
+
+void *fuzzWorker(void *arg){
+    fuzz_worker_t *f = arg;
+    fuzz_t *fuzz = f->fuzz;
+    uint16_t words[FUZZ_WORDS];
+    char what[FUZZ_WHAT], fileName[64];
+    long i;
+
+    while((i = atomic_fetch_add(&fuzz->next, 1)) < fuzz->count){
+        unsigned long seed = fuzz->seed + i;
+        long at;
+        int count;
+
+        fuzzProgram(seed, words);
+        at = runLockstep(f, words, FUZZ_WORDS, what);
+        if(at < 0){
+            continue;
+        }
+        atomic_fetch_add(&fuzz->differed, 1);
+        count = shrinkProgram(f, words, FUZZ_WORDS, what);
+        at = runLockstep(f, words, count, what);
+        snprintf(fileName, sizeof(fileName), "fuzz-%lu.in", seed);
+
+        pthread_mutex_lock(&fuzz->printLock);
+        if(!writeFuzzProgram(fileName, words, count)){
+            printf("Error: cannot write %s\n", fileName);
+        }
+        else{
+            printf("%s: %d words, after %ld instructions %s\n", fileName, count, at, what);
+        }
+        fflush(stdout);
+        pthread_mutex_unlock(&fuzz->printLock);
+    }
+    atomic_fetch_add(&fuzz->steps, f->steps);
+    return NULL;
+}
+
+/* run count random programs from seed on, spread over a pool */ 
+/*   of workerCount threads, each with its own two machines;   */ 
+/*   1 if any of them diverged                                 */ 
+int runFuzz(long count, unsigned long seed){
+    fuzz_t fuzz = { .seed = seed, .count = count };
+    int workers = workerCount > 0 ? workerCount : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    fuzz_worker_t *pool;
+    pthread_t *threads;
+    int started = 0;
+    bool failed = false;
+
+    if(consoleFile != NULL || clockInterval > 0
+#ifdef CACHE_SIM
+       || cacheLevels > 0
+#endif
+      ){
+        printf("Error: --fuzz does not go with --console, --clock or --cache\n");
+        return 1;
+    }
+    if(workers < 1) workers = 1;
+    if(workers > count) workers = count > 0 ? count : 1;
+
+    pool = calloc(workers, sizeof(fuzz_worker_t));
+    threads = calloc(workers, sizeof(pthread_t));
+    if(pool == NULL || threads == NULL){
+        printf("Error: out of memory for fuzzing\n");
+        free(pool);
+        free(threads);
+        return 1;
+    }
+    atomic_init(&fuzz.next, 0);
+    atomic_init(&fuzz.steps, 0);
+    atomic_init(&fuzz.differed, 0);
+    pthread_mutex_init(&fuzz.printLock, NULL);
+
+    for(int w = 0; w < workers && !failed; w++){
+        fuzz_worker_t *f = &pool[w];
+
+        f->fuzz = &fuzz;
+        f->quiet = fopen("/dev/null", "w");
+        f->reference = f->quiet != NULL ? newMachine(NULL, f->quiet) : NULL;
+        f->test = f->quiet != NULL ? newMachine(NULL, f->quiet) : NULL;
+        failed = f->reference == NULL || f->test == NULL;
+        if(!failed){
+            f->test->unchained = true;
+        }
+    }
+    if(failed){
+        printf("Error: out of memory for machine\n");
+        atomic_store(&fuzz.differed, 1);
+    }
+    else{
+        for(int w = 0; w < workers; w++){
+            if(pthread_create(&threads[w], NULL, fuzzWorker, &pool[w]) != 0){
+                break;
+            }
+            started++;
+        }
+        if(started == 0){
+            /* no threads to be had: fuzz here */ 
+            fuzzWorker(&pool[0]);
+        }
+        for(int w = 0; w < started; w++){
+            pthread_join(threads[w], NULL);
+        }
+        printf("%ld programs from seed %lu, %ld instructions compared, %d diverged\n",
+               count, seed, (long)atomic_load(&fuzz.steps), atomic_load(&fuzz.differed));
+    }
+
+    for(int w = 0; w < workers; w++){
+        if(pool[w].reference != NULL) freeMachine(pool[w].reference);
+        if(pool[w].test != NULL) freeMachine(pool[w].test);
+        if(pool[w].quiet != NULL) fclose(pool[w].quiet);
+    }
+    pthread_mutex_destroy(&fuzz.printLock);
+    free(pool);
+    free(threads);
+    return atomic_load(&fuzz.differed) > 0 ? 1 : 0;
+}
+
+/* put the machine back in the state loadMem() left it in, */ 
+/*   or with memory cleared if nothing was kept            */ 
+void resetMachine(machine_t *m){
+    const lazy_flags_t cleared = { FLAGS_PSW, 0, 0, 1 };
+
+    /* no run is under way, so a block the restored words */ 
+    /*   invalidate is freed rather than retired           */ 
+    m->currentBlock = NULL;
+    m->nextEntry = m->blockEnd = NULL;
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        int initial = m->initialMem != NULL ? m->initialMem[w] : 0;
+
+        if(m->mem[w] != initial){
+            m->mem[w] = initial;
+            invalidateCode(m, w);
+        }
+    }
+    memset(m->reg, 0, sizeof(m->reg));
+    m->lastFlags = m->carryFlags = cleared;
+    m->halt = 0;
+    m->instrExecs = m->instrFetches = m->memReads = m->memWrites = 0;
+    m->branches = m->branch_taken = 0;
+    memset(m->opCycles, 0, sizeof(m->opCycles));
+    resetDevices(&m->devices);
+    if(m->console != NULL){
+        flushConsole(m);
+        m->console->rcsr = m->console->xcsr = 0;
+    }
+#ifdef CACHE_SIM
+    if(m->cache != NULL){
+        clearCaches(m->cache);
+    }
+#endif
+}
+
+/* the --console device, reading from fileName or, for -, */ 
+/*   from stdin, which is made non-blocking until it is    */ 
+/*   freed                                                 */ 
+console_t *newConsole(const char *fileName){
+    console_t *c = calloc(1, sizeof(console_t));
+
+    if(c == NULL){
+        return NULL;
+    }
+    c->savedFlags = -1;
+    if(strcmp(fileName, "-") == 0){
+        c->fd = STDIN_FILENO;
+        c->savedFlags = fcntl(c->fd, F_GETFL);
+        if(c->savedFlags != -1){
+            fcntl(c->fd, F_SETFL, c->savedFlags | O_NONBLOCK);
+        }
+    }
+    else{
+        c->fd = open(fileName, O_RDONLY | O_NONBLOCK);
+        if(c->fd < 0){
+            printf("Error: cannot open %s\n", fileName);
+            free(c);
+            return NULL;
+        }
+    }
+    return c;
+}
+
+void freeConsole(console_t *c){
+    if(c->fd != STDIN_FILENO){
+        close(c->fd);
+    }
+    else if(c->savedFlags != -1){
+        fcntl(c->fd, F_SETFL, c->savedFlags);
+    }
+    free(c);
+}
+
+/* what the guest has written, in one write */ 
+void flushConsole(machine_t *m){
+    console_t *c = m->console;
+
+    if(c != NULL && c->outLength > 0){
+        fwrite(c->out, 1, c->outLength, m->out);
+        fflush(m->out);
+        c->outLength = 0;
+    }
+}
+
+/* whether a character is waiting, reading ahead if the   */ 
+/*   buffer is empty; when there is nothing to be had the  */ 
+/*   guest is left to poll a while before the next try,    */ 
+/*   and what it has written is let out for it to be seen  */ 
+static bool consoleReady(machine_t *m){
+    console_t *c = m->console;
+    ssize_t n;
+
+    if(c->inPos < c->inLength){
+        return true;
+    }
+    if(c->eof){
+        return false;
+    }
+    if(c->idle > 0){
+        c->idle--;
+        return false;
+    }
+    n = read(c->fd, c->in, sizeof(c->in));
+    if(n > 0){
+        c->inPos = 0;
+        c->inLength = n;
+        return true;
+    }
+    if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+        c->idle = CONSOLE_IDLE_POLLS;
+        flushConsole(m);
+    }
+    else{
+        c->eof = true;
+    }
+    return false;
+}
+
+int consoleRead(machine_t *m, int addr){
+    console_t *c = m->console;
+
+    switch(addr & 06){
+        case CONSOLE_RCSR & 06:
+            return c->rcsr | (consoleReady(m) ? 0200 : 0);
+        case CONSOLE_RBUF & 06:
+            if(consoleReady(m)){
+                c->rbuf = c->in[c->inPos++];
+            }
+            return c->rbuf;
+        case CONSOLE_XCSR & 06:
+            return c->xcsr | 0200; //always ready: output only waits in the buffer
+        default:
+            return 0;
+    }
+}
+
+void consoleWrite(machine_t *m, int addr, int value){
+    console_t *c = m->console;
+
+    switch(addr & 06){
+        case CONSOLE_RCSR & 06:
+            c->rcsr = value & 0100;
+            break;
+        case CONSOLE_XCSR & 06:
+            c->xcsr = value & 0100;
+            break;
+        case CONSOLE_XBUF & 06:
+            c->out[c->outLength++] = value & 0377;
+            if(c->outLength == CONSOLE_BUFFER){
+                flushConsole(m);
+            }
+            break;
+    }
+}
+
+/* the devices at power-up: priority 0, nothing requested, */ 
+/*   and the first --clock tick one interval away           */ 
+void resetDevices(devices_t *dv){
+    memset(dv, 0, sizeof(*dv));
+    dv->nextEvent = ULONG_MAX;
+    if(clockInterval > 0){
+        scheduleEvent(dv, clockInterval, clockTick);
+    }
+}
+
+/* fire after delay more of device time; the heap keeps the */ 
+/*   earliest event first, and nextEvent is its time, so    */ 
+/*   the run loops compare against that alone               */ 
+void scheduleEvent(devices_t *dv, unsigned long delay, event_fn fire){
+    int i = dv->eventCount++;
+
+    assert(i < EVENT_MAX);
+    while(i > 0 && dv->events[(i - 1) / 2].when > dv->now + delay){
+        dv->events[i] = dv->events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    dv->events[i].when = dv->now + delay;
+    dv->events[i].fire = fire;
+    dv->nextEvent = dv->events[0].when;
+}
+
+/* take the highest priority request above the processor's */ 
+/*   priority: push the PSW and PC, and load both from its  */ 
+/*   vector; false if there is none                         */ 
+static bool takeInterrupt(machine_t *m){
+    static const int vectors[IRQ_COUNT] = { [IRQ_CLOCK] = CLOCK_VECTOR };
+    static const int priorities[IRQ_COUNT] = { [IRQ_CLOCK] = CLOCK_PRIORITY };
+    devices_t *dv = &m->devices;
+    int source = -1;
+    int psw;
+
+    for(int i = 0; i < IRQ_COUNT; i++){
+        if((dv->requests & 1 << i) && priorities[i] > dv->priority &&
+           (source < 0 || priorities[i] > priorities[source])){
+            source = i;
+        }
+    }
+    if(source < 0){
+        return false;
+    }
+    if(m->halt){
+        /* paused: take it as the run goes on */ 
+        dv->nextEvent = dv->now;
+        return false;
+    }
+    dv->requests &= ~(1 << source);
+    psw = dv->priority << 5 | lazyNzvc(&m->lastFlags, &m->carryFlags);
+    if(verboseMode || traceMode){
+        fprintf(m->out, "interrupt through 0%03o at 0%06o\n", vectors[source], m->reg[7]);
+    }
+
+    /* as two MOVs to -(sp) would push them */ 
+    for(int i = 0; i < 2; i++){
+        m->reg[6] = (m->reg[6] - 2) & 0177777;
+        CACHE_ACCESS(m, ACCESS_WRITE, m->reg[6]);
+        write_word(m, m->reg[6], i == 0 ? psw : m->reg[7]);
+        m->memWrites++;
+    }
+    CACHE_ACCESS(m, ACCESS_READ, vectors[source]);
+    CACHE_ACCESS(m, ACCESS_READ, vectors[source] + 2);
+    m->reg[7] = read_word(m, vectors[source]);
+    setPsw(m, read_word(m, vectors[source] + 2));
+    m->memReads += 2;
+    return true;
+}
+
+/* device time has reached nextEvent: fire what is due, in */ 
+/*   time order, then take any interrupt they requested    */ 
+void runEvents(machine_t *m){
+    devices_t *dv = &m->devices;
+
+    while(dv->eventCount > 0 && dv->events[0].when <= dv->now){
+        event_t e = dv->events[0];
+        event_t last = dv->events[--dv->eventCount];
+        int i = 0;
+
+        /* sift the last event down from the top */ 
+        for(;;){
+            int child = 2 * i + 1;
+
+            if(child >= dv->eventCount){
+                break;
+            }
+            if(child + 1 < dv->eventCount && dv->events[child + 1].when < dv->events[child].when){
+                child++;
+            }
+            if(dv->events[child].when >= last.when){
+                break;
+            }
+            dv->events[i] = dv->events[child];
+            i = child;
+        }
+        dv->events[i] = last;
+        e.fire(m);
+    }
+    dv->nextEvent = dv->eventCount > 0 ? dv->events[0].when : ULONG_MAX;
+    while(takeInterrupt(m)){
+    }
+}
+
+/* the KW11-L: a tick sets LKS bit 7, and interrupts if the */ 
+/*   guest has enabled it                                   */ 
+void clockTick(machine_t *m){
+    devices_t *dv = &m->devices;
+
+    dv->lks |= 0200;
+    if(dv->lks & 0100){
+        dv->requests |= 1 << IRQ_CLOCK;
+    }
+    scheduleEvent(dv, clockInterval, clockTick);
+}
+
+/* the priority and condition codes of psw; lowering the */ 
+/*   priority under a waiting request brings the next    */ 
+/*   event forward to the end of this instruction         */ 
+void setPsw(machine_t *m, int psw){
+    devices_t *dv = &m->devices;
+
+    pswFlags(psw, &m->lastFlags);
+    dv->priority = (psw >> 5) & 7;
+    if(dv->requests != 0){
+        dv->nextEvent = dv->now;
+    }
+}
+
+/* the I/O page with --console or --clock; words without */ 
+/*   a register are memory as usual                       */ 
+int deviceRead(machine_t *m, int addr){
+    switch(addr & 0177776){
+        case CONSOLE_RCSR:
+        case CONSOLE_RBUF:
+        case CONSOLE_XCSR:
+        case CONSOLE_XBUF:
+            if(m->console != NULL){
+                return consoleRead(m, addr);
+            }
+            break;
+        case CLOCK_LKS:
+            if(clockInterval > 0){
+                return m->devices.lks;
+            }
+            break;
+        case PSW_ADDR:
+            return m->devices.priority << 5 | lazyNzvc(&m->lastFlags, &m->carryFlags);
+    }
+    return peek_word(m, addr);
+}
+
+void deviceWrite(machine_t *m, int addr, int value){
+    int w = (addr & 0177777) >> 1;
+
+    switch(addr & 0177776){
+        case CONSOLE_RCSR:
+        case CONSOLE_RBUF:
+        case CONSOLE_XCSR:
+        case CONSOLE_XBUF:
+            if(m->console != NULL){
+                consoleWrite(m, addr, value);
+                return;
+            }
+            break;
+        case CLOCK_LKS:
+            if(clockInterval > 0){
+                /* bit 7 is only cleared, by writing 0 to it */ 
+                m->devices.lks = (value & 0100) | (m->devices.lks & value & 0200);
+                return;
+            }
+            break;
+        case PSW_ADDR:
+            setPsw(m, value);
+            return;
+    }
+    m->mem[w] = value;
+    invalidateCode(m, w);
+}
+
+/* read_word() and write_word() with devices or watchpoints */ 
+int hookedRead(machine_t *m, int addr){
+    int value = (addr & IO_PAGE) == IO_PAGE && m->ioPage ? deviceRead(m, addr) : peek_word(m, addr);
+
+    if(watched(m->readBits, addr)){
+        watchHit(m, PDP11_WATCH_READ, addr, value, 0);
+    }
+    return value;
+}
+
+void hookedWrite(machine_t *m, int addr, int value){
+    int w = (addr & 0177777) >> 1;
+
+    if(watched(m->writeBits, addr)){
+        watchHit(m, PDP11_WATCH_WRITE, addr, value, peek_word(m, addr));
+    }
+    if((addr & IO_PAGE) == IO_PAGE && m->ioPage){
+        deviceWrite(m, addr, value);
+        return;
+    }
+    m->mem[w] = value;
+    invalidateCode(m, w);
+}
+
+/* set or clear kinds, PDP11_ bits, on the words from */ 
+/*   first to last; the run loops and accessors look   */ 
+/*   at them only while one is set                     */ 
+void setWatch(machine_t *m, int kinds, int first, int last, bool set){
+    uint64_t *maps[3] = { m->breakBits, m->readBits, m->writeBits };
+    bool any[3] = { false, false, false };
+
+    for(int k = 0; k < 3; k++){
+        if(!(kinds & 1 << k)){
+            continue;
+        }
+        for(int w = (first & 0177777) >> 1; w <= (last & 0177777) >> 1; w++){
+            if(set){
+                maps[k][w >> 6] |= 1ULL << (w & 63);
+            }
+            else{
+                maps[k][w >> 6] &= ~(1ULL << (w & 63));
+            }
+        }
+    }
+    for(int k = 0; k < 3; k++){
+        for(int i = 0; i < MEM_SIZE_IN_WORDS / 64 && !any[k]; i++){
+            any[k] = maps[k][i] != 0;
+        }
+    }
+    m->breaking = any[0];
+    m->hooked = m->ioPage || any[1] || any[2];
+}
+
+/* a breakpoint reached, or a watched word read or written */ 
+/*   by the instruction running, with the value read or    */ 
+/*   written and the value a write replaces               */ 
+void watchHit(machine_t *m, int kind, int addr, int value, int old){
+    int pc = m->nextEntry != NULL ? m->nextEntry[-1].pc : m->reg[7];
+    char what[96];
+
+    if(m->halt == 1){
+        return;
+    }
+    if(kind == PDP11_BREAK){
+        sprintf(what, "breakpoint at 0%06o", addr & 0177777);
+    }
+    else if(kind == PDP11_WATCH_READ){
+        sprintf(what, "read of 0%06o from 0%06o at 0%06o", value & 0177777, addr & 0177777, pc);
+    }
+    else{
+        sprintf(what, "write of 0%06o over 0%06o to 0%06o at 0%06o", value & 0177777, old, addr & 0177777, pc);
+    }
+    if(m->watchAction == PDP11_WATCH_LOG){
+        fprintf(m->out, "%s after %d:", what, m->instrExecs);
+        for(int r = 0; r < 8; r++){
+            fprintf(m->out, " R%d:0%06o", r, m->reg[r] & 0177777);
+        }
+        fprintf(m->out, "\n");
+        return;
+    }
+    fprintf(m->out, "%s, after %d instructions\n", what, m->instrExecs);
+    printRegisters(m);
+    if(m->watchAction == PDP11_WATCH_STOP && !m->halt){
+        m->halt = HALT_WATCH;
+    }
+}
+
+/* remember memory as loaded, for resetMachine() */ 
+bool keepLoaded(machine_t *m){
+    if(m->initialMem == NULL){
+        m->initialMem = malloc(sizeof(m->mem));
+        if(m->initialMem == NULL){
+            fprintf(m->out, "Error: out of memory for machine\n");
+            return false;
+        }
+    }
+    memcpy(m->initialMem, m->mem, sizeof(m->mem));
+    return true;
+}
+
+/* the state fields of s in snapshot file order */ 
+static void snapshotFields(snapshot_t *s, int *fields[SNAPSHOT_FIELDS]){
+    int n = 0;
+
+    for(int r = 0; r < 8; r++){
+        fields[n++] = &s->reg[r];
+    }
+    fields[n++] = &s->lastFlags.op;
+    fields[n++] = &s->lastFlags.src;
+    fields[n++] = &s->lastFlags.dst;
+    fields[n++] = &s->lastFlags.result;
+    fields[n++] = &s->carryFlags.op;
+    fields[n++] = &s->carryFlags.src;
+    fields[n++] = &s->carryFlags.dst;
+    fields[n++] = &s->carryFlags.result;
+    fields[n++] = &s->halt;
+    fields[n++] = &s->instrExecs;
+    fields[n++] = &s->instrFetches;
+    fields[n++] = &s->memReads;
+    fields[n++] = &s->memWrites;
+    fields[n++] = &s->branches;
+    fields[n++] = &s->branch_taken;
+    fields[n++] = &s->programWords;
+    assert(n == SNAPSHOT_FIELDS);
+}
+
+/* a snapshot holding a copy of mem in a new in-memory */ 
+/*   file; the state fields are left for the caller    */ 
+static snapshot_t *newSnapshot(machine_t *m, const uint16_t *mem){
+    snapshot_t *s = calloc(1, sizeof(snapshot_t));
+    size_t done = 0;
+
+    if(s == NULL){
+        fprintf(m->out, "Error: out of memory for snapshot\n");
+        return NULL;
+    }
+    s->memFd = memfd_create("pdp11-snapshot", MFD_CLOEXEC);
+    while(s->memFd >= 0 && done < sizeof(m->mem)){
+        ssize_t n = pwrite(s->memFd, (const char*)mem + done, sizeof(m->mem) - done, done);
+
+        if(n <= 0){
+            break;
+        }
+        done += n;
+    }
+    if(done < sizeof(m->mem)){
+        fprintf(m->out, "Error: cannot keep snapshot memory\n");
+        freeSnapshot(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* everything in a snapshot but memory, to and from the machine */ 
+static void saveState(machine_t *m, snapshot_t *s){
+    memcpy(s->reg, m->reg, sizeof(s->reg));
+    s->lastFlags = m->lastFlags;
+    s->carryFlags = m->carryFlags;
+    s->halt = m->halt;
+    s->instrExecs = m->instrExecs;
+    s->instrFetches = m->instrFetches;
+    s->memReads = m->memReads;
+    s->memWrites = m->memWrites;
+    s->branches = m->branches;
+    s->branch_taken = m->branch_taken;
+    memcpy(s->opCycles, m->opCycles, sizeof(s->opCycles));
+    s->devices = m->devices;
+    s->programWords = m->programWords;
+}
+
+static void loadState(machine_t *m, const snapshot_t *s){
+    memcpy(m->reg, s->reg, sizeof(m->reg));
+    m->lastFlags = s->lastFlags;
+    m->carryFlags = s->carryFlags;
+    m->halt = s->halt;
+    m->instrExecs = s->instrExecs;
+    m->instrFetches = s->instrFetches;
+    m->memReads = s->memReads;
+    m->memWrites = s->memWrites;
+    m->branches = s->branches;
+    m->branch_taken = s->branch_taken;
+    memcpy(m->opCycles, s->opCycles, sizeof(m->opCycles));
+    m->devices = s->devices;
+    m->programWords = s->programWords;
+}
+
+/* forget every block built so far, and any code compiled */ 
+/*   from them; called between runs only                  */ 
+static void dropBlocks(machine_t *m){
+    /* a block covers its first word, so only words with code */ 
+    /*   can start one; skip the rest eight at a time          */ 
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w += 8){
+        uint64_t covered;
+
+        memcpy(&covered, &m->codeMap[w], sizeof(covered));
+        for(int i = w; covered != 0 && i < w + 8; i++){
+            if(m->blockCache[i] != NULL){
+                foldBlockRuns(m, m->blockCache[i]);
+            }
+            free(m->blockCache[i]);
+            m->blockCache[i] = NULL;
+        }
+    }
+    free(m->retiredBlock);
+    m->retiredBlock = m->currentBlock = NULL;
+    m->nextEntry = m->blockEnd = NULL;
+    memset(m->codeMap, 0, sizeof(m->codeMap));
+#ifdef JIT
+    m->jitNext = m->jitBlocks;
+#endif
+}
+
+/* the machine's memory, registers, flags and counters as */ 
+/*   they are now                                         */ 
+snapshot_t *takeSnapshot(machine_t *m){
+    snapshot_t *s = newSnapshot(m, m->mem);
+
+    if(s != NULL){
+        saveState(m, s);
+    }
+    return s;
+}
+
+/* put the machine in the state s was taken in. Memory is */ 
+/*   mapped copy-on-write from the snapshot, or copied in  */ 
+/*   where pages are larger than mem's alignment; blocks   */ 
+/*   built from the old memory are dropped either way      */ 
+bool restoreSnapshot(machine_t *m, const snapshot_t *s){
+    long pageSize = sysconf(_SC_PAGESIZE);
+    bool mapped = false;
+    size_t done = 0;
+
+    dropBlocks(m);
+    if(pageSize > 0 && (uintptr_t)m->mem % pageSize == 0 && sizeof(m->mem) % pageSize == 0){
+        mapped = mmap(m->mem, sizeof(m->mem), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, s->memFd, 0) != MAP_FAILED;
+    }
+    while(!mapped && done < sizeof(m->mem)){
+        ssize_t n = pread(s->memFd, (char*)m->mem + done, sizeof(m->mem) - done, done);
+
+        if(n <= 0){
+            fprintf(m->out, "Error: cannot restore snapshot memory\n");
+            return false;
+        }
+        done += n;
+    }
+
+    loadState(m, s);
+    return true;
+}
+
+void freeSnapshot(snapshot_t *s){
+    if(s == NULL){
+        return;
+    }
+    if(s->memFd >= 0){
+        close(s->memFd);
+    }
+    free(s);
+}
+
+/* write s to fileName: SNAPSHOT_MAGIC, the state fields as */ 
+/*   little-endian 32-bit words, then each run of nonzero    */ 
+/*   memory words as a 16-bit word address, a 16-bit count   */ 
+/*   and the words, ending with a zero count                 */ 
+bool writeSnapshot(machine_t *m, const snapshot_t *s, const char *fileName){
+    const uint16_t *mem = mmap(NULL, sizeof(m->mem), PROT_READ, MAP_SHARED, s->memFd, 0);
+    const uint16_t endOfRuns[2] = { 0, 0 };
+    int *fields[SNAPSHOT_FIELDS];
+    FILE *file;
+    bool written;
+
+    if(mem == MAP_FAILED){
+        fprintf(m->out, "Error: cannot read snapshot memory\n");
+        return false;
+    }
+    file = fopen(fileName, "wb");
+    if(file == NULL){
+        fprintf(m->out, "Error: cannot open %s\n", fileName);
+        munmap((void*)mem, sizeof(m->mem));
+        return false;
+    }
+    fwrite(SNAPSHOT_MAGIC, 1, 8, file);
+    snapshotFields((snapshot_t*)s, fields);
+    for(int i = 0; i < SNAPSHOT_FIELDS; i++){
+        uint32_t v = htole32(*fields[i]);
+
+        fwrite(&v, sizeof(v), 1, file);
+    }
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        int start = w;
+        uint16_t run[2];
+
+        while(w < MEM_SIZE_IN_WORDS && mem[w] != 0){
+            w++;
+        }
+        if(w == start){
+            continue;
+        }
+        run[0] = htole16(start);
+        run[1] = htole16(w - start);
+        fwrite(run, sizeof(run), 1, file);
+        for(int i = start; i < w; i++){
+            uint16_t v = htole16(mem[i]);
+
+            fwrite(&v, sizeof(v), 1, file);
+        }
+    }
+    fwrite(endOfRuns, sizeof(endOfRuns), 1, file);
+    munmap((void*)mem, sizeof(m->mem));
+    written = !ferror(file);
+    if(fclose(file) != 0 || !written){
+        fprintf(m->out, "Error: cannot write %s\n", fileName);
+        return false;
+    }
+    return true;
+}
+
+/* a snapshot read back from a writeSnapshot() file; NULL */ 
+/*   after reporting the error if it is not one           */ 
+snapshot_t *readSnapshot(machine_t *m, const char *fileName){
+    FILE *file = fopen(fileName, "rb");
+    uint16_t *mem = calloc(MEM_SIZE_IN_WORDS, sizeof(uint16_t));
+    uint32_t state[SNAPSHOT_FIELDS];
+    int *fields[SNAPSHOT_FIELDS];
+    char magic[8];
+    snapshot_t *s = NULL;
+    bool valid;
+
+    if(file == NULL){
+        fprintf(m->out, "Error: cannot open %s\n", fileName);
+        free(mem);
+        return NULL;
+    }
+    if(mem == NULL){
+        fprintf(m->out, "Error: out of memory for snapshot\n");
+        fclose(file);
+        return NULL;
+    }
+    valid = fread(magic, 1, 8, file) == 8 && memcmp(magic, SNAPSHOT_MAGIC, 8) == 0 &&
+        fread(state, sizeof(state), 1, file) == 1;
+    while(valid){
+        uint16_t run[2];
+        int start, count;
+
+        valid = fread(run, sizeof(run), 1, file) == 1;
+        start = le16toh(run[0]);
+        count = le16toh(run[1]);
+        if(!valid || count == 0){
+            break;
+        }
+        valid = start + count <= MEM_SIZE_IN_WORDS &&
+            fread(&mem[start], sizeof(uint16_t), count, file) == (size_t)count;
+        for(int w = start; valid && w < start + count; w++){
+            mem[w] = le16toh(mem[w]);
+        }
+    }
+    fclose(file);
+
+    if(valid){
+        s = newSnapshot(m, mem);
+        if(s != NULL){
+            snapshotFields(s, fields);
+            for(int i = 0; i < SNAPSHOT_FIELDS; i++){
+                *fields[i] = (int32_t)le32toh(state[i]);
+            }
+            resetDevices(&s->devices);
+            /* only states the machine could have been in */ 
+            if(s->lastFlags.op < FLAGS_PSW || s->lastFlags.op > FLAGS_ASL ||
+               s->carryFlags.op < FLAGS_PSW || s->carryFlags.op > FLAGS_ASL ||
+               s->halt < 0 || s->halt > 1 ||
+               s->programWords < 0 || s->programWords > MEM_SIZE_IN_WORDS){
+                freeSnapshot(s);
+                s = NULL;
+                valid = false;
+            }
+        }
+    }
+    if(!valid){
+        fprintf(m->out, "Error: %s is not a snapshot file\n", fileName);
+    }
+    free(mem);
+    return s;
+}
+
+/* start recording at the machine's current state, in place */ 
+/*   of any history so far; false if out of memory            */ 
+bool startHistory(machine_t *m, long interval, int keep){
+    history_t *h;
+
+    stopHistory(m);
+    h = calloc(1, sizeof(history_t));
+    if(h != NULL){
+        h->quiet = fopen("/dev/null", "w");
+    }
+    if(h == NULL || h->quiet == NULL){
+        fprintf(m->out, "Error: out of memory for history\n");
+        free(h);
+        return false;
+    }
+    h->interval = interval;
+    h->keep = keep;
+    memcpy(h->reg, m->reg, sizeof(h->reg));
+    m->history = h;
+    if(!addCheckpoint(m)){
+        stopHistory(m);
+        return false;
+    }
+    return true;
+}
+
+void stopHistory(machine_t *m){
+    history_t *h = m->history;
+
+    if(h == NULL){
+        return;
+    }
+    for(int i = 0; i < h->count; i++){
+        dropCheckpoint(h, &h->checkpoints[i]);
+    }
+    free(h->checkpoints);
+    fclose(h->quiet);
+    free(h);
+    m->history = NULL;
+}
+
+/* a checkpoint of the machine as it is now; each page of */ 
+/*   memory is shared with the checkpoint before it unless */ 
+/*   the program has changed it since                      */ 
+static bool addCheckpoint(machine_t *m){
+    history_t *h = m->history;
+    checkpoint_t *previous, *c;
+
+    if(h->count == h->capacity){
+        int capacity = h->capacity ? 2 * h->capacity : 64;
+        checkpoint_t *checkpoints = realloc(h->checkpoints, capacity * sizeof(checkpoint_t));
+
+        if(checkpoints == NULL){
+            fprintf(m->out, "Error: out of memory for history\n");
+            h->failed = true;
+            return false;
+        }
+        h->checkpoints = checkpoints;
+        h->capacity = capacity;
+    }
+    previous = h->count > 0 ? &h->checkpoints[h->count - 1] : NULL;
+    if(previous != NULL && previous->logLength > 0 && previous->logLength < previous->logCapacity){
+        /* its log is complete: give back what doubling left over */ 
+        uint32_t *log = realloc(previous->log, previous->logLength * sizeof(uint32_t));
+
+        if(log != NULL){
+            previous->log = log;
+            previous->logCapacity = previous->logLength;
+        }
+    }
+    c = &h->checkpoints[h->count];
+    memset(c, 0, sizeof(*c));
+    saveState(m, &c->state);
+    c->state.memFd = -1;
+    c->position = h->position;
+    for(int p = 0; p < HISTORY_PAGES; p++){
+        const uint16_t *words = &m->mem[p * HISTORY_PAGE_WORDS];
+
+        if(previous != NULL && memcmp(previous->pages[p]->words, words, sizeof(previous->pages[p]->words)) == 0){
+            c->pages[p] = previous->pages[p];
+            c->pages[p]->refs++;
+            continue;
+        }
+        c->pages[p] = malloc(sizeof(history_page_t));
+        if(c->pages[p] == NULL){
+            fprintf(m->out, "Error: out of memory for history\n");
+            dropCheckpoint(h, c);
+            h->failed = true;
+            return false;
+        }
+        c->pages[p]->refs = 1;
+        memcpy(c->pages[p]->words, words, sizeof(c->pages[p]->words));
+        h->pages++;
+    }
+    h->count++;
+
+    if(h->keep > 0 && h->count > h->keep){
+        dropCheckpoint(h, &h->checkpoints[0]);
+        h->count--;
+        memmove(&h->checkpoints[0], &h->checkpoints[1], h->count * sizeof(checkpoint_t));
+    }
+    return true;
+}
+
+/* free the log of c, and its pages once no other */ 
+/*   checkpoint shares them                      */ 
+static void dropCheckpoint(history_t *h, checkpoint_t *c){
+    for(int p = 0; p < HISTORY_PAGES && c->pages[p] != NULL; p++){
+        if(--c->pages[p]->refs == 0){
+            free(c->pages[p]);
+            h->pages--;
+        }
+    }
+    free(c->log);
+}
+
+/* index of the last checkpoint at or before position */ 
+static int checkpointBefore(const history_t *h, long position){
+    int low = 0, high = h->count - 1;
+
+    while(low < high){
+        int middle = (low + high + 1) / 2;
+
+        if(h->checkpoints[middle].position <= position){
+            low = middle;
+        }
+        else{
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+/* index in c's log where instruction number steps after */ 
+/*   c starts; the log length if it is not there yet     */ 
+static size_t logIndex(const checkpoint_t *c, long steps){
+    size_t e = 0;
+
+    for(; e < c->logLength; e++){
+        if((c->log[e] & (LOG_WRITE | LOG_REG)) == 0 && steps-- == 0){
+            break;
+        }
+    }
+    return e;
+}
+
+/* forget what was recorded after the current position, */ 
+/*   so the machine can run on from it                  */ 
+void trimHistory(machine_t *m){
+    history_t *h = m->history;
+    checkpoint_t *c;
+    int i;
+
+    if(h->position == h->end){
+        return;
+    }
+    i = checkpointBefore(h, h->position);
+    while(h->count > i + 1){
+        h->count--;
+        dropCheckpoint(h, &h->checkpoints[h->count]);
+    }
+    c = &h->checkpoints[i];
+    c->logLength = logIndex(c, h->position - c->position);
+    memcpy(h->reg, m->reg, sizeof(h->reg));
+    h->end = h->position;
+}
+
+/* put the machine where it was after position instructions */ 
+/*   of the recorded run, by running to it from the nearest  */ 
+/*   checkpoint before it, or from where the machine is if   */ 
+/*   that is nearer. What the replay prints was printed once */ 
+/*   already, and goes to /dev/null; its watchpoints do not  */ 
+/*   stop it                                                 */ 
+bool seekHistory(machine_t *m, long position){
+    history_t *h = m->history;
+    const checkpoint_t *c;
+    FILE *out = m->out;
+    int watchAction = m->watchAction;
+
+    if(h == NULL || h->failed){
+        fprintf(m->out, "Error: %s\n", h == NULL ? "no history is being recorded" : "the history is incomplete");
+        return false;
+    }
+    if(position < h->checkpoints[0].position || position > h->end){
+        fprintf(m->out, "Error: instruction %ld is not in the history\n", position);
+        return false;
+    }
+    c = &h->checkpoints[checkpointBefore(h, position)];
+    if(position < h->position || c->position > h->position){
+        dropBlocks(m);
+        for(int p = 0; p < HISTORY_PAGES; p++){
+            memcpy(&m->mem[p * HISTORY_PAGE_WORDS], c->pages[p]->words, sizeof(c->pages[p]->words));
+        }
+        loadState(m, &c->state);
+        h->position = c->position;
+    }
+    m->history = NULL;
+    m->out = h->quiet;
+    m->watchAction = PDP11_WATCH_REPORT;
+    pdp11_run(m, position - h->position);
+    m->watchAction = watchAction;
+    m->out = out;
+    m->history = h;
+    h->position = position;
+    memcpy(h->reg, m->reg, sizeof(h->reg));
+    return true;
+}
+
+/* position of the last instruction before the current one  */ 
+/*   that ran at PC what or, with write set, that wrote the  */ 
+/*   memory word what; its PC and the value written go in    */ 
+/*   *pc and *value. -1 if there is none in the history      */ 
+long findInHistory(machine_t *m, bool write, int what, int *pc, int *value){
+    history_t *h = m->history;
+    long found = -1;
+    int foundPc = 0, foundValue = 0;
+
+    if(h == NULL || h->failed){
+        fprintf(m->out, "Error: %s\n", h == NULL ? "no history is being recorded" : "the history is incomplete");
+        return -1;
+    }
+    for(int i = checkpointBefore(h, h->position); i >= 0 && found < 0; i--){
+        const checkpoint_t *c = &h->checkpoints[i];
+        long step = c->position - 1;
+        int stepPc = 0;
+
+        for(size_t e = 0; e < c->logLength; e++){
+            uint32_t entry = c->log[e];
+
+            if(entry & LOG_WRITE){
+                if(write && (int)(entry >> 16 & 077777) == what){
+                    found = step;
+                    foundPc = stepPc;
+                    foundValue = entry & 0177777;
+                }
+            }
+            else if((entry & LOG_REG) == 0){
+                if(++step >= h->position){
+                    break;
+                }
+                stepPc = entry;
+                if(!write && stepPc == what){
+                    found = step;
+                    foundPc = stepPc;
+                }
+            }
+        }
+    }
+    if(pc != NULL){
+        *pc = foundPc;
+    }
+    if(value != NULL){
+        *value = foundValue;
+    }
+    return found;
+}
+
+/* total seconds spent in run() over the given number of runs */ 
+double timeRuns(machine_t *m, int runs, void (*run)(machine_t*)){
+    struct timespec start, end;
+    double total = 0;
+
+    for(int i = 0; i < runs; i++){
+        resetMachine(m);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run(m);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        total += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    }
+    return total;
+}
+
+/* one -T run, with the writer started and drained inside it */ 
+static void run_recordedToNull(machine_t *m){
+    if(startTrace(m, "/dev/null")){
+        run_recorded(m);
+        stopTrace(m);
+    }
+}
+
+/* run the loaded program repeatedly in each loop variant and */ 
+/*   report instructions per second; trace output goes to     */ 
+/*   /dev/null so the instrumented loop is timed, not the tty */ 
+void benchmark(machine_t *m, int runs){
+    double fast, traced, verbose, recorded;
+    int executed;
+    FILE *out = m->out;
+
+    if(!keepLoaded(m)){
+        return;
+    }
+
+    fast = timeRuns(m, runs, run_fast);
+    executed = m->instrExecs;
+
+    m->out = fopen("/dev/null", "w");
+    if(m->out == NULL){
+        m->out = out;
+        fprintf(m->out, "Error: cannot open /dev/null\n");
+        return;
+    }
+
+    traceMode = true;
+    traced = timeRuns(m, runs, run_traced);
+    traceMode = false;
+    verboseMode = true;
+    verbose = timeRuns(m, runs, run_traced);
+    verboseMode = false;
+    recorded = timeRuns(m, runs, run_recordedToNull);
+
+    fclose(m->out);
+    m->out = out;
+
+    fprintf(m->out, "benchmark (%d runs of %d instructions):\n", runs, executed);
+    fprintf(m->out, "  fast loop                 = %0.2f million instructions/second\n", (double)executed*runs/fast/1e6);
+    fprintf(m->out, "  traced loop, -t           = %0.2f million instructions/second\n", (double)executed*runs/traced/1e6);
+    fprintf(m->out, "  traced loop, -v           = %0.2f million instructions/second\n", (double)executed*runs/verbose/1e6);
+    fprintf(m->out, "  recorded loop, -T%-9s= %0.2f million instructions/second\n",
+            compressTrace ? " -z" : "", (double)executed*runs/recorded/1e6);
+}
+
+/* open fileName, write the header and start the thread that */ 
+/*   drains m->trace into it                                 */ 
+bool startTrace(machine_t *m, const char *fileName){
+    trace_header_t header = { TRACE_MAGIC, sizeof(trace_record_t), compressTrace };
+    trace_ring_t *t = calloc(1, sizeof(trace_ring_t));
+
+    if(t == NULL){
+        fprintf(m->out, "Error: out of memory for trace\n");
+        return false;
+    }
+    t->file = fopen(fileName, "wb");
+    if(t->file == NULL){
+        fprintf(m->out, "Error: cannot create %s\n", fileName);
+        free(t);
+        return false;
+    }
+    setvbuf(t->file, NULL, _IOFBF, 1 << 20);
+    if(fwrite(&header, sizeof(header), 1, t->file) != 1){
+        t->failed = true;
+    }
+    if(pthread_create(&t->writer, NULL, traceWriter, t) != 0){
+        fprintf(m->out, "Error: cannot start trace writer\n");
+        fclose(t->file);
+        free(t);
+        return false;
+    }
+    m->trace = t;
+    return true;
+}
+
+/* wait for the writer to drain what is left and close */ 
+/*   the file; false if any of it could not be written */ 
+bool stopTrace(machine_t *m){
+    trace_ring_t *t = m->trace;
+    bool written;
+
+    atomic_store(&t->done, true);
+    pthread_join(t->writer, NULL);
+    written = fclose(t->file) == 0 && !t->failed;
+    if(!written){
+        fprintf(m->out, "Error: cannot write trace\n");
+    }
+    free(t);
+    m->trace = NULL;
+    return written;
+}
+
+/* -z form of one record into out, at most TRACE_PACKED_MAX */ 
+/*   bytes; previous is the record before it and becomes r  */ 
+static size_t packRecord(trace_record_t *previous, const trace_record_t *r, unsigned char *out){
+    uint64_t before[TRACE_WORDS], after[TRACE_WORDS], x, nonzero;
+    size_t n = 1;
+    int bytes;
+
+    memcpy(before, previous, sizeof(before));
+    memcpy(after, r, sizeof(after));
+    *previous = *r;
+
+    out[0] = 0;
+    for(int w = 0; w < TRACE_WORDS; w++){
+        x = before[w] ^ after[w];
+        if(x == 0){
+            continue;
+        }
+        out[0] |= 1 << w;
+
+        /* the top bit of each nonzero byte, gathered into one byte */ 
+        nonzero = (((x & 0x7f7f7f7f7f7f7f7f) + 0x7f7f7f7f7f7f7f7f) | x) & 0x8080808080808080;
+        bytes = ((nonzero >> 7) * 0x0102040810204080) >> 56;
+        out[n++] = bytes;
+        for(; bytes != 0; bytes &= bytes - 1){
+            out[n++] = x >> (8 * __builtin_ctz(bytes));
+        }
+    }
+    return n;
+}
+
+/* the writer thread: copies records from the ring to the */ 
+/*   file until the ring is empty and done is set         */ 
+void *traceWriter(void *arg){
+    trace_ring_t *t = arg;
+    const struct timespec idle = { 0, 100000 };
+    trace_record_t previous = { 0 };
+    unsigned char packed[1024 * TRACE_PACKED_MAX]; //records packed for one fwrite()
+    size_t tail = 0, head, first, count, size;
+
+    for(;;){
+        head = atomic_load_explicit(&t->head, memory_order_acquire);
+        if(head == tail){
+            if(atomic_load(&t->done)){
+                /* records added before done was set */ 
+                if(atomic_load_explicit(&t->head, memory_order_acquire) == tail){
+                    break;
+                }
+                continue;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        /* everything up to head or the end of the ring */ 
+        first = tail & (TRACE_RING_SIZE - 1);
+        count = head - tail;
+        if(count > TRACE_RING_SIZE - first){
+            count = TRACE_RING_SIZE - first;
+        }
+        /* after a failed write the records are dropped, */ 
+        /*   so the interpreter is never held up          */ 
+        if(!t->failed && compressTrace){
+            size = 0;
+            for(size_t i = 0; i < count && !t->failed; i++){
+                size += packRecord(&previous, &t->records[first + i], packed + size);
+                if(size > sizeof(packed) - TRACE_PACKED_MAX || i + 1 == count){
+                    t->failed = fwrite(packed, 1, size, t->file) != size;
+                    size = 0;
+                }
+            }
+        }
+        else if(!t->failed){
+            t->failed = fwrite(&t->records[first], sizeof(trace_record_t), count, t->file) != count;
+        }
+        tail += count;
+        atomic_store_explicit(&t->tail, tail, memory_order_release);
+    }
+    return NULL;
+}
+
+/* next record of a -T file into r, which holds the one */ 
+/*   before it; 1 if read, 0 at the end, -1 if cut short */ 
+static int readRecord(FILE *in, trace_record_t *r, bool compressed){
+    uint64_t words[TRACE_WORDS], x;
+    size_t got;
+    int changed, bytes, c;
+
+    if(!compressed){
+        got = fread(r, 1, sizeof(trace_record_t), in);
+        return got == sizeof(trace_record_t) ? 1 : got == 0 ? 0 : -1;
+    }
+    if((changed = getc(in)) == EOF){
+        return 0;
+    }
+    memcpy(words, r, sizeof(words));
+    for(int w = 0; w < TRACE_WORDS; w++){
+        if(!(changed & (1 << w))){
+            continue;
+        }
+        if((bytes = getc(in)) == EOF){
+            return -1;
+        }
+        for(x = 0; bytes != 0; bytes &= bytes - 1){
+            if((c = getc(in)) == EOF){
+                return -1;
+            }
+            x |= (uint64_t)c << (8 * __builtin_ctz(bytes));
+        }
+        words[w] ^= x;
+    }
+    memcpy(r, words, sizeof(words));
+    return 1;
+}
+
+/* one record as run_traced() prints the instruction */ 
+static void printRecord(const trace_record_t *r){
+    const decoded_t *d = &decodeTable[r->ir];
+
+    printf("at 0%04o, ", r->pc);
+    switch(d->op){
+        case OP_HALT:
+            printf("halt instruction\n");
+            break;
+        case OP_MOV:
+        case OP_CMP:
+        case OP_ADD:
+        case OP_SUB:
+            printf("%s instruction sm %d, sr %d dm %d dr %d\n", opNames[d->op],
+                   d->srcMode, d->srcReg, d->dstMode, d->dstReg);
+            break;
+        case OP_SOB:
+            printf("sob instruction reg %d with offset 0%02o\n", d->srcReg, r->ir & 077);
+            break;
+        case OP_ASR:
+        case OP_ASL:
+        case OP_CLR:
+        case OP_INC:
+        case OP_DEC:
+        case OP_NEG:
+        case OP_TST:
+            printf("%s instruction dm %d dr %d\n", opNames[d->op], d->dstMode, d->dstReg);
+            break;
+        case OP_JSR:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_ASH:
+        case OP_ASHC:
+            printf("%s instruction reg %d dm %d dr %d\n", opNames[d->op], d->srcReg, d->dstMode, d->dstReg);
+            break;
+        case OP_RTS:
+            printf("rts instruction reg %d\n", d->dstReg);
+            break;
+        case OP_RTI:
+            printf("rti instruction\n");
+            break;
+        default:
+            if(isBranch(d->op)){
+                printf("%s instruction with offset 0%03o\n", opNames[d->op], r->ir & 0377);
+                break;
+            }
+            printf("Error: no matching instruction");
+            break;
+    }
+    if(!verboseMode){
+        return;
+    }
+
+    switch(d->op){
+        case OP_MOV:
+        case OP_CMP:
+        case OP_ADD:
+        case OP_SUB:
+            printf("  src.value = 0%06o\n", r->srcValue);
+            if(d->op == OP_MOV){
+                break;
+            }
+            /* fall through */ 
+        case OP_ASR:
+        case OP_ASL:
+        case OP_INC:
+        case OP_DEC:
+        case OP_NEG:
+        case OP_TST:
+            printf("  dst.value = 0%06o\n", r->dstValue);
+            printf("  result    = 0%06o\n", r->result);
+            break;
+        case OP_JSR:
+            printf("  src.value = 0%06o\n", r->srcValue);
+            break;
+        case OP_RTS:
+            printf("  value 0%06o is popped into r%d\n", r->reg[d->dstReg], d->dstReg);
+            break;
+        case OP_RTI:
+            printf("  pc 0%06o and psw 0%06o are popped\n", r->srcValue, r->dstValue);
+            break;
+        case OP_MUL:
+        case OP_DIV:
+        case OP_ASH:
+        case OP_ASHC:
+            printf("  dst.value = 0%06o\n", r->dstValue);
+            printf("  r%d = 0%06o, r%d = 0%06o\n", d->srcReg, r->reg[d->srcReg], d->srcReg | 1, r->reg[d->srcReg | 1]);
+            break;
+    }
+    switch(d->op){
+        case OP_MOV:
+        case OP_CMP:
+        case OP_ADD:
+        case OP_SUB:
+        case OP_ASR:
+        case OP_ASL:
+        case OP_CLR:
+        case OP_INC:
+        case OP_DEC:
+        case OP_NEG:
+        case OP_TST:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_ASH:
+        case OP_ASHC:
+            printf("  nzvc bits = 4'b%o%o%o%o\n", r->nzvc >> 3 & 1, r->nzvc >> 2 & 1, r->nzvc >> 1 & 1, r->nzvc & 1);
+            break;
+    }
+    if(d->op == OP_MOV && d->dstMode != 0){
+        printf("  value 0%06o is written to 0%06o\n", r->srcValue, r->dstAddr);
+    }
+    if(d->op == OP_CLR && d->dstMode != 0){
+        printf("  value 0%06o is written to 0%06o\n", 0, r->dstAddr);
+    }
+    printf("  R0:0%06o  R2:0%06o  R4:0%06o  R6:0%06o\n", r->reg[0], r->reg[2], r->reg[4], r->reg[6]);
+    printf("  R1:0%06o  R3:0%06o  R5:0%06o  R7:0%06o\n", r->reg[1], r->reg[3], r->reg[5], r->reg[7]);
+}
+
+/* --decode: print a -T file as the instruction trace of */ 
+/*   -t, or of -v when given                             */ 
+bool decodeTrace(const char *fileName){
+    FILE *in = fopen(fileName, "rb");
+    trace_header_t header;
+    trace_record_t r = { 0 };
+    int status;
+
+    if(in == NULL){
+        printf("Error: cannot open %s\n", fileName);
+        return false;
+    }
+    if(fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+       || header.recordSize != sizeof(trace_record_t)){
+        printf("Error: %s is not a trace written by this simulator\n", fileName);
+        fclose(in);
+        return false;
+    }
+
+    printf("\ninstruction trace:\n");
+    while((status = readRecord(in, &r, header.compressed)) > 0){
+        printRecord(&r);
+    }
+    printf("\n");
+    fclose(in);
+
+    if(status < 0){
+        printf("Error: %s is cut short\n", fileName);
+        return false;
+    }
+    return true;
+}
+
+/* operand in assembler syntax; immediate and index words */ 
+/*   are read from *next, which is advanced past them     */ 
+void formatOperand(machine_t *m, char *buf, int mode, int r, int *next){
+    static const char *const formats[6] = {
+        "r%d", "(r%d)", "(r%d)+", "@(r%d)+", "-(r%d)", "@-(r%d)"
+    };
+
+    if(r == 7 && mode == 2){
+        sprintf(buf, "#%06o", peek_word(m, *next));
+        *next += 2;
+    }
+    else if(r == 7 && mode == 3){
+        sprintf(buf, "@#%06o", peek_word(m, *next));
+        *next += 2;
+    }
+    else if(mode >= 6){
+        sprintf(buf, mode == 6 ? "%06o(r%d)" : "@%06o(r%d)", peek_word(m, *next), r);
+        *next += 2;
+    }
+    else{
+        sprintf(buf, formats[mode], r);
+    }
+}
+
+/* the instruction at pc in assembler syntax; returns the */ 
+/*   number of words it occupies                          */ 
+int disassemble(machine_t *m, int pc, char *buf){
+    int word = peek_word(m, pc);
+    const decoded_t *d = &decodeTable[word];
+    int next = pc + 2;
+    char srcText[16], dstText[16];
+
+    switch(d->op){
+        case OP_MOV:
+        case OP_CMP:
+        case OP_ADD:
+        case OP_SUB:
+            formatOperand(m, srcText, d->srcMode, d->srcReg, &next);
+            formatOperand(m, dstText, d->dstMode, d->dstReg, &next);
+            sprintf(buf, "%s %s,%s", opNames[d->op], srcText, dstText);
+            break;
+        case OP_ASR:
+        case OP_ASL:
+        case OP_CLR:
+        case OP_INC:
+        case OP_DEC:
+        case OP_NEG:
+        case OP_TST:
+            formatOperand(m, dstText, d->dstMode, d->dstReg, &next);
+            sprintf(buf, "%s %s", opNames[d->op], dstText);
+            break;
+        case OP_JSR:
+            formatOperand(m, dstText, d->dstMode, d->dstReg, &next);
+            sprintf(buf, "jsr r%d,%s", d->srcReg, dstText);
+            break;
+        case OP_RTS:
+            sprintf(buf, "rts r%d", d->dstReg);
+            break;
+        case OP_RTI:
+            sprintf(buf, "rti");
+            break;
+        case OP_MUL:
+        case OP_DIV:
+        case OP_ASH:
+        case OP_ASHC:
+            formatOperand(m, srcText, d->dstMode, d->dstReg, &next);
+            sprintf(buf, "%s %s,r%d", opNames[d->op], srcText, d->srcReg);
+            break;
+        case OP_SOB:
+            sprintf(buf, "sob r%d,%04o", d->srcReg, (pc + 2 - 2 * d->offset) & 0177777);
+            break;
+        case OP_HALT:
+            sprintf(buf, "halt");
+            break;
+        default:
+            if(isBranch(d->op)){
+                sprintf(buf, "%s %04o", opNames[d->op], (pc + 2 + 2 * d->offset) & 0177777);
+                break;
+            }
+            sprintf(buf, ".word %06o", word);
+            break;
+    }
+    return instructionWords(word);
+}
+
+#ifdef CACHE_SIM
+/* one cache of a --cache spec, up to the comma after it; */ 
+/*   false if it is not kind=size/ways/line[/wb|/wt]      */ 
+static bool parseCache(const char **p, char *kind, cache_config_t *c){
+    const char *s = *p;
+    char *end;
+
+    *kind = s[0];
+    if((*kind != 'i' && *kind != 'd' && *kind != 'u') || s[1] != '='){
+        return false;
+    }
+    c->size = strtol(s + 2, &end, 10);
+    if(*end == 'K' || *end == 'k'){
+        c->size *= 1024;
+        end++;
+    }
+    if(*end != '/'){
+        return false;
+    }
+    c->ways = strtol(end + 1, &end, 10);
+    if(*end != '/'){
+        return false;
+    }
+    c->lineBytes = strtol(end + 1, &end, 10);
+    c->writeThrough = strncmp(end, "/wt", 3) == 0;
+    if(strncmp(end, "/wt", 3) == 0 || strncmp(end, "/wb", 3) == 0){
+        end += 3;
+    }
+    if(*end == ',' && end[1] != '\0'){
+        end++;
+    }
+    else if(*end != '\0'){
+        return false;
+    }
+    *p = end;
+    return true;
+}
+
+/* --cache: the hierarchy, first level first, as caches     */ 
+/*   kind=size/ways/line[/wb|/wt] separated by commas; kind */ 
+/*   is i and d for the halves of a split first level, or u */ 
+/*   for a unified level. False, with a message, if spec    */ 
+/*   does not describe one; "" for no caches                */ 
+bool configureCaches(const char *spec){
+    const char *p = spec;
+
+    cacheCount = cacheLevels = 0;
+    instructionCache = dataCache = -1;
+    while(*p != '\0'){
+        cache_config_t *c = &cacheConfig[cacheCount];
+        char kind;
+        int sets;
+
+        if(cacheCount == CACHE_MAX){
+            printf("Error: --cache %s: at most %d caches\n", spec, CACHE_MAX);
+            return false;
+        }
+        if(!parseCache(&p, &kind, c)){
+            printf("Error: --cache %s: expected caches kind=size/ways/line[/wb|/wt], kind i, d or u\n", spec);
+            return false;
+        }
+        sets = c->ways > 0 && c->lineBytes > 0 ? c->size / (c->ways * c->lineBytes) : 0;
+        if(c->lineBytes < 2 || (c->lineBytes & (c->lineBytes - 1)) != 0 || sets < 1 || (sets & (sets - 1)) != 0 ||
+           sets * c->ways * c->lineBytes != c->size || c->size > 0200000){
+            printf("Error: --cache %s: a cache must hold a power of two sets of ways lines, lines a power of two bytes, at most 64 KB in all\n", spec);
+            return false;
+        }
+        if((kind == 'i' && cacheCount != 0) || (kind == 'd' && (cacheCount != 1 || instructionCache != 0)) ||
+           (kind != 'd' && cacheCount == 1 && instructionCache == 0)){
+            printf("Error: --cache %s: a split first level is an i cache, then a d cache\n", spec);
+            return false;
+        }
+        if(kind == 'u'){
+            c->level = cacheLevels++;
+            snprintf(c->name, sizeof(c->name), "L%d", c->level + 1);
+            if(cacheCount == 0){
+                instructionCache = dataCache = 0;
+            }
+        }
+        else{
+            c->level = 0;
+            snprintf(c->name, sizeof(c->name), "L1%c", kind);
+            if(kind == 'i'){
+                instructionCache = 0;
+                cacheLevels = 1;
+            }
+            else{
+                dataCache = 1;
+            }
+        }
+        cacheCount++;
+    }
+    if(instructionCache >= 0 && dataCache < 0){
+        printf("Error: --cache %s: an i cache needs a d cache beside it\n", spec);
+        return false;
+    }
+
+    /* misses at one level go to the cache of the next */ 
+    for(int i = 0; i < cacheCount; i++){
+        cacheConfig[i].next = -1;
+        for(int j = i + 1; j < cacheCount; j++){
+            if(cacheConfig[j].level == cacheConfig[i].level + 1){
+                cacheConfig[i].next = j;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/* empty caches for a machine, as --cache describes them */ 
+cache_state_t *newCaches(void){
+    cache_state_t *s = calloc(1, sizeof(cache_state_t));
+
+    if(s == NULL){
+        return NULL;
+    }
+    s->pcCounts = calloc((size_t)cacheLevels * PC_COUNTERS, sizeof(*s->pcCounts));
+    if(s->pcCounts == NULL){
+        freeCaches(s);
+        return NULL;
+    }
+    for(int i = 0; i < cacheCount; i++){
+        const cache_config_t *config = &cacheConfig[i];
+        cache_t *c = &s->caches[i];
+
+        c->sets = config->size / (config->ways * config->lineBytes);
+        c->lineShift = __builtin_ctz(config->lineBytes);
+        c->lines = calloc((size_t)c->sets * config->ways, sizeof(cache_line_t));
+        if(c->lines == NULL){
+            freeCaches(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+void freeCaches(cache_state_t *s){
+    if(s == NULL){
+        return;
+    }
+    for(int i = 0; i < cacheCount; i++){
+        free(s->caches[i].lines);
+    }
+    free(s->pcCounts);
+    free(s);
+}
+
+/* every line invalid and every count zero, as resetMachine() */ 
+/*   leaves the other counters                                */ 
+void clearCaches(cache_state_t *s){
+    for(int i = 0; i < cacheCount; i++){
+        cache_t *c = &s->caches[i];
+
+        memset(c->lines, 0, (size_t)c->sets * cacheConfig[i].ways * sizeof(cache_line_t));
+        c->accesses = c->hits = c->misses = c->evictions = c->writebacks = 0;
+    }
+    memset(s->pcCounts, 0, (size_t)cacheLevels * PC_COUNTERS * sizeof(*s->pcCounts));
+    s->clock = 0;
+    s->pc = 0;
+}
+
+/* look addr up in cache i, LRU within a set; a miss fills */ 
+/*   the line from the next level, after writing back the  */ 
+/*   dirty line it replaces. Write-through caches pass     */ 
+/*   every write on, and do not fill on a write miss       */ 
+static void accessCache(cache_state_t *s, int i, int addr, bool write){
+    const cache_config_t *config = &cacheConfig[i];
+    cache_t *c = &s->caches[i];
+    unsigned long (*counts)[MEM_SIZE_IN_WORDS] = &s->pcCounts[config->level * PC_COUNTERS];
+    int line = (addr & 0177777) >> c->lineShift;
+    cache_line_t *set = &c->lines[(line & (c->sets - 1)) * config->ways];
+    cache_line_t *victim = set;
+
+    c->accesses++;
+    s->clock++;
+    for(int w = 0; w < config->ways; w++){
+        if(set[w].valid && set[w].line == line){
+            c->hits++;
+            counts[PC_HITS][s->pc]++;
+            set[w].used = s->clock;
+            if(write && config->writeThrough && config->next >= 0){
+                accessCache(s, config->next, addr, true);
+            }
+            else if(write){
+                set[w].dirty = !config->writeThrough;
+            }
+            return;
+        }
+        if(set[w].used < victim->used){
+            victim = &set[w]; //invalid lines were last used at 0
+        }
+    }
+
+    c->misses++;
+    counts[PC_MISSES][s->pc]++;
+    if(write && config->writeThrough){
+        if(config->next >= 0){
+            accessCache(s, config->next, addr, true);
+        }
+        return;
+    }
+    if(victim->valid){
+        c->evictions++;
+        counts[PC_EVICTIONS][s->pc]++;
+        if(victim->dirty){
+            c->writebacks++;
+            if(config->next >= 0){
+                accessCache(s, config->next, victim->line << c->lineShift, true);
+            }
+        }
+    }
+    if(config->next >= 0){
+        accessCache(s, config->next, addr, false);
+    }
+    victim->line = line;
+    victim->valid = true;
+    victim->dirty = write;
+    victim->used = s->clock;
+}
+
+/* CACHE_ACCESS(): one guest access of the given kind */ 
+void cacheAccess(cache_state_t *s, int kind, int addr){
+    if(kind == ACCESS_INSTRUCTION){
+        s->pc = (addr & 0177777) >> 1;
+    }
+    if(kind == ACCESS_READ || kind == ACCESS_WRITE){
+        accessCache(s, dataCache, addr, kind == ACCESS_WRITE);
+    }
+    else{
+        accessCache(s, instructionCache, addr, false);
+    }
+}
+
+static unsigned long missesAt(const cache_state_t *s, int w){
+    unsigned long misses = 0;
+
+    for(int level = 0; level < cacheLevels; level++){
+        misses += s->pcCounts[level * PC_COUNTERS + PC_MISSES][w];
+    }
+    return misses;
+}
+
+/* --cache: what each cache did, then the PCs that missed */ 
+/*   most, with what they did at each level               */ 
+void printCaches(machine_t *m){
+    const cache_state_t *s = m->cache;
+    int top[CACHE_TOP_PCS];
+    int count = 0;
+    char text[48], label[24];
+
+    fprintf(m->out, "cache statistics (in decimal):\n");
+    for(int i = 0; i < cacheCount; i++){
+        const cache_config_t *config = &cacheConfig[i];
+        const cache_t *c = &s->caches[i];
+
+        fprintf(m->out, "  %s: %d bytes, %d-way, %d byte lines, %s\n", config->name, config->size, config->ways,
+                config->lineBytes, config->writeThrough ? "write-through" : "write-back");
+        fprintf(m->out, "    accesses                = %lu\n", c->accesses);
+        fprintf(m->out, "    hits                    = %lu", c->hits);
+        if(c->accesses > 0){
+            fprintf(m->out, " (%0.1f%%)\n", (double)c->hits*100/c->accesses);
+        }
+        else{
+            fprintf(m->out, "\n");
+        }
+        fprintf(m->out, "    misses                  = %lu\n", c->misses);
+        fprintf(m->out, "    evictions               = %lu\n", c->evictions);
+        if(!config->writeThrough){
+            fprintf(m->out, "    lines written back      = %lu\n", c->writebacks);
+        }
+    }
+
+    /* keep the CACHE_TOP_PCS with the most misses, in order */ 
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        unsigned long misses = missesAt(s, w);
+        int i;
+
+        if(misses == 0){
+            continue;
+        }
+        for(i = count; i > 0 && missesAt(s, top[i - 1]) < misses; i--){
+            if(i < CACHE_TOP_PCS){
+                top[i] = top[i - 1];
+            }
+        }
+        if(i < CACHE_TOP_PCS){
+            top[i] = w;
+            count += count < CACHE_TOP_PCS;
+        }
+    }
+    if(count == 0){
+        return;
+    }
+    fprintf(m->out, "cache hits, misses and evictions by PC (in decimal), most misses first:\n");
+    fprintf(m->out, "  addr  %-24s", "instruction");
+    for(int level = 0; level < cacheLevels; level++){
+        snprintf(label, sizeof(label), "L%d hits", level + 1);
+        fprintf(m->out, "  %9s %9s %9s", label, "misses", "evictions");
+    }
+    fprintf(m->out, "\n");
+    for(int i = 0; i < count; i++){
+        disassemble(m, 2 * top[i], text);
+        fprintf(m->out, "  %04o  %-24s", 2 * top[i], text);
+        for(int level = 0; level < cacheLevels; level++){
+            fprintf(m->out, "  %9lu %9lu %9lu", s->pcCounts[level * PC_COUNTERS + PC_HITS][top[i]],
+                    s->pcCounts[level * PC_COUNTERS + PC_MISSES][top[i]], s->pcCounts[level * PC_COUNTERS + PC_EVICTIONS][top[i]]);
+        }
+        fprintf(m->out, "\n");
+    }
+}
+#endif
+
+/* write the -p results: an annotated listing of every PC that */ 
+/*   executed, with opcode class and addressing mode totals,   */ 
+/*   and a folded-stack file (program;block;instruction count) */ 
+/*   for flamegraph tools                                      */ 
+void writeProfile(machine_t *m){
+    static const char *const modeNames[8] = {
+        "register", "register deferred", "autoincrement", "autoincrement deferred",
+        "autodecrement", "autodecrement deferred", "index", "index deferred"
+    };
+    unsigned char leader[MEM_SIZE_IN_WORDS];
+    const char *name = m->programFile != NULL ? m->programFile : "stdin";
+    char base[256], listName[272], foldedName[272], text[48];
+    unsigned long opTotals[OP_COUNT] = {0};
+    unsigned long srcModes[8] = {0}, dstModes[8] = {0};
+    FILE *list, *folded;
+    char *dot;
+    int block = 0, expected = -1;
+
+    snprintf(base, sizeof(base), "%s", m->programFile != NULL ? m->programFile : "pdp11");
+    dot = strrchr(base, '.');
+    if(dot != NULL && strchr(dot, '/') == NULL){
+        *dot = '\0';
+    }
+    snprintf(listName, sizeof(listName), "%s.prof", base);
+    snprintf(foldedName, sizeof(foldedName), "%s.folded", base);
+    list = fopen(listName, "w");
+    folded = fopen(foldedName, "w");
+    if(list == NULL || folded == NULL){
+        fprintf(m->out, "Error: cannot write profile %s\n", list == NULL ? listName : foldedName);
+        return;
+    }
+
+    /* basic blocks start at 0 and after and at the target of */ 
+    /*   every branch that executed                           */ 
+    memset(leader, 0, sizeof(leader));
+    leader[0] = 1;
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        const decoded_t *d = &decodeTable[m->mem[w]];
+        int pc = 2 * w;
+
+        if(m->pcCounts[w] == 0){
+            continue;
+        }
+        if(isBranch(d->op) && d->op != OP_SOB){
+            leader[((pc + 2 + 2 * d->offset) & 0177777) >> 1] = 1;
+        }
+        if(d->op == OP_SOB){
+            leader[((pc + 2 - 2 * d->offset) & 0177777) >> 1] = 1;
+        }
+        if(endsBlock(d->op)){
+            int after = w + instructionWords(m->mem[w]);
+
+            if(after < MEM_SIZE_IN_WORDS) leader[after] = 1;
+        }
+    }
+
+    fprintf(list, "profile of %s (%d instructions executed)\n\n", name, m->instrExecs);
+    fprintf(list, "  addr    word        count       %%  instruction\n");
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        const decoded_t *d = &decodeTable[m->mem[w]];
+        int pc = 2 * w;
+
+        if(m->pcCounts[w] == 0){
+            continue;
+        }
+        if(leader[w] || pc != expected){
+            block = pc;
+            fprintf(list, "\n");
+        }
+        expected = pc + 2 * disassemble(m, pc, text);
+        fprintf(list, "  %04o  %06o  %11lu  %5.1f%%  ", pc, m->mem[w], m->pcCounts[w],
+                (double)m->pcCounts[w] * 100 / m->instrExecs);
+        if(isBranch(d->op)){
+            fprintf(list, "%-24s  taken %lu, not taken %lu\n", text, m->takenCounts[w], m->pcCounts[w] - m->takenCounts[w]);
+        }
+        else{
+            fprintf(list, "%s\n", text);
+        }
+
+        for(char *c = text; *c != '\0'; c++){
+            if(*c == ' ' || *c == ';') *c = '_';
+        }
+        fprintf(folded, "%s;block_%04o;%04o_%s %lu\n", name, block, pc, text, m->pcCounts[w]);
+    }
 
-            get_operand( &src ); 
+    for(int op = 0; op < OP_COUNT; op++){
+        for(int sm = 0; sm < 8; sm++){
+            for(int dm = 0; dm < 8; dm++){
+                unsigned long n = m->opModeCounts[op][sm][dm];
 
-            result = src.value;
+                opTotals[op] += n;
+                if(op == OP_MOV || op == OP_CMP || op == OP_ADD || op == OP_SUB){
+                    srcModes[sm] += n;
+                }
+                if(op == OP_MOV || op == OP_CMP || op == OP_ADD || op == OP_SUB ||
+                   (op >= OP_ASR && op <= OP_ASHC && op != OP_RTS && op != OP_RTI)){
+                    dstModes[dm] += n;
+                }
+            }
+        }
+    }
 
-            sign_bit = result & 0100000;
+    fprintf(list, "\nopcode class        count       %%\n");
+    for(int op = 0; op < OP_COUNT; op++){
+        if(opTotals[op] > 0){
+            fprintf(list, "  %-10s  %11lu  %5.1f%%\n", opNames[op], opTotals[op],
+                    (double)opTotals[op] * 100 / m->instrExecs);
+        }
+    }
 
-            n_psw = 0;
-            if(sign_bit){ n_psw = 1;}
+    fprintf(list, "\naddressing mode                 src count    dst count\n");
+    for(int mode = 0; mode < 8; mode++){
+        fprintf(list, "  %d %-24s  %11lu  %11lu\n", mode, modeNames[mode], srcModes[mode], dstModes[mode]);
+    }
 
-            z_psw = 0;
-            if(result == 0){ z_psw = 1; }
+    fclose(list);
+    fclose(folded);
+    fprintf(m->out, "profile written to %s and %s\n", listName, foldedName);
+}
 
-            v_psw = 0;
+//How control leaves one translated instruction
+enum {
+    FLOW_NEXT, //on to *next
+    FLOW_BRANCH, //to *target, and on to *next unless it is -1
+    FLOW_JUMP, //to a PC only known at run time, through the dispatch switch
+    FLOW_HALT,
+    FLOW_EXIT //not translated, left to the interpreter
+};
 
-            if(verboseMode){
-                printf("  src.value = 0%06o\n", src.value);
-                printf("  nzvc bits = 4'b%o%o%o%o\n", n_psw, z_psw, v_psw, c_psw);
-            }
+//State of one --translate run
+typedef struct translation_t{
+    machine_t *m;
+    FILE *out; //NULL while the code is being discovered
+    unsigned char *code; //words the generated code depends on
+    bool dispatch; //some instruction jumps through the dispatch switch
+} translation_t;
 
-            put_result( &dst, result);
-        } else if( (ir >> 12) == 02 ){ //ref 4-26
-            if(verboseMode || traceMode){ 
-                printf("cmp instruction ");
-                printSrcDst(); 
-            }
-            
-            get_operand( &src );
-            get_operand( &dst );
+static void emitC(translation_t *t, const char *format, ...){
+    va_list args;
 
-            result = src.value - dst.value;
+    if(t->out == NULL){
+        return;
+    }
+    va_start(args, format);
+    vfprintf(t->out, format, args);
+    va_end(args);
+}
 
-            c_psw = (result & 0200000) >> 16;
-            result = result & CLAMP_16_BIT;
+/* C for get_operand_mode() or a PC-relative handler: the */ 
+/*   operand into v and its address into a; *p follows    */ 
+/*   reg[7], which is a constant at every instruction     */ 
+static void translateGet(translation_t *t, int mode, int r, int *p, const char *v, const char *a){
+    if(r == 7){
+        switch(mode){
+            case 0:
+                emitC(t, "    %s = 0%06o;\n", v, *p);
+                break;
+            case 1:
+                emitC(t, "    %s = 0%06o; %s = RD(%s);\n", a, *p, v, a);
+                break;
+            case 2:
+                t->code[*p >> 1] = 1;
+                emitC(t, "    %s = 0%06o; %s = 0%06o; fetches++;\n", a, *p, v, peek_word(t->m, *p));
+                *p = (*p + 2) & 0177777;
+                break;
+            case 3:
+                t->code[*p >> 1] = 1;
+                emitC(t, "    %s = 0%06o; %s = RD(%s); fetches += 2;\n", a, peek_word(t->m, *p), v, a);
+                *p = (*p + 2) & 0177777;
+                break;
+            case 4:
+                *p = (*p - 2) & 0177777;
+                emitC(t, "    %s = 0%06o; %s = RD(%s); fetches++;\n", a, *p, v, a);
+                break;
+            case 5:
+                *p = (*p - 2) & 0177777;
+                emitC(t, "    %s = RD(0%06o); %s = RD(%s); fetches += 2;\n", a, *p, v, a);
+                break;
+            default:
+                *p = (*p + 2) & 0177777;
+                emitC(t, "    %s = 0%06o; x = RD((%s + 2) * 2); %s = RD(%s + x); reads += 5; fetches -= 2;\n",
+                      a, *p, a, v, a);
+                break;
+        }
+        return;
+    }
 
-            sign_bit = result & 0100000;
+    switch(mode){
+        case 0:
+            emitC(t, "    %s = r%d;\n", v, r);
+            break;
+        case 1:
+            emitC(t, "    %s = r%d; %s = RD(%s);\n", a, r, v, a);
+            break;
+        case 2:
+            emitC(t, "    %s = r%d; %s = RD(%s); fetches++; r%d = (r%d + 2) & 0177777;\n", a, r, v, a, r, r);
+            break;
+        case 3:
+            emitC(t, "    %s = RD(r%d); %s = RD(%s); fetches += 2; r%d = (r%d + 2) & 0177777;\n", a, r, v, a, r, r);
+            break;
+        case 4:
+            emitC(t, "    r%d = (r%d - 2) & 0177777; %s = r%d; %s = RD(%s); fetches++;\n", r, r, a, r, v, a);
+            break;
+        case 5:
+            emitC(t, "    r%d = (r%d - 2) & 0177777; %s = RD(r%d); %s = RD(%s); fetches += 2;\n", r, r, a, r, v, a);
+            break;
+        default:
+            *p = (*p + 2) & 0177777;
+            emitC(t, "    %s = r%d; x = RD((%s + 2) * 2); %s = RD(%s + x); reads += 5; fetches -= 2;\n",
+                  a, r, a, v, a);
+            break;
+    }
+}
 
-            n_psw = 0;
-            if( sign_bit ) { n_psw = 1; }
+/* C for address_operand_mode(), the address alone into a; */ 
+/*   returns the address when it is a constant, else -1    */ 
+static int translateAddress(translation_t *t, int mode, int r, int *p, const char *a){
+    int x;
 
-            z_psw = 0;
-            if( result == 0 ) { z_psw = 1; }
+    if(mode >= 6){
+        t->code[*p >> 1] = 1;
+        x = peek_word(t->m, *p);
+        *p = (*p + 2) & 0177777;
+        if(r == 7 && mode == 6){
+            emitC(t, "    %s = 0%06o; fetches++;\n", a, (*p + x) & 0177777);
+            return (*p + x) & 0177777;
+        }
+        if(r == 7){
+            emitC(t, "    %s = RD(0%06o); fetches += 2;\n", a, (*p + x) & 0177777);
+        }
+        else if(mode == 6){
+            emitC(t, "    %s = (r%d + 0%06o) & 0177777; fetches++;\n", a, r, x);
+        }
+        else{
+            emitC(t, "    %s = RD((r%d + 0%06o) & 0177777); fetches += 2;\n", a, r, x);
+        }
+        return -1;
+    }
 
-            v_psw = 0;
-            if( ((src.value & 0100000) != (dst.value & 0100000)) && ((src.value & 0100000) == (result & 0100000)) ){
-                v_psw = 1;
-            }
+    if(r == 7){
+        switch(mode){
+            case 1:
+                emitC(t, "    %s = 0%06o;\n", a, *p);
+                return *p;
+            case 2:
+                emitC(t, "    %s = 0%06o;\n", a, *p);
+                *p = (*p + 2) & 0177777;
+                return (*p - 2) & 0177777;
+            case 3:
+                t->code[*p >> 1] = 1;
+                x = peek_word(t->m, *p);
+                emitC(t, "    %s = 0%06o; fetches++;\n", a, x);
+                *p = (*p + 2) & 0177777;
+                return x;
+            case 4:
+                *p = (*p - 2) & 0177777;
+                emitC(t, "    %s = 0%06o;\n", a, *p);
+                return *p;
+            default:
+                *p = (*p - 2) & 0177777;
+                emitC(t, "    %s = RD(0%06o); fetches++;\n", a, *p);
+                return -1;
+        }
+    }
 
-            if(verboseMode){
-                printf("  src.value = 0%06o\n", src.value);
-                printf("  dst.value = 0%06o\n", dst.value);
-                printf("  result    = 0%06o\n", result);
-                printf("  nzvc bits = 4'b%o%o%o%o\n", n_psw, z_psw, v_psw, c_psw);
-            }
-        } else if( (ir >> 12) == 06) { //ref 4-27
-            if(verboseMode || traceMode){ 
-                printf("add instruction ");
-                printSrcDst(); 
-            }
+    switch(mode){
+        case 1:
+            emitC(t, "    %s = r%d;\n", a, r);
+            break;
+        case 2:
+            emitC(t, "    %s = r%d; r%d = (r%d + 2) & 0177777;\n", a, r, r, r);
+            break;
+        case 3:
+            emitC(t, "    %s = RD(r%d); fetches++; r%d = (r%d + 2) & 0177777;\n", a, r, r, r);
+            break;
+        case 4:
+            emitC(t, "    r%d = (r%d - 2) & 0177777; %s = r%d;\n", r, r, a, r);
+            break;
+        default:
+            emitC(t, "    r%d = (r%d - 2) & 0177777; %s = RD(r%d); fetches++;\n", r, r, a, r);
+            break;
+    }
+    return -1;
+}
 
-            get_operand( &src );
-            get_operand( &dst );
+/* C for put_result_mode() or a PC-relative handler storing */ 
+/*   v; true if it is a jump, a MOV into the PC             */ 
+static bool translatePut(translation_t *t, int mode, int r, int *p, const char *v){
+    if(mode == 0){
+        if(r == 7){
+            t->dispatch = true;
+            emitC(t, "    pc = %s; goto dispatch;\n", v);
+            return true;
+        }
+        emitC(t, "    r%d = %s;\n", r, v);
+        return false;
+    }
 
-            result = src.value + dst.value;
+    if(r == 7){
+        switch(mode){
+            case 2:
+                emitC(t, "    da = 0%06o;\n", *p);
+                *p = (*p + 2) & 0177777;
+                break;
+            case 3:
+                t->code[*p >> 1] = 1;
+                emitC(t, "    da = 0%06o;\n", peek_word(t->m, *p));
+                *p = (*p + 2) & 0177777;
+                break;
+            case 4:
+                *p = (*p - 2) & 0177777;
+                emitC(t, "    da = 0%06o;\n", *p);
+                break;
+            case 5:
+                *p = (*p - 2) & 0177777;
+                emitC(t, "    da = RD(0%06o);\n", *p);
+                break;
+            default:
+                emitC(t, "    da = 0%06o;\n", *p);
+                break;
+        }
+    }
+    else{
+        switch(mode){
+            case 2:
+                emitC(t, "    da = r%d; r%d = (r%d + 2) & 0177777;\n", r, r, r);
+                break;
+            case 3:
+                emitC(t, "    da = RD(r%d); r%d = (r%d + 2) & 0177777;\n", r, r, r);
+                break;
+            case 4:
+                emitC(t, "    r%d = (r%d - 2) & 0177777; da = r%d;\n", r, r, r);
+                break;
+            case 5:
+                emitC(t, "    r%d = (r%d - 2) & 0177777; da = RD(r%d);\n", r, r, r);
+                break;
+            default:
+                emitC(t, "    da = r%d;\n", r);
+                break;
+        }
+    }
+    emitC(t, "    writes++; WR(da, %s, 0%06o);\n", v, *p);
+    return false;
+}
 
-            c_psw = (result & 0200000) >> 16;
-            result = result & CLAMP_16_BIT;
+/* C for update_operand(): result back to the destination */ 
+/*   getDst computed; true if it is a jump                */ 
+static bool translateUpdate(translation_t *t, int mode, int r, int p){
+    if(mode != 0){
+        emitC(t, "    WR(da, result, 0%06o);\n", p);
+        return false;
+    }
+    if(r == 7){
+        t->dispatch = true;
+        emitC(t, "    pc = result; goto dispatch;\n");
+        return true;
+    }
+    emitC(t, "    r%d = result;\n", r);
+    return false;
+}
 
-            sign_bit = result & 0100000;
-            n_psw = 0;
-            if( sign_bit ) { n_psw = 1; }
+/* C for the instruction at pc, with the same effect on the */ 
+/*   registers, memory, flags and counters as its handler;  */ 
+/*   sets *next and *target as the returned FLOW_ says      */ 
+int translateInstruction(translation_t *t, int pc, int *next, int *target){
+    const decoded_t *d = &decodeTable[peek_word(t->m, pc)];
+    int p = (pc + 2) & 0177777; //reg[7] after the fetch
+    char text[64];
+    bool jump = false;
 
-            z_psw = 0;
-            if( result == 0 ) { z_psw = 1; }
+    *next = *target = -1;
+    disassemble(t->m, pc, text);
+    if(d->op == OP_ILLEGAL || (d->op == OP_SOB && d->srcReg == 7)){
+        emitC(t, "    /* 0%06o: %s, left to the interpreter */\n    pc = 0%06o; goto leave;\n", pc, text, pc);
+        return FLOW_EXIT;
+    }
 
-            v_psw = 0;
-            if( ((src.value & 0100000) != (dst.value & 0100000)) && ((src.value & 0100000) == (result & 0100000)) ){
-                v_psw = 1;
-                if(result == 0177777) v_psw = 0;
+    t->code[pc >> 1] = 1;
+    emitC(t, "    /* 0%06o: %s */\n    execs++; fetches++;\n", pc, text);
+    switch(d->op){
+        case OP_HALT:
+            emitC(t, "    halt = 1; pc = 0%06o; goto leave;\n", p);
+            return FLOW_HALT;
+        case OP_MOV:
+            translateGet(t, d->srcMode, d->srcReg, &p, "src", "sa");
+            emitC(t, "    MOVFLAGS(src);\n");
+            jump = translatePut(t, d->dstMode, d->dstReg, &p, "src");
+            break;
+        case OP_CMP:
+            translateGet(t, d->srcMode, d->srcReg, &p, "src", "sa");
+            translateGet(t, d->dstMode, d->dstReg, &p, "dst", "da");
+            emitC(t, "    result = (src - dst) & 0177777; SETFLAGS(FLAGS_CMP, src, dst, result);\n");
+            break;
+        case OP_ADD:
+        case OP_SUB:
+            translateGet(t, d->srcMode, d->srcReg, &p, "src", "sa");
+            translateGet(t, d->dstMode, d->dstReg, &p, "dst", "da");
+            if(d->op == OP_ADD){
+                emitC(t, "    result = (src + dst) & 0177777; SETFLAGS(FLAGS_ADD, src, dst, result);\n");
             }
-            if(result == 0177776 && (src.value >> 15 == 0)) v_psw = 1;
-
-           if(verboseMode){
-                printf("  src.value = 0%06o\n", src.value);
-                printf("  dst.value = 0%06o\n", dst.value);
-                printf("  result    = 0%06o\n", result);
-                printf("  nzvc bits = 4'b%o%o%o%o\n", n_psw, z_psw, v_psw, c_psw);
+            else{
+                emitC(t, "    result = (dst - src) & 0177777; SETFLAGS(FLAGS_SUB, src, dst, result);\n");
             }
-
-            update_operand(&dst, result);
-        } else if( (ir >> 12) == 016) { //ref 4-28
-            if(verboseMode || traceMode){ 
-                printf("sub instruction ");
-                printSrcDst(); 
+            jump = translateUpdate(t, d->dstMode, d->dstReg, p);
+            break;
+        case OP_ASR:
+        case OP_ASL:
+            translateGet(t, d->dstMode, d->dstReg, &p, "dst", "da");
+            if(d->op == OP_ASR){
+                emitC(t, "    result = ((dst >> 1) | 0100000) & 0177777; SETFLAGS(FLAGS_ASR, 0, dst, result);\n");
             }
-
-            get_operand( &src );
-            get_operand( &dst );
-
-            result = dst.value - src.value;
-            //C: cleared if there was a carry from the most significant bit of
-            //the result; set otherwise 
-            c_psw = (result & 0200000) >> 16;
-            result = result & CLAMP_16_BIT;
-
-            sign_bit = result & 0100000;
-
-            //N: set if result <0; cleared otherwise
-            n_psw = 0;
-            if( sign_bit ) { n_psw = 1; }
-            //Z: set if result = 0; cleared otherwise
-            z_psw = 0;
-            if( result == 0 ) { z_psw = 1; }
-            //V: set if there was arithmetic overflow as a result of the oper·
-            //ation, that is if operands were of opposite signs and the sign
-            //of the source was the same as the sign of the result; cleared
-            //otherwise
-            v_psw = 0;
-            if( ((src.value & 0100000) != (dst.value & 0100000)) && ((src.value & 0100000) == (result & 0100000)) ){
-                v_psw = 1;
+            else{
+                emitC(t, "    result = (dst << 1) & 0177777; SETFLAGS(FLAGS_ASL, 0, dst, result);\n");
             }
-
-            if(verboseMode){
-                printf("  src.value = 0%06o\n", src.value);
-                printf("  dst.value = 0%06o\n", dst.value);
-                printf("  result    = 0%06o\n", result);
-                printf("  nzvc bits = 4'b%o%o%o%o\n", n_psw, z_psw, v_psw, c_psw);
+            jump = translateUpdate(t, d->dstMode, d->dstReg, p);
+            break;
+        case OP_SOB:
+            *target = (p - 2 * d->offset) & 0177777;
+            *next = p;
+            emitC(t, "    branches++; r%d = r%d - 1;\n    if(r%d != 0){ taken++; goto L%06o; }\n",
+                  d->srcReg, d->srcReg, d->srcReg, *target);
+            return FLOW_BRANCH;
+        case OP_BR:
+            *target = (p + 2 * d->offset) & 0177777;
+            emitC(t, "    branches++; taken++; goto L%06o;\n", *target);
+            return FLOW_BRANCH;
+        case OP_BNE:
+        case OP_BEQ:
+            *target = (p + 2 * d->offset) & 0177777;
+            *next = p;
+            emitC(t, "    branches++;\n    if(lf.result %s 0){ taken++; goto L%06o; }\n",
+                  d->op == OP_BNE ? "!=" : "==", *target);
+            return FLOW_BRANCH;
+        case OP_CLR:
+            emitC(t, "    SETFLAGS(FLAGS_PSW, 0, 0, 0);\n");
+            jump = translatePut(t, d->dstMode, d->dstReg, &p, "0");
+            break;
+        case OP_INC:
+        case OP_DEC:
+        case OP_NEG:
+        case OP_TST:
+            translateGet(t, d->dstMode, d->dstReg, &p, "dst", "da");
+            if(d->op == OP_INC || d->op == OP_DEC){
+                /* C is kept: x holds it while the flags are replaced */ 
+                emitC(t, "    x = lazyNzvc(&lf, &cf) & 1; result = (dst %s 1) & 0177777;\n", d->op == OP_INC ? "+" : "-");
+                emitC(t, "    SETFLAGS(FLAGS_PSW, (result == 0%06o) << 1 | x, 0, result);\n", d->op == OP_INC ? 0100000 : 077777);
             }
-
-            update_operand(&dst, result);
-        } else if( (ir >> 9) == 077) { //ref 4-61
-            if (verboseMode || traceMode) {
-                printf("sob instruction reg %d ", src.reg);
+            else if(d->op == OP_NEG){
+                emitC(t, "    result = (-dst) & 0177777; SETFLAGS(FLAGS_SUB, dst, 0, result);\n");
             }
-
-            offset = ir & 077; //6-bit signed offset
-
-            if (verboseMode || traceMode) printf("with offset 0%02o\n", offset);
-
-            offset = offset << 26; //sign extend to 32 bits
-            offset = offset >> 26;
-
-            result = reg[src.reg];
-            result--;
-
-            reg[src.reg] = result;
-
-            if(result != 0){
-                reg[7] =  ( reg[7] - (offset << 1)) & 0177777;
-                branch_taken++;
+            else{
+                emitC(t, "    SETFLAGS(FLAGS_PSW, 0, 0, dst);\n");
+                break;
+            }
+            jump = translateUpdate(t, d->dstMode, d->dstReg, p);
+            break;
+        case OP_JSR:
+            /* the return address and a constant target start */ 
+            /*   blocks, reached again through the dispatch    */ 
+            *target = translateAddress(t, d->dstMode, d->dstReg, &p, "da");
+            *next = p;
+            t->dispatch = true;
+            emitC(t, "    r6 = (r6 - 2) & 0177777; sa = r6;\n");
+            if(d->srcReg == 7){
+                emitC(t, "    src = 0%06o;\n", p);
             }
             else{
-                reg[7] = reg[7];
+                emitC(t, "    src = r%d; r%d = 0%06o;\n", d->srcReg, d->srcReg, p);
             }
-            
-            branches++;
-        } else if( (ir >> 8) == 001) { //ref 4-35
-            if(verboseMode || traceMode) {
-                printf("br instruction ");
+            emitC(t, "    writes++; WR(sa, src, da);\n    pc = da; goto dispatch;\n");
+            return FLOW_BRANCH;
+        case OP_RTS:
+            t->dispatch = true;
+            emitC(t, "    src = RD(r6); fetches++; r6 = (r6 + 2) & 0177777;\n");
+            if(d->dstReg == 7){
+                emitC(t, "    pc = src; goto dispatch;\n");
             }
+            else{
+                emitC(t, "    pc = r%d; r%d = src; goto dispatch;\n", d->dstReg, d->dstReg);
+            }
+            return FLOW_JUMP;
+        case OP_RTI:
+            /* no devices here: only the condition codes of the PSW */ 
+            t->dispatch = true;
+            emitC(t, "    src = RD(r6); dst = RD(r6 + 2); fetches += 2; r6 = (r6 + 4) & 0177777;\n");
+            emitC(t, "    pswFlags(dst, &lf);\n    pc = src; goto dispatch;\n");
+            return FLOW_JUMP;
+        case OP_MUL:
+        case OP_DIV:
+        case OP_ASH:
+        case OP_ASHC:
+            translateGet(t, d->dstMode, d->dstReg, &p, "dst", "da");
+            emitC(t, "    {\n        int reg[8] = { r0, r1, r2, r3, r4, r5, r6, 0%06o };\n\n", p);
+            emitC(t, "        eisOperation(0%06o, dst, reg, &lf);\n", peek_word(t->m, pc));
+            for(int r = d->srcReg; r <= (d->srcReg | 1); r++){
+                if(r == 7){
+                    jump = true;
+                    t->dispatch = true;
+                    emitC(t, "        pc = reg[7]; goto dispatch;\n");
+                }
+                else{
+                    emitC(t, "        r%d = reg[%d];\n", r, r);
+                }
+            }
+            emitC(t, "    }\n");
+            break;
+        default: //the other conditional branches
+            *target = (p + 2 * d->offset) & 0177777;
+            *next = p;
+            emitC(t, "    branches++;\n    if(branchCondition(0%06o, lazyNzvc(&lf, &cf))){ taken++; goto L%06o; }\n",
+                  peek_word(t->m, pc), *target);
+            return FLOW_BRANCH;
+    }
+    if(jump){
+        return FLOW_JUMP;
+    }
+    *next = p;
+    return FLOW_NEXT;
+}
 
-            offset = ir & 0377; //8-bit signed offset
-
-            if (verboseMode || traceMode) printf("with offset 0%03o\n", offset);
+/* write the loaded program out as a C function, one label per   */ 
+/*   basic block reachable from 0, to be built with pdp11.c      */ 
+/*   and -DTRANSLATED; jumps to code it could not find and       */ 
+/*   stores into the translated code hand over to the embedded   */ 
+/*   interpreter, so the result always matches running the .in   */ 
+bool translateProgram(machine_t *m, const char *fileName){
+    translation_t t = { m, NULL, NULL, false };
+    unsigned char *seen = calloc(MEM_SIZE_IN_WORDS, 1);
+    unsigned char *preds = calloc(MEM_SIZE_IN_WORDS, 1);
+    unsigned char *leader = calloc(MEM_SIZE_IN_WORDS, 1);
+    int *pending = malloc((2 * MEM_SIZE_IN_WORDS + 1) * sizeof(int));
+    int count = 0, marked = 0, next, target, flow;
+    const char *name = m->programFile != NULL ? m->programFile : "stdin";
+    FILE *out = NULL;
+    bool written = false;
 
-            offset = offset << 24; //sign extend to 32 bits
-            offset = offset >> 24;
+    t.code = calloc(MEM_SIZE_IN_WORDS, 1);
+    if(seen == NULL || preds == NULL || leader == NULL || pending == NULL || t.code == NULL){
+        fprintf(m->out, "Error: out of memory for translation\n");
+        goto done;
+    }
 
-            reg[7] =  ( reg[7] + (offset << 1)) & 0177777;
-            branch_taken++;
+    /* find the code by following the control flow from 0; a */ 
+    /*   block starts at every branch target and fall-through */ 
+    /*   and wherever two paths meet                         */ 
+    leader[0] = 1;
+    pending[count++] = 0;
+    while(count > 0){
+        int pc = pending[--count];
 
-            branches++;
+        if(seen[pc >> 1]){
+            continue;
+        }
+        seen[pc >> 1] = 1;
+        flow = translateInstruction(&t, pc, &next, &target);
+        for(int i = 0; i < 2; i++){
+            int to = i == 0 ? target : next;
 
-        } else if( (ir >> 8) == 002) { //ref 4-36   
-            if(verboseMode || traceMode) {
-                printf("bne instruction ");
+            if(to < 0){
+                continue;
             }
-
-            offset = ir & 0377; //8-bit signed offset
-
-            if (verboseMode || traceMode) printf("with offset 0%03o\n", offset);
-
-            offset = offset << 24; //sign extend to 32 bits
-            offset = offset >> 24;
-
-            if(!z_psw){
-                reg[7] =  ( reg[7] + (offset << 1)) & 0177777;
-                branch_taken++;
+            if(flow == FLOW_BRANCH){
+                leader[to >> 1] = 1;
             }
+            if(preds[to >> 1] < 2){
+                preds[to >> 1]++;
+            }
+            pending[count++] = to;
+        }
+    }
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        if(preds[w] > 1){
+            leader[w] = 1;
+        }
+    }
 
-            branches++;
+    out = fopen(fileName, "w");
+    if(out == NULL){
+        fprintf(m->out, "Error: cannot create %s\n", fileName);
+        goto done;
+    }
+    t.out = out;
 
-        } else if( (ir >> 8) == 003) { //ref 4-37
-            if(verboseMode || traceMode) {
-                printf("beq instruction ");
-            }
+    emitC(&t, "/* %s, translated to C by pdp11 --translate; build with */\n", name);
+    emitC(&t, "/*   cc -O2 -DTRANSLATED -pthread -I<dir> -o <program> <this file> <dir>/pdp11.c <dir>/main.c */\n");
+    emitC(&t, "/*   where <dir> holds pdp11.c and pdp11rt.h */\n");
+    emitC(&t, "#include \"pdp11rt.h\"\n\nconst char translatedName[] = \"");
+    for(const char *c = name; *c != '\0'; c++){
+        emitC(&t, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+    }
+    emitC(&t, "\";\nconst int translatedWords = %d;\nconst uint16_t translatedImage[] = {", m->programWords);
+    for(int i = 0; i < m->programWords; i++){
+        emitC(&t, i % 8 == 0 ? "\n    %07o," : " %07o,", m->mem[i]);
+    }
+    emitC(&t, m->programWords == 0 ? " 0 };\n\n" : "\n};\n\n");
 
-            offset = ir & 0377; //8-bit signed offset
+    emitC(&t, "/* words the code below depends on; a store into one */\n");
+    emitC(&t, "/*   leaves for the interpreter                      */\n");
+    emitC(&t, "static const unsigned char code[%d] = {", MEM_SIZE_IN_WORDS);
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        if(t.code[w]){
+            emitC(&t, marked++ % 8 == 0 ? "\n    [%d] = 1," : " [%d] = 1,", w);
+        }
+    }
+    emitC(&t, marked == 0 ? " 0 };\n\n" : "\n};\n\n");
 
-            if (verboseMode || traceMode) printf("with offset 0%03o\n", offset);
+    emitC(&t, "void runTranslated(translated_state_t *s){\n");
+    emitC(&t, "    uint16_t *mem = s->mem;\n");
+    emitC(&t, "    int r0 = s->reg[0], r1 = s->reg[1], r2 = s->reg[2], r3 = s->reg[3];\n");
+    emitC(&t, "    int r4 = s->reg[4], r5 = s->reg[5], r6 = s->reg[6];\n");
+    emitC(&t, "    int pc = s->reg[7];\n");
+    emitC(&t, "    lazy_flags_t lf = s->lastFlags, cf = s->carryFlags;\n");
+    emitC(&t, "    int halt = 0;\n");
+    emitC(&t, "    int execs = 0, fetches = 0, reads = 0, writes = 0, branches = 0, taken = 0;\n");
+    emitC(&t, "    int src = 0, dst = 0, sa = 0, da = 0, x = 0, result = 0;\n\n");
+    emitC(&t, "    (void)mem; (void)src; (void)dst; (void)sa; (void)da; (void)x; (void)result;\n");
+    emitC(&t, "    (void)code;\n\n");
+    if(t.dispatch){
+        emitC(&t, "dispatch:\n");
+    }
+    emitC(&t, "    switch(pc){\n");
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        if(leader[w]){
+            emitC(&t, "        case 0%06o: goto L%06o;\n", w << 1, w << 1);
+        }
+    }
+    emitC(&t, "    }\n    goto leave;\n");
 
-            offset = offset << 24; //sign extend to 32 bits
-            offset = offset >> 24;
+    for(int w = 0; w < MEM_SIZE_IN_WORDS; w++){
+        int pc = w << 1;
 
-            if(z_psw){
-                reg[7] =  ( reg[7] + (offset << 1)) & 0177777;
-                branch_taken++;
+        if(!leader[w]){
+            continue;
+        }
+        emitC(&t, "\nL%06o:\n", pc);
+        for(;;){
+            flow = translateInstruction(&t, pc, &next, &target);
+            if(flow == FLOW_NEXT && !leader[next >> 1]){
+                pc = next;
+                continue;
             }
-
-            branches++;
-        } else if( (ir >> 6) == 0062) { //ref 4-13
-            //TODO: Doesn't work
-            if(verboseMode || traceMode){ 
-                printf("asr instruction ");
-                printf("dm %d ", dst.mode);
-                printf("dr %d\n", dst.reg);
+            if(next >= 0){
+                emitC(&t, "    goto L%06o;\n", next);
             }
+            break;
+        }
+    }
 
-            // printf("\n\n  asr dst (begin) : \n");
-            // printf("        mode: %d\n", dst.mode);
-            // printf("        reg: %d\n", dst.reg);
-            // printf("        addr: %06o\n", dst.addr);
-            // printf("        value: %d\n\n", dst.value);
-
-            get_operand( &dst );
-
-            // printf("\n\n  asr dst (post get) : \n");
-            // printf("        mode: %d\n", dst.mode);
-            // printf("        reg: %d\n", dst.reg);
-            // printf("        addr: %06o\n", dst.addr);
-            // printf("        value: %d\n\n", dst.value);
+    emitC(&t, "\nleave:\n");
+    for(int r = 0; r < 7; r++){
+        emitC(&t, "    s->reg[%d] = r%d;\n", r, r);
+    }
+    emitC(&t, "    s->reg[7] = pc;\n");
+    emitC(&t, "    s->lastFlags = lf;\n    s->carryFlags = cf;\n    s->halt = halt;\n");
+    emitC(&t, "    s->instrExecs += execs;\n    s->instrFetches += fetches;\n");
+    emitC(&t, "    s->memReads += reads;\n    s->memWrites += writes;\n");
+    emitC(&t, "    s->branches += branches;\n    s->branch_taken += taken;\n}\n");
+    written = fclose(out) == 0;
+    if(!written){
+        fprintf(m->out, "Error: cannot write %s\n", fileName);
+    }
 
-            result = dst.value;
+done:
+    free(seen);
+    free(preds);
+    free(leader);
+    free(pending);
+    free(t.code);
+    return written;
+}
 
-            // result = result << 24; //sign extend
-            // result = result >> 24;
+#ifdef TRANSLATED
+/* the built-in program, loaded in place of loadMem()'s file */ 
+bool loadTranslated(machine_t *m){
+    m->programFile = translatedName;
+    if(verboseMode){
+        fprintf(m->out, "\nreading words in octal from %s:\n", translatedName);
+        for(int i = 0; i < translatedWords; i++){
+            fprintf(m->out, "  0%06o\n", translatedImage[i]);
+        }
+    }
+    memcpy(m->mem, translatedImage, translatedWords * sizeof(uint16_t));
+    m->programWords = translatedWords;
+    return true;
+}
 
-            // printf(" sign extended result: %016o\n", result);
+/* run the translated code from the machine's state until */ 
+/*   it halts or hands over to the interpreter            */ 
+void enterTranslated(machine_t *m){
+    translated_state_t s;
 
-            c_psw = result & 1;
+    s.mem = m->mem;
+    memcpy(s.reg, m->reg, sizeof(s.reg));
+    s.lastFlags = m->lastFlags;
+    s.carryFlags = m->carryFlags;
+    s.halt = m->halt;
+    s.instrExecs = m->instrExecs;
+    s.instrFetches = m->instrFetches;
+    s.memReads = m->memReads;
+    s.memWrites = m->memWrites;
+    s.branches = m->branches;
+    s.branch_taken = m->branch_taken;
 
-            result = result >> 1;
-            result = result | 0100000;
-            // printf(" result >> 1: %06o\n", result);
-            result = result & CLAMP_16_BIT;
-            // printf(" result & CLAMP_16_BIT: %06o\n", result);
+    runTranslated(&s);
 
-            n_psw = 0;
-            if(result >> 15 == 1){
-                n_psw = SET;
-            }
+    memcpy(m->reg, s.reg, sizeof(m->reg));
+    m->lastFlags = s.lastFlags;
+    m->carryFlags = s.carryFlags;
+    m->halt = s.halt;
+    m->instrExecs = s.instrExecs;
+    m->instrFetches = s.instrFetches;
+    m->memReads = s.memReads;
+    m->memWrites = s.memWrites;
+    m->branches = s.branches;
+    m->branch_taken = s.branch_taken;
+}
+#endif
 
-            z_psw = 0;
-            if(result == 0){
-                z_psw = 1;
-            }
+/* load the program from programFile (stdin by default): */ 
+/*   octal words as text, or a raw image with -r; false   */ 
+/*   after reporting the error if it cannot be loaded     */ 
+bool loadMem(machine_t *m) {
+    int fd = STDIN_FILENO;
+    size_t length;
+    bool mapped, loaded;
+    char *input;
 
-            v_psw = n_psw ^ c_psw;
+#ifdef TRANSLATED
+    /* the program is built in */ 
+    if(m->programFile != NULL){
+        fprintf(m->out, "Error: %s is built in, no program file is read\n", translatedName);
+        return false;
+    }
+    return loadTranslated(m);
+#endif
+    if(m->programFile != NULL){
+        fd = open(m->programFile, O_RDONLY);
+        if(fd < 0){
+            fprintf(m->out, "Error: cannot open %s\n", m->programFile);
+            return false;
+        }
+    }
 
-            if(verboseMode){
-                printf("  dst.value = 0%06o\n", dst.value);
-                printf("  result    = 0%06o\n", result);
-                printf("  nzvc bits = 4'b%o%o%o%o\n", n_psw, z_psw, v_psw, c_psw);
-            }
+    input = readInput(fd, &length, &mapped);
+    if(input == NULL){
+        fprintf(m->out, "Error: out of memory reading program\n");
+        if(fd != STDIN_FILENO){
+            close(fd);
+        }
+        return false;
+    }
 
-            update_operand( &dst, result);
+    if(rawImage){
+        loaded = loadImage(m, (const unsigned char*)input, length);
+    }
+    else{
+        if (verboseMode) {
+            fprintf(m->out, "\nreading words in octal from %s:\n", m->programFile != NULL ? m->programFile : "stdin");
+        }
+        loaded = loadOctal(m, input, length);
+    }
 
-            // printf("\n\n  asr dst (end) : \n");
-            // printf("        mode: %d\n", dst.mode);
-            // printf("        reg: %d\n", dst.reg);
-            // printf("        addr: %06o\n", dst.addr);
-            // printf("        value: %d\n\n", dst.value);
-        } else if( (ir >> 6) == 0063) { //ref 4-14
-            
-            if(verboseMode || traceMode){ 
-                printf("asl instruction ");
-                printf("dm %d ", dst.mode);
-                printf("dr %d\n", dst.reg);
-            }
+    if(mapped){
+        munmap(input, length);
+    }
+    else{
+        free(input);
+    }
+    if(fd != STDIN_FILENO){
+        close(fd);
+    }
+    return loaded;
+}
 
-            get_operand( &dst );
-            result = dst.value << 1;
+/* map the whole input if it is a regular file (this includes */ 
+/*   stdin redirected from a file), otherwise read it in large */ 
+/*   blocks; NULL if out of memory                             */ 
+char *readInput(int fd, size_t *length, bool *mapped){
+    struct stat info;
+    char *buffer;
+    size_t size, used = 0;
+    ssize_t n;
 
-            result = result & CLAMP_16_BIT;
+    if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+        buffer = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(buffer != MAP_FAILED){
+            *length = info.st_size;
+            *mapped = true;
+            return buffer;
+        }
+    }
 
-            c_psw = dst.value & 1;
-            if(dst.value == 0100101){ c_psw = 1; }
-            if(dst.value == 0040101){ c_psw = 0; }
+    size = 1 << 16;
+    buffer = malloc(size);
+    while(buffer != NULL && (n = read(fd, buffer + used, size - used)) > 0){
+        used += n;
+        if(used == size){
+            char *larger = realloc(buffer, size * 2);
 
-            n_psw = 0;
-            if(result >> 15 == 1){
-                n_psw = SET;
+            if(larger == NULL){
+                free(buffer);
+                return NULL;
             }
+            buffer = larger;
+            size *= 2;
+        }
+    }
+    if(buffer == NULL){
+        return NULL;
+    }
+    *length = used;
+    *mapped = false;
+    return buffer;
+}
 
-            z_psw = 0;
-            if(result == 0){
-                z_psw = 1;
-            }
+/* parse whitespace-separated octal words into mem[] */ 
+bool loadOctal(machine_t *m, const char *input, size_t length){
+    const char *p = input;
+    const char *end = input + length;
+    const char *start;
+    int instructionIn, count = 0;
 
-            v_psw = n_psw ^ c_psw;
+    for(;;){
+        while(p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')){
+            p++;
+        }
+        if(p == end){
+            break;
+        }
+        start = p;
 
-            if(verboseMode){
-                printf("  dst.value = 0%06o\n", dst.value);
-                printf("  result    = 0%06o\n", result);
-                printf("  nzvc bits = 4'b%o%o%o%o\n", n_psw, z_psw, v_psw, c_psw);
+        /* fast path for the usual six-digit word followed by */ 
+        /*   whitespace: check and convert all six digits at  */ 
+        /*   once, without a branch per character             */ 
+        if(end - p >= 8){
+            uint64_t word;
+            memcpy(&word, p, 8);
+            word = le64toh(word);
+            if((word & 0xF8F8F8F8F8F8ULL) == 0x303030303030ULL &&
+               (unsigned char)(word >> 48) <= ' '){
+                uint64_t digits = word & 0x070707070707ULL;
+                instructionIn = (int)(((digits & 7) << 15) | ((digits >> 8 & 7) << 12) |
+                                      ((digits >> 16 & 7) << 9) | ((digits >> 24 & 7) << 6) |
+                                      ((digits >> 32 & 7) << 3) | (digits >> 40 & 7));
+                p += 6;
+                goto store;
             }
+        }
 
-            update_operand( &dst, result);
-        } else{
-            printf("Error: no matching instruction" );
-            instrExecs--;
+        if(*p < '0' || *p > '7'){
+            fprintf(m->out, "Error: invalid octal word at offset %ld\n", (long)(p - input));
+            return false;
+        }
+        /* stop at the first digit too many, before the value */ 
+        /*   can overflow                                     */ 
+        instructionIn = 0;
+        while(p < end && *p >= '0' && *p <= '7' && instructionIn <= 0177777){
+            instructionIn = instructionIn * 8 + (*p - '0');
+            p++;
+        }
+        while(p < end && *p >= '0' && *p <= '7'){
+            p++;
         }
 
-        instrExecs++;
-        if(verboseMode){
-            printRegisters();
+    store:
+        if(count == MEM_SIZE_IN_WORDS){
+            fprintf(m->out, "Error: program is larger than memory (%d words)\n", MEM_SIZE_IN_WORDS);
+            return false;
         }
+        if(instructionIn > 0177777){
+            fprintf(m->out, "Error: word %.*s does not fit in 16 bits\n", (int)(p - start), start);
+            return false;
+        }
+        if (verboseMode) fprintf(m->out, "  0%06o\n", instructionIn);
+        m->mem[count] = instructionIn;
+        count++;
     }
-    if(verboseMode || traceMode) printf("\n");
-    printf("execution statistics (in decimal):\n");
-    printf("  instructions executed     = %d\n", instrExecs);
-    printf("  instruction words fetched = %d\n", instrFetches);
-    printf("  data words read           = %d\n", memReads);
-    printf("  data words written        = %d\n", memWrites);
-    printf("  branches executed         = %d\n", branches);
-    printf("  branches taken            = %d", branch_taken);
-    if(branch_taken > 0){
-        printf(" (%0.1f%%)\n", (double)branch_taken*100/branches);
-    }
-    else{
-        printf("\n");
-    }
+    m->programWords = count;
+    return true;
+}
 
-    if(verboseMode) {
-        printFirst20Mem();
+/* a raw image is a sequence of little-endian 16-bit words */ 
+/*   loaded from address 0                                 */ 
+bool loadImage(machine_t *m, const unsigned char *input, size_t length){
+    if(length % 2 != 0 || length > 2 * MEM_SIZE_IN_WORDS){
+        fprintf(m->out, "Error: image must be an even number of bytes, at most %d\n", 2 * MEM_SIZE_IN_WORDS);
+        return false;
     }
-    
-    return 0;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    memcpy(m->mem, input, length);
+#else
+    for(size_t i = 0; i < length / 2; i++){
+        m->mem[i] = input[2 * i] | (input[2 * i + 1] << 8);
+    }
+#endif
+    m->programWords = length / 2;
+    return true;
 }
 
-void loadMem() {
-    if (verboseMode) {
-        printf("\nreading words in octal from stdin:\n");
-    }
+/* write mem[] up to the last nonzero word as a raw image */ 
+bool writeImage(machine_t *m, const char *fileName){
+    FILE *out = fopen(fileName, "wb");
+    int words = MEM_SIZE_IN_WORDS;
 
-    int instructionIn, count = 0;
-    while( scanf("%o", &instructionIn) != EOF){
-        if (verboseMode) printf("  0%06o\n", instructionIn);
-        mem[count] = instructionIn;
-        count++;
+    if(out == NULL){
+        fprintf(m->out, "Error: cannot create %s\n", fileName);
+        return false;
     }
+    while(words > 0 && m->mem[words - 1] == 0){
+        words--;
+    }
+    for(int i = 0; i < words; i++){
+        fputc(m->mem[i] & 0377, out);
+        fputc((m->mem[i] >> 8) & 0377, out);
+    }
+    fclose(out);
+    return true;
 }
 
-void get_operand(address_phrase_t *phrase) {
+/* operand fetch for one (mode, reg) pair; only ever called */ 
+/*   with constant mode and r, so each handler generated    */ 
+/*   below compiles down to the code for a single case      */ 
+static inline __attribute__((always_inline))
+void get_operand_mode(machine_t *m, address_phrase_t *phrase, const int mode, const int r) {
+    int x;
 
-    assert((phrase->mode >= 0) && (phrase->mode <= 7));
-    assert((phrase->reg >= 0) && (phrase->reg <= 7));
-
-    switch(phrase->mode) {
+    switch(mode) {
         /*register*/
         //The operand is in Rn
         case 0:
-            phrase->value = reg[ phrase->reg ];
-            assert( phrase->value < 0200000);
+            phrase->value = m->reg[ r ];
+            CHECK( phrase->value < 0200000);
             phrase->addr = 0;
             break;
         //register indirect
         //Rn contains the address of the operand
         case 1:
-            phrase->addr = reg[phrase->reg]; /* address is in the register*/
-            assert( phrase->addr < 0200000);
-            phrase->value = mem[ phrase->addr >> 1]; // adjust to word address
-            assert(phrase->value < 0200000);
+            phrase->addr = m->reg[r]; /* address is in the register*/
+            CHECK( phrase->addr < 0200000);
+            CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+            phrase->value = read_word(m, phrase->addr);
             break;
         //autoincrement (post reference)
         //Rn contrains the address of the operand, then increment Rn
         case 2:
-            phrase->addr = reg[ phrase->reg ]; //address is in te register
-            assert( phrase->addr < 0200000);
-            phrase->value = mem[phrase->addr >> 1]; //adjust to word address
-            instrFetches++;
-            assert(phrase->value < 0200000);
-            reg[ phrase->reg] = (reg[phrase->reg] + 2 ) & 0177777;
+            phrase->addr = m->reg[ r ]; //address is in te register
+            CHECK( phrase->addr < 0200000);
+            CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+            phrase->value = read_word(m, phrase->addr);
+            m->instrFetches++;
+            m->reg[ r ] = (m->reg[r] + 2 ) & 0177777;
             break;
         //autoincrement indirect
         //Rn contains the address of the address of the operand, then increment Rn by 2
         case 3:
-            phrase->addr = reg[phrase->reg]; //addr of addr is in reg
-            assert(phrase->addr < 0200000);
-
-            phrase->addr = mem[ phrase->addr >> 1]; //adjust to word addr
-            instrFetches++;
-            assert( phrase->addr < 0200000);
+            phrase->addr = m->reg[r]; //addr of addr is in reg
+            CHECK(phrase->addr < 0200000);
 
-            phrase->value = mem[phrase->addr >> 1]; //adjust to word addr
-            instrFetches++;
-            assert(phrase->value < 0200000);
+            CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+            phrase->addr = read_word(m, phrase->addr);
+            m->instrFetches++;
 
-            reg[phrase->reg] = (reg[phrase->reg] + 2 ) & 0177777;
+            CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+            phrase->value = read_word(m, phrase->addr);
+            m->instrFetches++;
 
+            m->reg[r] = (m->reg[r] + 2 ) & 0177777;
             break;
         //autodecrement
         //Decrement Rn, then use the result as the address of the operand
         case 4:
-            reg[phrase->reg] = (reg[phrase->reg] - 2) & 0177777;
-            phrase->addr = reg[phrase->reg]; // address is in the register
-            assert(phrase->addr < 0200000);
+            m->reg[r] = (m->reg[r] - 2) & 0177777;
+            phrase->addr = m->reg[r]; // address is in the register
+            CHECK(phrase->addr < 0200000);
 
-            phrase->value = mem[ phrase->addr >> 1]; //adjust to word addr
-            instrFetches++;
-            assert(phrase->value < 0200000);
+            CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+            phrase->value = read_word(m, phrase->addr);
+            m->instrFetches++;
             break;
         //autodecrement indirect    
         //Decrement Rn by 2,then use the result as theaddress of the address of the operand
         case 5:
-            reg[phrase->reg] = (reg[phrase->reg] - 2) & 0177777;
-            phrase->addr = reg[phrase->reg]; // addr of addr is in reg
-            assert(phrase->addr < 02000000);
+            m->reg[r] = (m->reg[r] - 2) & 0177777;
+            phrase->addr = m->reg[r]; // addr of addr is in reg
+            CHECK(phrase->addr < 0200000);
 
-            phrase->addr = mem[phrase->addr >> 1 ]; //adjust to word addr
-            instrFetches++;
-            assert(phrase->addr < 0200000);
-
-            phrase->value = mem[ phrase->addr >> 1]; //adjust to word adr
-            instrFetches++;
-            assert(phrase->value < 0200000);
+            CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+            phrase->addr = read_word(m, phrase->addr);
+            m->instrFetches++;
 
+            CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+            phrase->value = read_word(m, phrase->addr);
+            m->instrFetches++;
             break;
         //index
         //Rn+X is the address of the operand
         case 6:
-            //TODO: Doesn't work
-            // printf("\n    Case 6 phrase (begin): \n");
-            // printf("        reg: %d\n", phrase->reg);
-            // printf("        mode: %06o\n", phrase->mode);
-            // printf("        addr: %06o\n", phrase->addr);
-            // printf("        value: %d\n\n", phrase->value);
-
-            //phrase->addr = reg[phrase->reg]; /* address is in the register*/
-            //assert( phrase->addr < 0200000);
-            //phrase->value = mem[ phrase->addr >> 1]; // adjust to word address
-            //assert(phrase->value < 0200000);
-
-            reg[7] = ( reg[7] + 2 ) & CLAMP_16_BIT; //increment r7 by 2
-            //phrase->addr = reg[phrase->reg]; //get contents of base register
-            //int x = mem[phrase->addr + 1]; //get index word
-            //phrase->addr = phrase->addr + x;
-
-            phrase->addr = reg[phrase->reg];
-
-            // printf("   reg[phrase->reg] contents: %06o\n", reg[phrase->reg]);
-
-            int x = mem[phrase->addr + 2];
-            // printf("    phrase->addr: %06o\n", phrase->addr);
-            // printf("    mem[phrase->addr] :%06o\n", mem[phrase->addr]);
-            // printf("    mem[phrase->addr + 2] (var x): %06o\n", x);
-            // printf("    phrase->addr + x: %06o\n", phrase->addr + x);
-            phrase->value = mem[(phrase->addr + x) / 2];
-            memReads+=5;
-            instrFetches-=2;
-            //instrFetches++;
-
-            // printf("\n    Case 6 phrase (end): \n");
-            // printf("        reg: %d\n", phrase->reg);
-            // printf("        mode: %06o\n", phrase->mode);
-            // printf("        addr: %06o\n", phrase->addr);
-            // printf("        value: %d\n\n", phrase->value);
-
-            break;
         //Index deferred
         //Rn+X is the address of the address of the operand
         case 7:
-            reg[7] = ( reg[7] + 2 ) & CLAMP_16_BIT;
-
-            phrase->addr = reg[phrase->reg];
-            int xx = mem[phrase->addr + 2];
-            phrase->value = mem[(phrase->addr + xx) / 2];
-            memReads+=5;
-            instrFetches-=2;
-            // printf("\n\n mode 7 mem[(phrase->addr + xx) / 2]: %06o\n", phrase->value);
-            // phrase->value = mem[phrase->value / 2];
-            // printf("       mem[phrase->value / 2] (new phrase->val): %06o \n\n", phrase->value);
+            //TODO: Doesn't work
+            m->reg[7] = ( m->reg[7] + 2 ) & CLAMP_16_BIT; //increment r7 by 2
 
-            break;
-        default:
-            printf("unimplemented address mode %o\n", phrase->mode);
+            phrase->addr = m->reg[r];
+            CACHE_ACCESS(m, ACCESS_READ, (phrase->addr + 2) * 2);
+            x = read_word(m, (phrase->addr + 2) * 2); //index word looked up by word address
+            CACHE_ACCESS(m, ACCESS_READ, phrase->addr + x);
+            phrase->value = read_word(m, phrase->addr + x);
+            m->memReads+=5;
+            m->instrFetches-=2;
             break;
     }
 }
 
-void update_operand(address_phrase_t *phrase, int newOp){
-    if(phrase->mode == 0) {
-        reg[phrase->reg] = newOp;
-    }
-    else {
-        mem[phrase->addr] = newOp;
+/* store a result at the effective address in phrase->addr */ 
+static inline void store_result(machine_t *m, address_phrase_t *phrase, int result) {
+    CACHE_ACCESS(m, ACCESS_WRITE, phrase->addr);
+    write_word(m, phrase->addr, result);
+    m->memWrites++;
+}
+
+/* effective address for storing a result; the same as the */ 
+/*   address computation in get_operand_mode() minus the   */ 
+/*   operand read                                          */ 
+static inline __attribute__((always_inline))
+void put_result_mode(machine_t *m, address_phrase_t *phrase, const int mode, const int r, int result) {
+    switch(mode) {
+        //register
+        case 0:
+            phrase->addr = 0;
+            m->reg[r] = result;
+            return;
+        //register indirect
+        case 1:
+            phrase->addr = m->reg[r];
+            break;
+        //autoincrement
+        case 2:
+            phrase->addr = m->reg[ r ];
+            m->reg[ r ] = (m->reg[r] + 2 ) & 0177777;
+            break;
+        //autoincrement indirect
+        case 3:
+            CACHE_ACCESS(m, ACCESS_READ, m->reg[r]);
+            phrase->addr = read_word(m, m->reg[r]);
+            m->reg[r] = (m->reg[r] + 2 ) & 0177777;
+            break;
+        //autodecrement
+        case 4:
+            m->reg[r] = (m->reg[r] - 2) & 0177777;
+            phrase->addr = m->reg[r];
+            break;
+        //autodecrement indirect
+        case 5:
+            m->reg[r] = (m->reg[r] - 2) & 0177777;
+            CACHE_ACCESS(m, ACCESS_READ, m->reg[r]);
+            phrase->addr = read_word(m, m->reg[r]);
+            break;
+        //index, index deferred
+        case 6:
+        case 7:
+            phrase->addr = m->reg[r];
+            break;
     }
+
+    store_result(m, phrase, result);
 }
 
-void put_result(address_phrase_t *phrase, int result){
+/* effective address alone, for JSR, which jumps to it */ 
+/*   and never reads the operand; unlike the quirky     */ 
+/*   index modes in get_operand_mode(), modes 6 and 7   */ 
+/*   take the index word that follows the instruction   */ 
+/*   and add it to Rn, which for the PC is the address  */ 
+/*   after that word                                    */ 
+static inline __attribute__((always_inline))
+void address_operand_mode(machine_t *m, address_phrase_t *phrase, const int mode, const int r) {
+    int x;
 
-    switch(phrase->mode) {
-        /*register*/
-        //The operand is in Rn
+    switch(mode) {
+        //register: JSR to a register traps, decode() never gets here
         case 0:
-            phrase->value = reg[ phrase->reg ];
             phrase->addr = 0;
             break;
         //register indirect
-        //Rn contains the address of the operand
         case 1:
-            phrase->addr = reg[phrase->reg]; /* address is in the register*/
-            phrase->value = mem[ phrase->addr >> 1]; // adjust to word address
+            phrase->addr = m->reg[r];
             break;
-        //autoincrement (post reference)
-        //Rn contrains the address of the operand, then increment Rn
+        //autoincrement
         case 2:
-            phrase->addr = reg[ phrase->reg ]; //address is in te register
-            phrase->value = mem[phrase->addr >> 1]; //adjust to word address
-            reg[ phrase->reg] = (reg[phrase->reg] + 2 ) & 0177777;
+            phrase->addr = m->reg[ r ];
+            m->reg[ r ] = (m->reg[r] + 2 ) & 0177777;
             break;
         //autoincrement indirect
-        //Rn contains the address of the address of the operand, then increment Rn by 2
         case 3:
-            phrase->addr = reg[phrase->reg]; //addr of addr is in reg
-            phrase->addr = mem[ phrase->addr >> 1]; //adjust to word addr
-            phrase->value = mem[phrase->addr >> 1]; //adjust to word addr
-            reg[phrase->reg] = (reg[phrase->reg] + 2 ) & 0177777;
-
+            CACHE_ACCESS(m, ACCESS_READ, m->reg[r]);
+            phrase->addr = read_word(m, m->reg[r]);
+            m->instrFetches++;
+            m->reg[r] = (m->reg[r] + 2 ) & 0177777;
             break;
         //autodecrement
-        //Decrement Rn, then use the result as the address of the operand
         case 4:
-            reg[phrase->reg] = (reg[phrase->reg] - 2) & 0177777;
-            phrase->addr = reg[phrase->reg]; // address is in the register
-            phrase->value = mem[ phrase->addr >> 1]; //adjust to word addr
+            m->reg[r] = (m->reg[r] - 2) & 0177777;
+            phrase->addr = m->reg[r];
             break;
-        //autodecrement indirect    
-        //Decrement Rn by 2,then use the result as theaddress of the address of the operand
+        //autodecrement indirect
         case 5:
-            reg[phrase->reg] = (reg[phrase->reg] - 2) & 0177777;
-            phrase->addr = reg[phrase->reg]; // addr of addr is in reg
-            phrase->addr = mem[phrase->addr >> 1 ]; //adjust to word addr
-            phrase->value = mem[ phrase->addr >> 1]; //adjust to word adr
-
+            m->reg[r] = (m->reg[r] - 2) & 0177777;
+            CACHE_ACCESS(m, ACCESS_READ, m->reg[r]);
+            phrase->addr = read_word(m, m->reg[r]);
+            m->instrFetches++;
             break;
-        //index
-        //Rn+X is the address of the operand
+        //index, index deferred
         case 6:
-            phrase->addr = reg[phrase->reg];
-            int x = mem[phrase->addr + 2];
-            phrase->value = mem[(phrase->addr + x) / 2];
-            
-            break;
-        //Index deferred
-        //Rn+X is the address of the address of the operand
         case 7:
-            phrase->addr = reg[phrase->reg];
-            int xx = mem[phrase->addr + 2];
-            phrase->value = mem[(phrase->addr + xx) / 2];
-            break;
-        default:
-            printf("unimplemented address mode %o\n", phrase->mode);
+            CACHE_ACCESS(m, ACCESS_FETCH, m->reg[7]);
+            x = read_word(m, m->reg[7]);
+            m->instrFetches++;
+            m->reg[7] = (m->reg[7] + 2) & 0177777;
+            phrase->addr = (m->reg[r] + x) & 0177777;
+            if(mode == 7){
+                CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+                phrase->addr = read_word(m, phrase->addr);
+                m->instrFetches++;
+            }
             break;
     }
-    
+}
+
+/* generate get_mM_rR(), put_mM_rR() and addr_mM_rR() for */ 
+/*   all 64 pairs                                         */ 
+#define ADDRESS_HANDLER(M, R) \
+    void get_m##M##_r##R(machine_t *m, address_phrase_t *phrase) { get_operand_mode(m, phrase, M, R); } \
+    void put_m##M##_r##R(machine_t *m, address_phrase_t *phrase, int result) { put_result_mode(m, phrase, M, R, result); } \
+    void addr_m##M##_r##R(machine_t *m, address_phrase_t *phrase) { address_operand_mode(m, phrase, M, R); }
+
+#define ADDRESS_HANDLERS(M) \
+    ADDRESS_HANDLER(M, 0) ADDRESS_HANDLER(M, 1) ADDRESS_HANDLER(M, 2) ADDRESS_HANDLER(M, 3) \
+    ADDRESS_HANDLER(M, 4) ADDRESS_HANDLER(M, 5) ADDRESS_HANDLER(M, 6) ADDRESS_HANDLER(M, 7)
+
+ADDRESS_HANDLERS(0)
+ADDRESS_HANDLERS(1)
+ADDRESS_HANDLERS(2)
+ADDRESS_HANDLERS(3)
+ADDRESS_HANDLERS(4)
+ADDRESS_HANDLERS(5)
+ADDRESS_HANDLERS(6)
+ADDRESS_HANDLERS(7)
+
+/* PC-relative forms: the operand or its address follows */ 
+/*   the instruction word                                */ 
+
+//immediate: #n
+void get_immediate(machine_t *m, address_phrase_t *phrase) {
+    phrase->addr = m->reg[7];
+    CACHE_ACCESS(m, ACCESS_FETCH, phrase->addr);
+    phrase->value = read_word(m, phrase->addr);
+    m->instrFetches++;
+    m->reg[7] = (m->reg[7] + 2) & 0177777;
+}
+
+//absolute: @#a
+void get_absolute(machine_t *m, address_phrase_t *phrase) {
+    CACHE_ACCESS(m, ACCESS_FETCH, m->reg[7]);
+    phrase->addr = read_word(m, m->reg[7]);
+    CACHE_ACCESS(m, ACCESS_READ, phrase->addr);
+    phrase->value = read_word(m, phrase->addr);
+    m->instrFetches += 2;
+    m->reg[7] = (m->reg[7] + 2) & 0177777;
+}
+
+//relative: a, and relative deferred: @a
+void get_relative(machine_t *m, address_phrase_t *phrase) {
+    int x;
+
+    m->reg[7] = (m->reg[7] + 2) & CLAMP_16_BIT;
+    phrase->addr = m->reg[7];
+    CACHE_ACCESS(m, ACCESS_READ, (phrase->addr + 2) * 2);
+    x = read_word(m, (phrase->addr + 2) * 2);
+    CACHE_ACCESS(m, ACCESS_READ, phrase->addr + x);
+    phrase->value = read_word(m, phrase->addr + x);
+    m->memReads += 5;
+    m->instrFetches -= 2;
+}
+
+void put_immediate(machine_t *m, address_phrase_t *phrase, int result) {
+    phrase->addr = m->reg[7];
+    m->reg[7] = (m->reg[7] + 2) & 0177777;
+    store_result(m, phrase, result);
+}
+
+void put_absolute(machine_t *m, address_phrase_t *phrase, int result) {
+    CACHE_ACCESS(m, ACCESS_FETCH, m->reg[7]);
+    phrase->addr = read_word(m, m->reg[7]);
+    m->reg[7] = (m->reg[7] + 2) & 0177777;
+    store_result(m, phrase, result);
+}
+
+void put_relative(machine_t *m, address_phrase_t *phrase, int result) {
+    phrase->addr = m->reg[7];
+    store_result(m, phrase, result);
+}
+
+#define ADDRESS_ROW(F, M) \
+    { F##_m##M##_r0, F##_m##M##_r1, F##_m##M##_r2, F##_m##M##_r3, \
+      F##_m##M##_r4, F##_m##M##_r5, F##_m##M##_r6, F##_m##M##_r7 }
+
+//Operand handlers indexed by [mode][reg], selected once per ir
+//when the decode table is built
+const operand_fn operandGetters[8][8] = {
+    ADDRESS_ROW(get, 0), ADDRESS_ROW(get, 1),
+    { get_m2_r0, get_m2_r1, get_m2_r2, get_m2_r3, get_m2_r4, get_m2_r5, get_m2_r6, get_immediate },
+    { get_m3_r0, get_m3_r1, get_m3_r2, get_m3_r3, get_m3_r4, get_m3_r5, get_m3_r6, get_absolute },
+    ADDRESS_ROW(get, 4), ADDRESS_ROW(get, 5),
+    { get_m6_r0, get_m6_r1, get_m6_r2, get_m6_r3, get_m6_r4, get_m6_r5, get_m6_r6, get_relative },
+    { get_m7_r0, get_m7_r1, get_m7_r2, get_m7_r3, get_m7_r4, get_m7_r5, get_m7_r6, get_relative },
+};
+
+const result_fn resultPutters[8][8] = {
+    ADDRESS_ROW(put, 0), ADDRESS_ROW(put, 1),
+    { put_m2_r0, put_m2_r1, put_m2_r2, put_m2_r3, put_m2_r4, put_m2_r5, put_m2_r6, put_immediate },
+    { put_m3_r0, put_m3_r1, put_m3_r2, put_m3_r3, put_m3_r4, put_m3_r5, put_m3_r6, put_absolute },
+    ADDRESS_ROW(put, 4), ADDRESS_ROW(put, 5),
+    { put_m6_r0, put_m6_r1, put_m6_r2, put_m6_r3, put_m6_r4, put_m6_r5, put_m6_r6, put_relative },
+    { put_m7_r0, put_m7_r1, put_m7_r2, put_m7_r3, put_m7_r4, put_m7_r5, put_m7_r6, put_relative },
+};
+
+//Address-only handlers for JSR; the PC needs no special
+//forms here, address_operand_mode() already covers it
+const operand_fn operandAddresses[8][8] = {
+    ADDRESS_ROW(addr, 0), ADDRESS_ROW(addr, 1), ADDRESS_ROW(addr, 2), ADDRESS_ROW(addr, 3),
+    ADDRESS_ROW(addr, 4), ADDRESS_ROW(addr, 5), ADDRESS_ROW(addr, 6), ADDRESS_ROW(addr, 7),
+};
+
+/* write back a read-modify-write result to the address */ 
+/*   the getDst handler already computed                */ 
+void update_operand(machine_t *m, address_phrase_t *phrase, int newOp){
     if(phrase->mode == 0) {
-        reg[phrase->reg] = result;
+        m->reg[phrase->reg] = newOp;
     }
     else {
-        if(verboseMode){
-            printf("  value 0%06o is written to 0%06o\n", result, phrase->addr);
-        }
-        mem[phrase->addr / 2] = result;
-        memWrites++;
+        CACHE_ACCESS(m, ACCESS_WRITE, phrase->addr);
+        write_word(m, phrase->addr, newOp);
     }
 }
 
-void printSrcDst(){
-    printf("sm %d, ", src.mode);
-    printf("sr %d ", src.reg);
-    printf("dm %d ", dst.mode);
-    printf("dr %d\n", dst.reg);
+void printSrcDst(machine_t *m){
+    fprintf(m->out, "sm %d, ", m->src.mode);
+    fprintf(m->out, "sr %d ", m->src.reg);
+    fprintf(m->out, "dm %d ", m->dst.mode);
+    fprintf(m->out, "dr %d\n", m->dst.reg);
 }
 
-void printRegisters(){
-    printf("  R0:0%06o  R2:0%06o  R4:0%06o  R6:0%06o\n", reg[0], reg[2], reg[4], reg[6]);
-    printf("  R1:0%06o  R3:0%06o  R5:0%06o  R7:0%06o\n", reg[1], reg[3], reg[5], reg[7]);
+void printRegisters(machine_t *m){
+    fprintf(m->out, "  R0:0%06o  R2:0%06o  R4:0%06o  R6:0%06o\n", m->reg[0], m->reg[2], m->reg[4], m->reg[6]);
+    fprintf(m->out, "  R1:0%06o  R3:0%06o  R5:0%06o  R7:0%06o\n", m->reg[1], m->reg[3], m->reg[5], m->reg[7]);
 }
 
-void printFirst20Mem(){
-    printf("\nfirst 20 words of memory after execution halts:\n");
+void printFirst20Mem(machine_t *m){
+    fprintf(m->out, "\nfirst 20 words of memory after execution halts:\n");
     for( int i = 0; i < 20; i++){
-        printf("  0%04o: %06o\n", 2*i, mem[i]);
+        fprintf(m->out, "  0%04o: %06o\n", 2*i, peek_word(m, 2*i));
     }
 }
\ No newline at end of file
@@ -0,0 +1,210 @@
+#ifndef PDP11_H
+#define PDP11_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//The simulator as a library, libpdp11.a or libpdp11.so; the pdp11
+//command (main.c) is a front end to it. A pdp11_t is one machine
+//with its own 64 KB of memory, registers, flags and counters, and
+//may run on a thread of its own. The options are shared by every
+//machine and are set once, before the first one is created
+
+#define PDP11_API __attribute__((visibility("default")))
+
+typedef struct machine_t pdp11_t;
+typedef struct snapshot_t pdp11_snapshot_t;
+
+//Settings shared by all machines; zero for each is the default
+typedef struct pdp11_options_t{
+    bool verbose; //-v: trace with values and registers, list what is loaded
+    bool trace; //-t: print each instruction as it executes
+    bool stats; //-s: block cache statistics after the run
+    bool rawImage; //-r: programs are raw little-endian images, not octal text
+    bool profile; //-p: write a profile of the run
+    int workers; //-j: threads for pdp11_run_batch(), 0 for one per CPU
+    const char *binaryTrace; //-T: record every instruction in this file
+    bool compressTrace; //-z: compress the binary trace
+    bool timing; //-c: count LSI-11 cycles, and report them with the statistics
+    const char *cache; //--cache: simulate this memory hierarchy, in a -DCACHE_SIM build
+    const char *console; //--console: a DL11 console at 0177560, its input from this file or - for stdin
+    long clock; //--clock: a KW11-L line clock ticking every this many instructions, or cycles with -c
+} pdp11_options_t;
+
+//Counters kept as a program runs, as -s and the usual report print them
+typedef struct pdp11_stats_t{
+    int instructions;
+    int fetches;
+    int memReads;
+    int memWrites;
+    int branches;
+    int branchesTaken;
+    unsigned long cycles; //with the -c timing model only
+} pdp11_stats_t;
+
+//What pdp11_get_history() reports of a recorded run; positions
+//count the instructions recorded before a point of the run
+typedef struct pdp11_history_t{
+    long first; //earliest position still recorded, -1 if not recording
+    long position; //where the machine is now
+    long end; //latest position recorded
+    long interval; //instructions between checkpoints
+    int checkpoints;
+    size_t pageBytes; //memory pages the checkpoints hold between them
+    size_t logBytes; //the instruction logs
+    size_t totalBytes; //all of the above and the checkpoints themselves
+    bool complete; //false once recording ran out of memory
+} pdp11_history_t;
+
+//What pdp11_run() and pdp11_step() stopped on
+enum {
+    PDP11_RUNNING, //the instruction budget ran out
+    PDP11_HALTED, //a HALT instruction was executed
+    PDP11_STOPPED //a breakpoint or watchpoint, with PDP11_WATCH_STOP
+};
+
+//Kinds for pdp11_watch(), which may be or'ed together
+#define PDP11_BREAK 1 //the PC reaching the word
+#define PDP11_WATCH_READ 2
+#define PDP11_WATCH_WRITE 4
+
+//What a breakpoint or watchpoint does when it is hit
+enum {
+    PDP11_WATCH_REPORT, //print it and the registers, and run on
+    PDP11_WATCH_LOG, //print it and the registers on one line, and run on
+    PDP11_WATCH_STOP //report it and stop the run after the instruction
+};
+
+#define PDP11_NO_LIMIT (-1L) //pdp11_run() until HALT, with every fast path
+
+/* false, with a message, if the options cannot be used. A  */
+/*   --cache hierarchy is caches kind=size/ways/line[/wb|/wt] */
+/*   separated by commas, first level first: kind is i then d */
+/*   for a split first level, or u for a unified level, and   */
+/*   the size may end in K. Each machine gets its own caches; */
+/*   write-back ones allocate on a write miss, write-through  */
+/*   ones do not. Runs are then interpreted, and report hits, */
+/*   misses and evictions by cache and by PC with the         */
+/*   statistics. The caches are not part of a snapshot, and   */
+/*   see the accesses pdp11_seek() replays. A --console puts  */
+/*   the DL11 registers RCSR, RBUF, XCSR and XBUF at 0177560  */
+/*   to 0177566 of every machine; input is read as the guest  */
+/*   polls RCSR, never waiting for it, and output is written  */
+/*   to the machine's output when 4 KB of it is held, when    */
+/*   the guest polls for input that is not there yet, and at  */
+/*   HALT. Unbounded runs are then interpreted. The console   */
+/*   is not part of a snapshot or of --sweep lanes, and the   */
+/*   reads and writes pdp11_seek() replays reach it again;    */
+/*   pdp11_read_word() and pdp11_write_word() see the memory  */
+/*   under it. A --clock puts the KW11-L status register at   */
+/*   0177546; with its bit 6 set each tick interrupts through */
+/*   the vector at 0100, at priority 6. Either device brings  */
+/*   in the PSW at 0177776: an interrupt above its priority   */
+/*   is taken between one instruction and the next, pushing   */
+/*   the PSW and PC on r6 and loading both from the vector,   */
+/*   and RTI pops them. Device time is kept in snapshots but  */
+/*   not snapshot files, and the pushes are not in the write  */
+/*   log pdp11_find_write() searches                          */
+PDP11_API bool pdp11_configure(const pdp11_options_t *options);
+
+/* a machine in its power-up state; error messages, and the */
+/*   report and traces of pdp11_run_program(), go to out,   */
+/*   which is not closed. NULL discards them                */
+PDP11_API pdp11_t *pdp11_create(FILE *out);
+PDP11_API void pdp11_destroy(pdp11_t *m);
+
+/* each clears the machine and loads a program at address 0, */
+/*   parsed straight from the caller's buffer; false, with   */
+/*   a message, if it is not a valid program                 */
+PDP11_API bool pdp11_load_octal(pdp11_t *m, const char *text, size_t length);
+PDP11_API bool pdp11_load_image(pdp11_t *m, const void *image, size_t length);
+PDP11_API bool pdp11_load_file(pdp11_t *m, const char *fileName); //stdin when NULL; -r picks the format
+
+/* back to the state just after the last load */
+PDP11_API void pdp11_reset(pdp11_t *m);
+
+/* run at most maxInstructions, or PDP11_NO_LIMIT; a bounded */
+/*   run is interpreted one instruction at a time            */
+PDP11_API int pdp11_run(pdp11_t *m, long maxInstructions);
+PDP11_API int pdp11_step(pdp11_t *m);
+PDP11_API bool pdp11_halted(pdp11_t *m);
+
+/* run until the PC reaches pc, interpreted as a bounded run; */
+/*   PDP11_RUNNING there, PDP11_HALTED if it halts first, and */
+/*   PDP11_STOPPED if a watchpoint stops it first             */
+PDP11_API int pdp11_run_to(pdp11_t *m, int pc, long maxInstructions);
+
+PDP11_API int pdp11_get_register(pdp11_t *m, int r);
+PDP11_API void pdp11_set_register(pdp11_t *m, int r, int value);
+PDP11_API int pdp11_read_word(pdp11_t *m, int addr);
+PDP11_API void pdp11_write_word(pdp11_t *m, int addr, int value);
+PDP11_API const uint16_t *pdp11_memory(pdp11_t *m); //all 32K words; write through pdp11_write_word()
+PDP11_API void pdp11_get_stats(pdp11_t *m, pdp11_stats_t *stats);
+
+/* set, or clear, breakpoints or watchpoints on the words   */
+/*   from first to last, as byte addresses; they are a bit  */
+/*   for each word, and hits are reported on the machine's  */
+/*   output. A breakpoint is hit when an instruction leaves */
+/*   the PC on it, a watchpoint as the guest reads or       */
+/*   writes the word, interrupt pushes too. Runs are then   */
+/*   interpreted; without any, nothing looks at the bits    */
+PDP11_API void pdp11_watch(pdp11_t *m, int kinds, int first, int last, bool set);
+PDP11_API void pdp11_watch_action(pdp11_t *m, int action); //PDP11_WATCH_REPORT by default
+
+/* the whole state of a machine: memory, registers, flags   */
+/*   and counters. It may be restored into any machine, any */
+/*   number of times; the memory is mapped copy-on-write,   */
+/*   so a restore costs only the pages the run then writes. */
+/*   Errors are reported on m's output                      */
+PDP11_API pdp11_snapshot_t *pdp11_snapshot(pdp11_t *m);
+PDP11_API bool pdp11_restore(pdp11_t *m, const pdp11_snapshot_t *s);
+PDP11_API void pdp11_free_snapshot(pdp11_snapshot_t *s);
+PDP11_API bool pdp11_write_snapshot(pdp11_t *m, const pdp11_snapshot_t *s, const char *fileName);
+PDP11_API pdp11_snapshot_t *pdp11_read_snapshot(pdp11_t *m, const char *fileName);
+
+/* time travel: from here on pdp11_run() and pdp11_step()   */
+/*   record a checkpoint every interval instructions (0 for */
+/*   10000), keeping the last keep of them (0 for all), and */
+/*   log the PC, memory write and register changes of each  */
+/*   instruction. Recording is interpreted, as a bounded    */
+/*   run is. Loading, resetting or restoring the machine    */
+/*   starts the history over                                */
+PDP11_API bool pdp11_record(pdp11_t *m, long interval, int keep);
+PDP11_API void pdp11_stop_recording(pdp11_t *m);
+PDP11_API long pdp11_position(pdp11_t *m); //-1 if not recording
+PDP11_API void pdp11_get_history(pdp11_t *m, pdp11_history_t *info);
+
+/* go back, or forward again, to any recorded position, by  */
+/*   replaying from the checkpoint before it; running from  */
+/*   an earlier position drops the history after it        */
+PDP11_API bool pdp11_seek(pdp11_t *m, long position);
+
+/* the position of the last instruction before this one     */
+/*   that ran at pc, or that wrote the word at addr, whose  */
+/*   PC and the value written go in *pc and *value (either  */
+/*   may be NULL); -1 if there is none in the history       */
+PDP11_API long pdp11_find_pc(pdp11_t *m, int pc);
+PDP11_API long pdp11_find_write(pdp11_t *m, int addr, int *pc, int *value);
+
+/* the command line modes: each runs or converts the loaded */
+/*   program and reports as the pdp11 command does          */
+PDP11_API bool pdp11_run_program(pdp11_t *m);
+PDP11_API void pdp11_benchmark(pdp11_t *m, int runs);
+PDP11_API bool pdp11_write_image(pdp11_t *m, const char *fileName);
+PDP11_API bool pdp11_translate(pdp11_t *m, const char *fileName);
+PDP11_API int pdp11_sweep(pdp11_t *m, const char *sweepFile);
+PDP11_API int pdp11_run_batch(const char **programFiles, int count);
+PDP11_API bool pdp11_decode_trace(const char *fileName);
+
+/* --fuzz: count random programs, numbered from seed, each   */
+/*   run by the interpreter and by the fast engine (blocks,  */
+/*   recognized loops and compiled code) in lockstep on the  */
+/*   -j workers. Registers, flags, counters and memory are   */
+/*   compared after every instruction, or every block the    */
+/*   fast engine runs whole; a program on which they differ  */
+/*   is shrunk and written to fuzz-SEED.in. 1 if any did     */
+PDP11_API int pdp11_fuzz(long count, unsigned long seed);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef PDP11RT_H
+#define PDP11RT_H
+
+#include <stdint.h>
+
+//Shared by pdp11.c and the C that --translate writes: the lazy
+//condition code records and the state handed between translated
+//code and the runtime (pdp11.c built with -DTRANSLATED)
+
+//Condition codes are evaluated lazily: each instruction only records
+//what it did, and N/Z/V/C are computed by get_n() etc. when read
+enum {
+    FLAGS_PSW, //explicit nzvc bits in src
+    FLAGS_MOV,
+    FLAGS_CMP,
+    FLAGS_ADD,
+    FLAGS_SUB,
+    FLAGS_ASR,
+    FLAGS_ASL
+};
+
+typedef struct lazy_flags_t{
+    int op;
+    int src;
+    int dst;
+    int result;
+} lazy_flags_t;
+
+//Machine state on entry to and exit from runTranslated(); the
+//counters are added to, never reset
+typedef struct translated_state_t{
+    uint16_t *mem;
+    int reg[8];
+    lazy_flags_t lastFlags;
+    lazy_flags_t carryFlags;
+    int halt;
+
+    int instrExecs;
+    int instrFetches;
+    int memReads;
+    int memWrites;
+    int branches;
+    int branch_taken;
+} translated_state_t;
+
+//From the runtime, for what the generated code does not do inline:
+//all four condition codes as the nzvc bits, whether the branch
+//instruction ir is taken on them, an EIS instruction (MUL, DIV,
+//ASH, ASHC) applied to the registers in reg, and the condition
+//codes of a PSW, as RTI restores them
+int lazyNzvc(const lazy_flags_t *last, const lazy_flags_t *carry);
+int branchCondition(int ir, int nzvc);
+void eisOperation(int ir, int src, int reg[8], lazy_flags_t *f);
+void pswFlags(int psw, lazy_flags_t *f);
+
+//Defined by the translated program
+extern const char translatedName[]; //the program it was translated from
+extern const uint16_t translatedImage[]; //memory as loaded
+extern const int translatedWords;
+
+/* run from reg[7] until HALT, or until the PC reaches code */
+/*   that was not translated or the program stores into its */
+/*   own code; reg[7] is then where the interpreter resumes */
+void runTranslated(translated_state_t*);
+
+/* helpers for the generated code, which keeps the guest */
+/*   registers, flags and counters in locals             */
+#define RD(a) mem[((a) & 0177777) >> 1]
+#define WR(a, v, next) do{ \
+        int w_ = ((a) & 0177777) >> 1; \
+        mem[w_] = (v); \
+        if(code[w_]){ pc = (next); goto leave; } \
+    }while(0)
+#define SETFLAGS(o, s, d, r) (lf.op = (o), lf.src = (s), lf.dst = (d), lf.result = (r))
+#define MOVFLAGS(v) do{ \
+        if(lf.op != FLAGS_MOV) cf = lf; \
+        lf.op = FLAGS_MOV; \
+        lf.result = (v); \
+    }while(0)
+
+#endif